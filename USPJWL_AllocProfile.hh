@@ -0,0 +1,95 @@
+// -*- C++ -*-
+
+// Per-analysis allocation accounting, compiled in only with
+// -DUSPJWL_ALLOC_PROFILE.
+//
+// The counting itself is done by replacements of the global operator
+// new/delete in tools/uspjwl-allocprofile.cc, which must be preloaded into
+// the job (LD_PRELOAD=libuspjwl-alloc.so): a replacement inside the
+// analysis plugin would not be seen by Rivet, FastJet or YODA. Every
+// analysis marks the calls it owns with
+//   USPJWL_ALLOC_SCOPE(name(), INIT);        first line of init()
+//   USPJWL_ALLOC_REPORT(name(), analysisObjects());   in finalize()
+// and analyze() through its Runtime::Event (see USPJWL_Runtime.hh), or
+// with USPJWL_ALLOC_SCOPE(name(), ANALYZE) if it has no Runtime, so that every allocation made while the scope is open (including the
+// projections it triggers) is charged to that analysis. The report gives
+// allocations and bytes per event, the peak of the bytes allocated by the
+// analysis and still live, and the size of its booked histograms.
+// Without the preloaded library the scopes find no tracker and do nothing.
+
+#ifndef USPJWL_ALLOCPROFILE_HH
+#define USPJWL_ALLOCPROFILE_HH
+
+#ifdef USPJWL_ALLOC_PROFILE
+
+#include "Rivet/Analysis.hh"
+#include "USPJWL_Persistent.hh"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Defined by the preloaded tracker, null when it is not loaded
+extern "C" {
+  void uspjwl_alloc_enter(const char* analysis, int phase, void** saved) __attribute__((weak));
+  void uspjwl_alloc_leave(void* saved) __attribute__((weak));
+  void uspjwl_alloc_report(const char* analysis, size_t histogramBytes) __attribute__((weak));
+}
+
+namespace USPJWL {
+
+  namespace AllocProfile {
+
+    enum Phase { INIT = 0, ANALYZE = 1 };
+
+
+    class Scope {
+    public:
+
+      Scope(const std::string& analysis, Phase phase) : _saved(nullptr) {
+        if (uspjwl_alloc_enter) uspjwl_alloc_enter(analysis.c_str(), phase, &_saved);
+      }
+
+      ~Scope() {
+        if (uspjwl_alloc_leave) uspjwl_alloc_leave(_saved);
+      }
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+
+    private:
+      void* _saved;
+    };
+
+
+    // Heap held by the accumulated histograms and counters (nominal weight;
+    // Rivet keeps one such copy per weight variation)
+    inline size_t histogramBytes(const std::vector<Rivet::MultiweightAOPtr>& aos) {
+      size_t bytes = 0;
+      for (const auto& h : persistentObjects<YODA::Histo1D>(aos))
+        bytes += sizeof(YODA::Histo1D) + h->numBins() * sizeof(YODA::HistoBin1D) + h->path().capacity();
+      for (const auto& c : persistentObjects<YODA::Counter>(aos))
+        bytes += sizeof(YODA::Counter) + c->path().capacity();
+      return bytes;
+    }
+
+
+    inline void report(const std::string& analysis, const std::vector<Rivet::MultiweightAOPtr>& aos) {
+      if (uspjwl_alloc_report) uspjwl_alloc_report(analysis.c_str(), histogramBytes(aos));
+    }
+
+  }
+
+}
+
+#define USPJWL_ALLOC_SCOPE(analysis, phase) USPJWL::AllocProfile::Scope uspjwl_alloc_scope(analysis, USPJWL::AllocProfile::phase)
+#define USPJWL_ALLOC_REPORT(analysis, aos) USPJWL::AllocProfile::report(analysis, aos)
+
+#else
+
+#define USPJWL_ALLOC_SCOPE(analysis, phase) ((void)0)
+#define USPJWL_ALLOC_REPORT(analysis, aos) ((void)0)
+
+#endif
+
+#endif
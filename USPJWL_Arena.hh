@@ -0,0 +1,135 @@
+// -*- C++ -*-
+
+// Per-event monotonic arena for analysis scratch data.
+//
+// Allocation is a pointer bump in a chunk owned by the arena. Nothing is
+// freed individually; reset() makes the whole arena reusable, and the
+// chunks are kept, so after the first events an analysis allocates no
+// heap memory for its scratch containers at all. Each analysis owns its
+// arena, so analyses on different threads never share an allocator.
+//
+// Usage in analyze():
+//   USPJWL::Arena::EventScope scratch(_arena);        // first, resets on return
+//   USPJWL::ScratchVector<int> v(_arena);
+// Containers must not outlive the event scope.
+
+#ifndef USPJWL_ARENA_HH
+#define USPJWL_ARENA_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace USPJWL {
+
+  class Arena {
+  public:
+
+    explicit Arena(size_t chunkSize = 1 << 16) : _chunkSize(chunkSize), _current(0), _offset(0), _used(0), _peak(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align) {
+      while (true) {
+        if (_current < _chunks.size()) {
+          Chunk& c = _chunks[_current];
+          uintptr_t base = reinterpret_cast<uintptr_t>(c.data.get());
+          size_t start = ((base + _offset + align - 1) & ~uintptr_t(align - 1)) - base;
+          if (start + bytes <= c.size) {
+            _offset = start + bytes;
+            _used += bytes;
+            _peak = std::max(_peak, _used);
+            return c.data.get() + start;
+          }
+          // The rest of this chunk stays unused until the next reset
+          _current++;
+          _offset = 0;
+          continue;
+        }
+        // Oversized requests get a chunk of their own
+        Chunk c;
+        c.size = std::max(_chunkSize, bytes + align);
+        c.data.reset(new char[c.size]);
+        _chunks.push_back(std::move(c));
+        _current = _chunks.size() - 1;
+        _offset = 0;
+      }
+    }
+
+    // Makes all memory reusable; containers using it must be gone
+    void reset() {
+      _current = 0;
+      _offset = 0;
+      _used = 0;
+    }
+
+    size_t bytesUsed() const { return _used; }
+    size_t peakBytes() const { return _peak; }
+    size_t numChunks() const { return _chunks.size(); }
+
+
+    // Resets the arena when the event is done, including vetoEvent returns
+    class EventScope {
+    public:
+      explicit EventScope(Arena& arena) : _arena(arena) {}
+      ~EventScope() { _arena.reset(); }
+      EventScope(const EventScope&) = delete;
+      EventScope& operator=(const EventScope&) = delete;
+    private:
+      Arena& _arena;
+    };
+
+  private:
+
+    struct Chunk {
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+
+    size_t _chunkSize;
+    std::vector<Chunk> _chunks;
+    size_t _current, _offset, _used, _peak;
+  };
+
+
+  // Standard allocator drawing from an Arena; deallocation is a no-op
+  template <typename T>
+  class ArenaAllocator {
+  public:
+
+    typedef T value_type;
+
+    ArenaAllocator(Arena& arena) noexcept : _arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : _arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) noexcept {}
+
+    Arena* arena() const noexcept { return _arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return _arena == other.arena(); }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return _arena != other.arena(); }
+
+  private:
+    Arena* _arena;
+  };
+
+
+  template <typename T>
+  using ScratchVector = std::vector<T, ArenaAllocator<T> >;
+
+}
+
+#endif
@@ -0,0 +1,219 @@
+// -*- C++ -*-
+
+// Compact binary container for the unscaled USPJWL histograms (.ybin),
+// written by the analyses at the end of a job (USPJWL_Runtime.hh) and read
+// by uspjwl-merge and uspjwl-binhisto.
+//
+// File layout (little endian, native alignment):
+//   FileHeader
+//   Record, Record, ...
+//   name table: uint32 length + bytes, for every string
+// Every record is
+//   RecordHeader
+//   double  edges[nBins + 1]              (HISTO1D only)
+//   double  stat[NSTATS][nBins + 3]       (HISTO1D)
+//   double  stat[NSTATS][1]               (COUNTER: sumw, sumw2, -, -, numEntries)
+//   char    text[textBytes], padding to 8 (TEXT: any other object, as YODA text)
+// The histogram slots are total, underflow, overflow and the bins, in the
+// order YODA writes them. The annotations (Path, Title, Type, ScaledBy,
+// ...) are kept as "Key: value" lines in the name table.
+//
+// Reading copies every array in one memcpy; no number is ever formatted
+// or parsed.
+
+#ifndef USPJWL_BINHISTO_HH
+#define USPJWL_BINHISTO_HH
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace BinHisto {
+
+    const char MAGIC[8] = {'U', 'S', 'P', 'J', 'W', 'L', 'B', 'H'};
+    const uint32_t VERSION = 1;
+
+    enum Kind { HISTO1D = 1, COUNTER = 2, TEXT = 3 };
+    enum Stat { SUMW, SUMW2, SUMWX, SUMWX2, NUMENTRIES, NSTATS };
+    enum Slot { TOTAL, UNDERFLOW, OVERFLOW, FIRSTBIN };
+
+    struct FileHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t nObjects;
+      uint64_t namesOffset;
+      uint64_t namesBytes;
+    };
+
+    struct RecordHeader {
+      uint32_t kind;
+      uint32_t nBins;
+      uint32_t pathIndex;
+      uint32_t annotationsIndex;
+      double scaledBy;
+      uint64_t textBytes;
+      uint64_t nBytes;      // Size of the record including this header
+    };
+
+    inline size_t padTo8(size_t n) { return (n + 7) & ~size_t(7); }
+
+
+    struct Object {
+      Kind kind = HISTO1D;
+      std::string path;
+      std::string annotations;      // "Key: value" lines separated by '\n'
+      double scaledBy = 1.;
+      std::vector<double> edges;
+      std::vector<double> data;     // NSTATS arrays of numSlots()
+      std::string text;             // TEXT objects: the full YODA block
+
+      size_t numBins() const { return edges.empty() ? 0 : edges.size() - 1; }
+      size_t numSlots() const { return kind == HISTO1D ? numBins() + FIRSTBIN : kind == COUNTER ? 1 : 0; }
+
+      void resize() { data.assign(NSTATS * numSlots(), 0.); }
+
+      double& at(int stat, size_t slot) { return data[stat * numSlots() + slot]; }
+      double at(int stat, size_t slot) const { return data[stat * numSlots() + slot]; }
+    };
+
+
+    // The whole file in memory
+    inline std::vector<char> encode(const std::vector<Object>& objects) {
+      std::vector<char> buf(sizeof(FileHeader));
+      std::vector<std::string> names;
+      auto append = [&buf](const void* p, size_t n) {
+        buf.insert(buf.end(), static_cast<const char*>(p), static_cast<const char*>(p) + n);
+      };
+
+      for (const Object& obj : objects) {
+        RecordHeader rh;
+        rh.kind = obj.kind;
+        rh.nBins = obj.numBins();
+        rh.pathIndex = names.size();
+        names.push_back(obj.path);
+        rh.annotationsIndex = names.size();
+        names.push_back(obj.annotations);
+        rh.scaledBy = obj.scaledBy;
+        rh.textBytes = obj.text.size();
+        rh.nBytes = sizeof(RecordHeader) + (obj.kind == HISTO1D ? obj.edges.size() * sizeof(double) : 0)
+                    + obj.data.size() * sizeof(double) + padTo8(obj.text.size());
+        if (obj.data.size() != NSTATS * obj.numSlots())
+          throw std::runtime_error("Inconsistent binary histogram " + obj.path);
+        append(&rh, sizeof(rh));
+        if (obj.kind == HISTO1D) append(obj.edges.data(), obj.edges.size() * sizeof(double));
+        append(obj.data.data(), obj.data.size() * sizeof(double));
+        append(obj.text.data(), obj.text.size());
+        buf.resize(padTo8(buf.size()), 0);
+      }
+
+      FileHeader fh;
+      std::memcpy(fh.magic, MAGIC, sizeof(MAGIC));
+      fh.version = VERSION;
+      fh.nObjects = objects.size();
+      fh.namesOffset = buf.size();
+      for (const std::string& s : names) {
+        uint32_t n = s.size();
+        append(&n, sizeof(n));
+        append(s.data(), n);
+      }
+      fh.namesBytes = buf.size() - fh.namesOffset;
+      std::memcpy(buf.data(), &fh, sizeof(fh));
+      return buf;
+    }
+
+
+    inline void write(const std::string& path, const std::vector<Object>& objects) {
+      const std::vector<char> buf = encode(objects);
+      std::FILE* f = std::fopen(path.c_str(), "wb");
+      if (!f) throw std::runtime_error("Cannot write " + path + ": " + std::strerror(errno));
+      bool ok = std::fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+      ok = (std::fclose(f) == 0) && ok;
+      if (!ok) throw std::runtime_error("Cannot write " + path);
+    }
+
+
+    inline bool isBinHisto(const std::string& path) {
+      std::FILE* f = std::fopen(path.c_str(), "rb");
+      if (!f) return false;
+      char magic[8];
+      bool ok = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+      std::fclose(f);
+      return ok;
+    }
+
+
+    // Objects of a file read into memory; source names it in errors
+    inline std::vector<Object> decode(const std::vector<char>& buf, const std::string& source) {
+      const std::runtime_error corrupt("Corrupt binary histogram file " + source);
+      if (buf.size() < sizeof(FileHeader)) throw corrupt;
+      FileHeader fh;
+      std::memcpy(&fh, buf.data(), sizeof(fh));
+      if (std::memcmp(fh.magic, MAGIC, sizeof(MAGIC)) != 0 || fh.version != VERSION)
+        throw std::runtime_error("Not a USPJWL binary histogram file: " + source);
+      if (fh.namesOffset + fh.namesBytes > buf.size()) throw corrupt;
+
+      std::vector<std::string> names;
+      for (size_t pos = fh.namesOffset; pos < fh.namesOffset + fh.namesBytes; ) {
+        uint32_t len;
+        std::memcpy(&len, &buf[pos], sizeof(len));
+        pos += sizeof(len);
+        if (pos + len > fh.namesOffset + fh.namesBytes) throw corrupt;
+        names.push_back(std::string(&buf[pos], len));
+        pos += len;
+      }
+
+      std::vector<Object> objects(fh.nObjects);
+      size_t pos = sizeof(FileHeader);
+      for (Object& obj : objects) {
+        RecordHeader rh;
+        if (pos + sizeof(rh) > fh.namesOffset) throw corrupt;
+        std::memcpy(&rh, &buf[pos], sizeof(rh));
+        if (pos + rh.nBytes > fh.namesOffset || rh.pathIndex >= names.size() || rh.annotationsIndex >= names.size())
+          throw corrupt;
+        obj.kind = Kind(rh.kind);
+        obj.path = names[rh.pathIndex];
+        obj.annotations = names[rh.annotationsIndex];
+        obj.scaledBy = rh.scaledBy;
+
+        if (obj.kind != HISTO1D && rh.nBins != 0) throw corrupt;
+        if (obj.kind == HISTO1D) obj.edges.resize(rh.nBins + 1);
+        if (rh.nBytes != sizeof(rh) + (obj.edges.size() + NSTATS * obj.numSlots()) * sizeof(double) + padTo8(rh.textBytes))
+          throw corrupt;
+
+        size_t p = pos + sizeof(rh);
+        if (obj.kind == HISTO1D) {
+          std::memcpy(obj.edges.data(), &buf[p], obj.edges.size() * sizeof(double));
+          p += obj.edges.size() * sizeof(double);
+        }
+        obj.resize();
+        std::memcpy(obj.data.data(), &buf[p], obj.data.size() * sizeof(double));
+        p += obj.data.size() * sizeof(double);
+        obj.text.assign(&buf[p], rh.textBytes);
+        pos += rh.nBytes;
+      }
+      return objects;
+    }
+
+
+    inline std::vector<Object> read(const std::string& path) {
+      std::FILE* f = std::fopen(path.c_str(), "rb");
+      if (!f) throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+      std::vector<char> buf;
+      char chunk[1 << 16];
+      size_t n;
+      while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+      std::fclose(f);
+      return decode(buf, path);
+    }
+
+  }
+
+}
+
+#endif
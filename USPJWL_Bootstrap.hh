@@ -0,0 +1,327 @@
+// -*- C++ -*-
+
+// Online Poisson-bootstrap replicas of the booked histograms.
+//
+// With USPJWL_BOOTSTRAP=K every analysis keeps K replicas of each booked
+// histogram and counter. Every event enters replica k with a Poisson(1)
+// multiplicity n_k, drawn from a counter-based generator keyed on
+// (USPJWL_BOOTSTRAP_SEED, HepMC event number, k), so the same event gets
+// the same multiplicities in every analysis and on every rerun. Jobs whose
+// inputs share event numbers need different seeds.
+//
+// Rivet applies an event's fills to the persistent histograms after
+// analyze(), so the replicas need no hook at the fill sites. At the end
+// of analyze() (Runtime::Event) the fills the event left in Rivet's
+// per-event proxies mark the bins they go to; at the start of the next
+// event (and at finalize) the change of each marked bin is added to the
+// replicas, scaled by that event's n_k: a replica sees each fill of weight
+// w with weight n_k w, so the changes of sumw, sumwx, sumwx2 and the
+// entries are scaled by n_k and that of sumw2 by n_k^2. The replica sums
+// of each bin statistic are stored next to each other, so this is one
+// contiguous multiply-add over K per filled bin and statistic; bins the
+// event did not fill are never read.
+//
+// At finalize the replicas are written to <prefix>_<ANALYSIS>.boot.ybin
+// (<prefix> is USPJWL_BOOTSTRAP_FILE, default "uspjwl") as copies of the
+// nominal objects with paths <path>[BOOT<k>], scaled like the nominal
+// ones; uspjwl-merge adds them across jobs like any other object. The
+// spread of a derived quantity over the replicas is its statistical
+// uncertainty, including correlations between bins and histograms.
+// Replicas cover the events analysed by the process: they are not carried
+// in checkpoints.
+
+#ifndef USPJWL_BOOTSTRAP_HH
+#define USPJWL_BOOTSTRAP_HH
+
+#include "Rivet/Analysis.hh"
+#include "USPJWL_BinHisto.hh"
+#include "USPJWL_Master.hh"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Bootstrap {
+
+    // SplitMix64 finaliser: a counter-based generator, one hash per draw
+    inline uint64_t mix(uint64_t x) {
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      return x ^ (x >> 31);
+    }
+
+
+    // Poisson(1) multiplicities of one event for replicas 0..K-1
+    class Multiplicities {
+    public:
+
+      static const int NMAX = 12;      // P(n > 12) ~ 1e-10
+
+      Multiplicities() {
+        // Cumulative distribution in units of 2^-53
+        double p = std::exp(-1.), c = 0.;
+        for (int n = 0; n < NMAX; n++) {
+          c += p;
+          p /= (n + 1);
+          _cdf[n] = uint64_t(std::ldexp(c, 53));
+        }
+      }
+
+      void draw(uint64_t seed, uint64_t event, std::vector<double>& n) const {
+        const uint64_t key = mix(seed ^ mix(event + 0x9e3779b97f4a7c15ULL));
+        for (size_t k = 0; k < n.size(); k++) {
+          const uint64_t u = mix(key + k * 0x9e3779b97f4a7c15ULL) >> 11;
+          int count = 0;
+          for (int j = 0; j < NMAX; j++) count += u >= _cdf[j];
+          n[k] = count;
+        }
+      }
+
+    private:
+      uint64_t _cdf[NMAX];
+    };
+
+
+    class Replicas {
+    public:
+
+      Replicas() : _k(0), _seed(0) {}
+
+      bool enabled() const { return _k > 0; }
+
+      void configure(const std::string& name, const std::vector<Rivet::MultiweightAOPtr>& aos) {
+        const char* k = getenv("USPJWL_BOOTSTRAP");
+        if (!k || std::atol(k) <= 0) return;
+        _k = std::atol(k);
+        _seed = getenv("USPJWL_BOOTSTRAP_SEED") ? std::strtoull(getenv("USPJWL_BOOTSTRAP_SEED"), nullptr, 0) : 0;
+        _name = name;
+        _path = std::string(getenv("USPJWL_BOOTSTRAP_FILE") ? getenv("USPJWL_BOOTSTRAP_FILE") : "uspjwl") + "_" + name + ".boot.ybin";
+        for (const Rivet::MultiweightAOPtr& ao : aos) {
+          std::shared_ptr<Rivet::Wrapper<YODA::Histo1D> > h = std::dynamic_pointer_cast<Rivet::Wrapper<YODA::Histo1D> >(ao.get());
+          if (h) _hwrappers.push_back(h);
+          std::shared_ptr<Rivet::Wrapper<YODA::Counter> > c = std::dynamic_pointer_cast<Rivet::Wrapper<YODA::Counter> >(ao.get());
+          if (c) _cwrappers.push_back(c);
+        }
+        for (const auto& w : _hwrappers) _histos.push_back(w->persistent(0));
+        for (const auto& w : _cwrappers) _counters.push_back(w->persistent(0));
+
+        // Objects in the .ybin data order, histograms first
+        size_t cells = 0;
+        for (const auto& h : _histos) {
+          _cells.push_back(cells);
+          _slots.push_back(h->numBins() + BinHisto::FIRSTBIN);
+          cells += BinHisto::NSTATS * _slots.back();
+        }
+        for (size_t i = 0; i < _counters.size(); i++) {
+          _cells.push_back(cells);
+          _slots.push_back(1);
+          cells += BinHisto::NSTATS;
+        }
+
+        // Resumed sums are the starting point, not a change
+        _previous.assign(cells, 0.);
+        double v[BinHisto::NSTATS];
+        for (size_t o = 0; o < _slots.size(); o++) {
+          for (size_t slot = 0; slot < _slots[o]; slot++) {
+            readSlot(o, slot, false, v);
+            for (int stat = 0; stat < BinHisto::NSTATS; stat++) _previous[cell(o, stat, slot)] = v[stat];
+          }
+        }
+        _marked.assign(cells / BinHisto::NSTATS, 0);
+        _sums.assign(cells * _k, 0.);
+        _n.assign(_k, 0.);
+        _n2.assign(_k, 0.);
+        std::cout << _name << ": " << _k << " bootstrap replicas of " << _histos.size() + _counters.size()
+                  << " objects, written to " << _path << std::endl;
+      }
+
+      // Before the fills of an event, i.e. after those of the previous one
+      void beginEvent(uint64_t eventNumber) {
+        if (!enabled()) return;
+        accumulate(false);
+        _multiplicities.draw(_seed, eventNumber, _n);
+      }
+
+      // At the end of analyze(): marks the bins the event filled, read from
+      // the fills waiting in Rivet's per-event proxies
+      void endEvent() {
+        if (!enabled()) return;
+        for (size_t o = 0; o < _hwrappers.size(); o++) {
+          const auto* proxy = dynamic_cast<const Rivet::TupleWrapper<YODA::Histo1D>*>(_hwrappers[o]->active().get());
+          if (!proxy || proxy->fills().empty()) continue;
+          YODA::Histo1D& h = *_histos[o];
+          mark(o, BinHisto::TOTAL);
+          for (const auto& fill : proxy->fills()) {
+            const double x = fill.first;
+            const int i = h.binIndexAt(x);
+            mark(o, i >= 0 ? BinHisto::FIRSTBIN + i : x < h.xMin() ? BinHisto::UNDERFLOW : BinHisto::OVERFLOW);
+          }
+        }
+        for (size_t o = 0; o < _cwrappers.size(); o++) {
+          const auto* proxy = dynamic_cast<const Rivet::TupleWrapper<YODA::Counter>*>(_cwrappers[o]->active().get());
+          if (proxy && !proxy->fills().empty()) mark(_histos.size() + o, 0);
+        }
+      }
+
+      // nominal: the objects as written to .ybin, for paths, binning and scale;
+      // projected histograms are never filled, so their replicas come from the masters'
+      void finalize(const std::vector<BinHisto::Object>& nominal, const Master::Projections& projections) {
+        if (!enabled()) return;
+        accumulate(true);
+
+        std::vector<BinHisto::Object> out;
+        size_t offset = 0;
+        auto emit = [&](const std::string& path, size_t ncells) {
+          const BinHisto::Object* nom = nullptr;
+          for (const BinHisto::Object& bo : nominal) {
+            if (bo.path == path) nom = &bo;
+          }
+          if (nom && nom->data.size() == ncells) {
+            const double s = nom->scaledBy;
+            for (size_t k = 0; k < _k; k++) {
+              char suffix[32];
+              std::snprintf(suffix, sizeof(suffix), "[BOOT%03zu]", k);
+              BinHisto::Object bo = *nom;
+              bo.path = path + suffix;
+              bo.annotations = withPath(nom->annotations, bo.path);
+              for (size_t c = 0; c < ncells; c++) {
+                const int stat = int(c / nom->numSlots());
+                const double factor = stat == BinHisto::SUMW || stat == BinHisto::SUMWX ? s
+                                    : stat == BinHisto::NUMENTRIES ? 1. : s * s;
+                bo.data[c] = factor * _sums[(offset + c) * _k + k];
+              }
+              out.push_back(bo);
+            }
+          }
+          offset += ncells;
+        };
+        for (const auto& h : _histos) emit(h->path(), BinHisto::NSTATS * (h->numBins() + BinHisto::FIRSTBIN));
+        for (const auto& c : _counters) emit(c->path(), BinHisto::NSTATS);
+
+        try {
+          projections.apply(out);
+          BinHisto::write(_path, out);
+          std::cout << _name << ": wrote " << out.size() << " bootstrap objects to " << _path << std::endl;
+        }
+        catch (const std::exception& e) {
+          std::cerr << _name << ": " << e.what() << std::endl;
+        }
+      }
+
+    private:
+
+      struct Mark {
+        size_t object, slot;
+      };
+
+      size_t cell(size_t object, int stat, size_t slot) const {
+        return _cells[object] + stat * _slots[object] + slot;
+      }
+
+      void mark(size_t object, size_t slot) {
+        char& m = _marked[_cells[object] / BinHisto::NSTATS + slot];
+        if (m) return;
+        m = 1;
+        _pending.push_back({object, slot});
+      }
+
+      template <typename DBN>
+      static void put(double* v, const DBN& d, double s) {
+        v[BinHisto::SUMW] = d.sumW() / s;
+        v[BinHisto::SUMW2] = d.sumW2() / (s * s);
+        v[BinHisto::SUMWX] = d.sumWX() / s;
+        v[BinHisto::SUMWX2] = d.sumWX2() / (s * s);
+        v[BinHisto::NUMENTRIES] = d.numEntries();
+      }
+
+      // Statistics of one slot of an object; unscaled undoes a scale()
+      // applied in finalize before this is called
+      void readSlot(size_t object, size_t slot, bool unscaled, double* v) const {
+        if (object < _histos.size()) {
+          const YODA::Histo1D& h = *_histos[object];
+          const double s = unscaled && h.hasAnnotation("ScaledBy") ? std::stod(h.annotation("ScaledBy")) : 1.;
+          if (slot == BinHisto::TOTAL) put(v, h.totalDbn(), s);
+          else if (slot == BinHisto::UNDERFLOW) put(v, h.underflow(), s);
+          else if (slot == BinHisto::OVERFLOW) put(v, h.overflow(), s);
+          else put(v, h.bin(slot - BinHisto::FIRSTBIN).dbn(), s);
+          return;
+        }
+        const YODA::Counter& c = *_counters[object - _histos.size()];
+        const double s = unscaled && c.hasAnnotation("ScaledBy") ? std::stod(c.annotation("ScaledBy")) : 1.;
+        v[BinHisto::SUMW] = c.sumW() / s;
+        v[BinHisto::SUMW2] = c.sumW2() / (s * s);
+        v[BinHisto::SUMWX] = v[BinHisto::SUMWX2] = 0.;
+        v[BinHisto::NUMENTRIES] = c.numEntries();
+      }
+
+      // Adds the change of the marked slots, weighted by the last event's
+      // multiplicities. A slot Rivet has not filled yet (the fills of an
+      // event group are applied together) stays marked for the next call.
+      void accumulate(bool unscaled) {
+        for (size_t k = 0; k < _k; k++) _n2[k] = _n[k] * _n[k];
+        size_t kept = 0;
+        double v[BinHisto::NSTATS];
+        for (const Mark& m : _pending) {
+          readSlot(m.object, m.slot, unscaled, v);
+          bool changed = false;
+          for (int stat = 0; stat < BinHisto::NSTATS; stat++) changed |= v[stat] != _previous[cell(m.object, stat, m.slot)];
+          if (!changed) {
+            _pending[kept++] = m;
+            continue;
+          }
+          for (int stat = 0; stat < BinHisto::NSTATS; stat++) {
+            double& previous = _previous[cell(m.object, stat, m.slot)];
+            const double d = v[stat] - previous;
+            previous = v[stat];
+            if (d == 0) continue;
+            const double* n = stat == BinHisto::SUMW2 ? _n2.data() : _n.data();
+            double* r = &_sums[cell(m.object, stat, m.slot) * _k];
+            for (size_t k = 0; k < _k; k++) r[k] += d * n[k];
+          }
+          _marked[_cells[m.object] / BinHisto::NSTATS + m.slot] = 0;
+        }
+        _pending.resize(kept);
+      }
+
+      static std::string withPath(const std::string& annotations, const std::string& path) {
+        std::string out;
+        size_t pos = 0;
+        while (pos <= annotations.size()) {
+          size_t end = annotations.find('\n', pos);
+          if (end == std::string::npos) end = annotations.size();
+          const std::string line = annotations.substr(pos, end - pos);
+          if (!out.empty()) out += "\n";
+          out += line.compare(0, 6, "Path: ") == 0 ? "Path: " + path : line;
+          pos = end + 1;
+        }
+        return out;
+      }
+
+      std::string _name, _path;
+      size_t _k;
+      uint64_t _seed;
+      std::vector<std::shared_ptr<Rivet::Wrapper<YODA::Histo1D> > > _hwrappers;
+      std::vector<std::shared_ptr<Rivet::Wrapper<YODA::Counter> > > _cwrappers;
+      std::vector<std::shared_ptr<YODA::Histo1D> > _histos;
+      std::vector<std::shared_ptr<YODA::Counter> > _counters;
+      std::vector<size_t> _cells, _slots;  // per object: first cell, slots
+      std::vector<char> _marked;           // per slot
+      std::vector<Mark> _pending;
+      Multiplicities _multiplicities;
+      std::vector<double> _previous;
+      std::vector<double> _sums;     // [statistic cell][replica]
+      std::vector<double> _n, _n2;   // multiplicities of the last event, and their squares
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+// -*- C++ -*-
+
+// Centrality classes within one job.
+//
+// USPJWL_CENTRALITY=<source>:<edges> splits the events of a job into
+// classes, and every analysis books one set of its histograms per class
+// (and per subtraction setting, see USPJWL_Subtraction.hh). <edges> are
+// the comma-separated class boundaries in the variable of <source>:
+//   b             HepMC heavy-ion impact parameter, in fm
+//   ncoll         HepMC heavy-ion number of binary collisions
+//   table=<file>  a sidecar table with lines "<event number> <value>",
+//                 e.g. the centrality percentile of each event
+// e.g. USPJWL_CENTRALITY=b:0,4.9,8.6,11.1. Edges may also be given in
+// decreasing order, as usual for Ncoll. Class k covers [edge k, edge k+1)
+// and its histograms get the suffix "_CENT<label>", where the labels are
+// USPJWL_CENTRALITY_LABELS (comma separated, e.g. 0-10,10-30,30-50) or
+// "<low>_<high>" by default. Events outside every class, or without the
+// information the source needs, are skipped. Without USPJWL_CENTRALITY
+// there is a single class and the histogram names are unchanged.
+//
+// The table is read once at init into a hash map from event number to
+// class, so the per-event cost is one lookup; for b and ncoll it is a
+// branch-free comparison with the few class edges.
+
+#ifndef USPJWL_CENTRALITY_HH
+#define USPJWL_CENTRALITY_HH
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/HeavyIon.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Centrality {
+
+    class Classes {
+    public:
+
+      enum Source { NONE, IMPACT, NCOLL, TABLE };
+
+      Classes() : _source(NONE), _sign(1.), _warned(false) {}
+
+      // Throws on a malformed setting: merging classes silently would be worse
+      void configure(const std::string& analysis) {
+        const char* env = getenv("USPJWL_CENTRALITY");
+        if (!env) return;
+        const std::string spec = env;
+        const size_t colon = spec.rfind(':');
+        if (colon == std::string::npos) throw std::invalid_argument("USPJWL_CENTRALITY without ':' edges: " + spec);
+        const std::string source = spec.substr(0, colon);
+
+        std::istringstream in(spec.substr(colon + 1));
+        std::string item;
+        while (std::getline(in, item, ',')) {
+          if (!item.empty()) _edges.push_back(std::stod(item));
+        }
+        if (_edges.size() < 2) throw std::invalid_argument("USPJWL_CENTRALITY needs at least two edges: " + spec);
+
+        // Labels from the edges as given, before a decreasing list is flipped
+        if (getenv("USPJWL_CENTRALITY_LABELS")) {
+          std::istringstream labels(getenv("USPJWL_CENTRALITY_LABELS"));
+          while (std::getline(labels, item, ',')) _labels.push_back(item);
+        }
+        else {
+          for (size_t k = 0; k + 1 < _edges.size(); k++) {
+            std::ostringstream s;
+            s << _edges[k] << "_" << _edges[k + 1];
+            _labels.push_back(s.str());
+          }
+        }
+        if (_labels.size() != _edges.size() - 1) throw std::invalid_argument("USPJWL_CENTRALITY_LABELS does not match the classes");
+
+        if (_edges.front() > _edges.back()) {
+          _sign = -1.;
+          for (double& e : _edges) e = -e;
+        }
+        for (size_t k = 0; k + 1 < _edges.size(); k++) {
+          if (!(_edges[k] < _edges[k + 1])) throw std::invalid_argument("USPJWL_CENTRALITY edges are not monotonic: " + spec);
+        }
+
+        if (source == "b") _source = IMPACT;
+        else if (source == "ncoll") _source = NCOLL;
+        else if (source.compare(0, 6, "table=") == 0) {
+          readTable(source.substr(6));
+          _source = TABLE;
+        }
+        else throw std::invalid_argument("unknown USPJWL_CENTRALITY source: " + source);
+
+        std::cout << analysis << ": centrality classes from " << source << ":";
+        for (size_t k = 0; k < size(); k++) std::cout << " " << _labels[k];
+        std::cout << std::endl;
+      }
+
+      bool enabled() const { return _source != NONE; }
+      size_t size() const { return enabled() ? _labels.size() : 1; }
+
+      // Histogram name suffix of class k
+      std::string tag(size_t k) const { return enabled() ? "_CENT" + _labels[k] : ""; }
+
+      // Class of the event, -1 if it belongs to none
+      int classify(const HepMC::GenEvent* ge) {
+        if (_source == NONE) return 0;
+        if (_source == TABLE) {
+          const auto it = _table.find(ge->event_number());
+          if (it != _table.end()) return it->second;
+          warn("event " + std::to_string(ge->event_number()) + " is not in the centrality table");
+          return -1;
+        }
+        const HepMC::HeavyIon* hi = ge->heavy_ion();
+        if (!hi) {
+          warn("event without HepMC heavy-ion information");
+          return -1;
+        }
+        return find(_source == IMPACT ? hi->impact_parameter() : hi->Ncoll());
+      }
+
+    private:
+
+      int find(double value) const {
+        const double x = _sign * value;
+        int pos = 0;
+        for (double e : _edges) pos += x >= e;
+        return pos > 0 && pos < int(_edges.size()) ? pos - 1 : -1;
+      }
+
+      void readTable(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) throw std::runtime_error("Cannot read centrality table " + path);
+        std::string line;
+        while (std::getline(in, line)) {
+          if (line.empty() || line[0] == '#') continue;
+          std::istringstream fields(line);
+          long number;
+          double value;
+          if (!(fields >> number >> value)) throw std::runtime_error("Bad line in centrality table " + path + ": " + line);
+          _table[number] = find(value);
+        }
+      }
+
+      void warn(const std::string& what) {
+        if (!_warned) std::cerr << "USPJWL_CENTRALITY: " << what << ", skipped (reported once)" << std::endl;
+        _warned = true;
+      }
+
+      Source _source;
+      double _sign;
+      bool _warned;
+      std::vector<double> _edges;
+      std::vector<std::string> _labels;
+      std::unordered_map<long, int> _table;
+    };
+
+  }
+
+}
+
+#endif
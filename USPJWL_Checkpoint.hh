@@ -0,0 +1,131 @@
+// -*- C++ -*-
+
+// Crash-consistent checkpoints of analysis state, written as YODA files on
+// a background thread.
+//
+// A checkpoint is a list of YODA objects copied on the event thread (the
+// snapshot) and handed over to a single writer thread. The writer puts them
+// in <file>.tmp, syncs it to disk and renames it over <file>, so a job
+// killed at any point leaves either the previous or the new checkpoint,
+// never a partial one.
+
+#ifndef USPJWL_CHECKPOINT_HH
+#define USPJWL_CHECKPOINT_HH
+
+#include "YODA/AnalysisObject.h"
+#include "YODA/IO.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace USPJWL {
+
+  namespace Checkpoint {
+
+    typedef std::vector<std::shared_ptr<YODA::AnalysisObject> > Snapshot;
+
+
+    // Writes <path> atomically: temporary file, fsync, rename
+    inline bool writeAtomically(const std::string& path, const Snapshot& snapshot) {
+      const std::string tmp = path + ".tmp";
+      std::vector<YODA::AnalysisObject*> aos;
+      for (const auto& ao : snapshot) aos.push_back(ao.get());
+      try {
+        YODA::write(tmp, aos);
+      }
+      catch (const std::exception& e) {
+        std::cerr << "Checkpoint " << tmp << " failed: " << e.what() << std::endl;
+        return false;
+      }
+
+      int fd = ::open(tmp.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+      ::fsync(fd);
+      ::close(fd);
+      if (std::rename(tmp.c_str(), path.c_str()) != 0) return false;
+
+      // Make the rename itself durable
+      std::string dir = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/') + 1);
+      fd = ::open(dir.c_str(), O_RDONLY);
+      if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+      }
+      return true;
+    }
+
+
+    // Single background thread shared by all analyses. Pending snapshots
+    // for the same file are coalesced, only the newest one is written.
+    class Writer {
+    public:
+
+      static Writer& instance() {
+        static Writer writer;
+        return writer;
+      }
+
+      void submit(const std::string& path, Snapshot snapshot) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_thread.joinable()) _thread = std::thread(&Writer::run, this);
+        _pending[path] = std::move(snapshot);
+        _cv.notify_all();
+      }
+
+      // Blocks until every submitted snapshot is on disk
+      void wait() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _pending.empty() && !_busy; });
+      }
+
+      ~Writer() {
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _stop = true;
+          _cv.notify_all();
+        }
+        if (_thread.joinable()) _thread.join();
+      }
+
+    private:
+
+      Writer() : _busy(false), _stop(false) {}
+
+      void run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+          _cv.wait(lock, [this] { return _stop || !_pending.empty(); });
+          if (_pending.empty()) return;
+          auto job = *_pending.begin();
+          _pending.erase(_pending.begin());
+          _busy = true;
+          lock.unlock();
+          writeAtomically(job.first, job.second);
+          lock.lock();
+          _busy = false;
+          _cv.notify_all();
+        }
+      }
+
+      std::mutex _mutex;
+      std::condition_variable _cv;
+      std::map<std::string, Snapshot> _pending;
+      std::thread _thread;
+      bool _busy, _stop;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,202 @@
+// -*- C++ -*-
+
+// Histogram that many threads can fill at the same time without locks or
+// per-thread copies.
+//
+// The bin contents (sumw, sumw2, sumwx, sumwx2, entries for every bin plus
+// underflow, overflow and total) are kept in a few stripes. Each thread
+// adds to one stripe; the stripes start on separate cache lines, so
+// threads on different stripes never share a line, and threads on the
+// same hot bin are spread over the stripes. Reading (toYODA, toBinHisto)
+// sums the stripes and must not run concurrently with fills.
+//
+// Every sum is held in fixed point, as LIMBS signed 64-bit integers of
+// CHUNK bits each from 2^LOWEST up, and a fill adds the (at most three)
+// pieces of each double with atomic integer additions. Integer addition
+// is associative, so the contents do not depend on the order of the fills,
+// on the number of threads or on which stripe a thread uses: the result is
+// bit-identical for any thread count. Values whose bits fall outside the
+// fixed-point window (below 2^LOWEST, from 2^(LOWEST + CHUNK * LIMBS), or
+// not finite) go to an ExactSum under a lock; for JEWEL weights and
+// momenta this path is never taken. Reads add everything up exactly and
+// round once.
+//
+// Booked Rivet histograms (Histo1DPtr) stay the choice for the usual
+// single-threaded event loop; a ConcurrentHisto1D is exported into one of
+// them at finalize with addTo().
+
+#ifndef USPJWL_CONCURRENTHISTO_HH
+#define USPJWL_CONCURRENTHISTO_HH
+
+#include "YODA/Histo1D.h"
+#include "USPJWL_BinHisto.hh"
+#include "USPJWL_ExactSum.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace USPJWL {
+
+  class ConcurrentHisto1D {
+  public:
+
+    static const size_t CACHELINE = 64;
+
+    // A piece is below 2^CHUNK, so a limb takes 2^33 additions before it can overflow
+    static const int CHUNK = 30;
+    static const int LIMBS = 8;
+    static const int LOWEST = -120;
+
+    // nstripes = 0 picks one stripe per 8 hardware threads (at least 2)
+    ConcurrentHisto1D(const std::string& path, const std::vector<double>& edges, size_t nstripes = 0)
+      : _path(path), _edges(edges), _nstripes(nstripes) {
+      if (_edges.size() < 2 || !std::is_sorted(_edges.begin(), _edges.end()))
+        throw std::invalid_argument("ConcurrentHisto1D " + path + ": bad bin edges");
+      if (_nstripes == 0) _nstripes = std::max(2u, std::thread::hardware_concurrency() / 8);
+
+      // Every stripe is padded to whole cache lines
+      const size_t perLine = CACHELINE / sizeof(std::atomic<int64_t>);
+      _stride = (BinHisto::NSTATS * numSlots() * LIMBS + perLine - 1) / perLine * perLine;
+      _storage.reset(new std::atomic<int64_t>[_stride * _nstripes + perLine]);
+      uintptr_t addr = reinterpret_cast<uintptr_t>(_storage.get());
+      _base = _storage.get() + ((CACHELINE - addr % CACHELINE) % CACHELINE) / sizeof(std::atomic<int64_t>);
+      reset();
+    }
+
+    ConcurrentHisto1D(const ConcurrentHisto1D&) = delete;
+    ConcurrentHisto1D& operator=(const ConcurrentHisto1D&) = delete;
+
+    const std::string& path() const { return _path; }
+    size_t numBins() const { return _edges.size() - 1; }
+
+    void reset() {
+      for (size_t i = 0; i < _stride * _nstripes; i++) _base[i].store(0, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(_outsideMutex);
+      _outside.reset();
+    }
+
+    // Same arguments and bin conventions as YODA::Histo1D::fill, which
+    // also rejects a NaN x (it would compare into no bin)
+    void fill(double x, double w = 1.0, double fraction = 1.0) {
+      if (std::isnan(x)) throw std::invalid_argument("ConcurrentHisto1D " + _path + ": x is NaN");
+      size_t slot;
+      if (x < _edges.front()) slot = BinHisto::UNDERFLOW;
+      else if (x >= _edges.back()) slot = BinHisto::OVERFLOW;
+      else slot = BinHisto::FIRSTBIN + (std::upper_bound(_edges.begin(), _edges.end(), x) - _edges.begin() - 1);
+
+      std::atomic<int64_t>* stripe = _base + _stride * (threadIndex() % _nstripes);
+      const double sw = fraction * w, sw2 = fraction * w * w;
+      for (size_t s : {size_t(BinHisto::TOTAL), slot}) {
+        add(stripe, BinHisto::SUMW, s, sw);
+        add(stripe, BinHisto::SUMW2, s, sw2);
+        add(stripe, BinHisto::SUMWX, s, sw * x);
+        add(stripe, BinHisto::SUMWX2, s, sw * x * x);
+        add(stripe, BinHisto::NUMENTRIES, s, fraction);
+      }
+    }
+
+    // Exact sum over the stripes, rounded once
+    double get(int stat, size_t slot) const {
+      ExactSum sum;
+      const size_t cell = (stat * numSlots() + slot) * LIMBS;
+      for (size_t k = 0; k < _nstripes; k++) {
+        for (int j = 0; j < LIMBS; j++) {
+          // Both halves convert to double exactly
+          const int64_t limb = _base[_stride * k + cell + j].load(std::memory_order_relaxed);
+          const int64_t hi = limb >> 32, lo = limb - hi * (int64_t(1) << 32);
+          sum.add(std::ldexp(double(hi), LOWEST + CHUNK * j + 32));
+          sum.add(std::ldexp(double(lo), LOWEST + CHUNK * j));
+        }
+      }
+      if (_outside) sum += _outside[stat * numSlots() + slot];
+      return sum.value();
+    }
+
+    BinHisto::Object toBinHisto() const {
+      BinHisto::Object bo;
+      bo.kind = BinHisto::HISTO1D;
+      bo.path = _path;
+      bo.annotations = "Path: " + _path + "\nTitle: \nType: Histo1D";
+      bo.edges = _edges;
+      bo.resize();
+      for (int s = 0; s < BinHisto::NSTATS; s++) {
+        for (size_t slot = 0; slot < numSlots(); slot++) bo.at(s, slot) = get(s, slot);
+      }
+      return bo;
+    }
+
+    std::shared_ptr<YODA::Histo1D> toYODA() const {
+      std::vector<YODA::HistoBin1D> bins;
+      for (size_t i = 0; i < numBins(); i++) bins.push_back(YODA::HistoBin1D(_edges[i], _edges[i + 1], dbn(BinHisto::FIRSTBIN + i)));
+      return std::make_shared<YODA::Histo1D>(bins, dbn(BinHisto::TOTAL), dbn(BinHisto::UNDERFLOW),
+                                             dbn(BinHisto::OVERFLOW), _path);
+    }
+
+    // Adds the contents to a histogram with the same binning
+    void addTo(YODA::Histo1D& h) const {
+      YODA::Histo1D mine = *toYODA();
+      mine.setPath(h.path());
+      h += mine;
+    }
+
+  private:
+
+    size_t numSlots() const { return numBins() + BinHisto::FIRSTBIN; }
+
+    YODA::Dbn1D dbn(size_t slot) const {
+      return YODA::Dbn1D(get(BinHisto::NUMENTRIES, slot), get(BinHisto::SUMW, slot), get(BinHisto::SUMW2, slot),
+                         get(BinHisto::SUMWX, slot), get(BinHisto::SUMWX2, slot));
+    }
+
+    void add(std::atomic<int64_t>* stripe, int stat, size_t slot, double v) {
+      if (v == 0) return;
+      int exp;
+      const double f = std::frexp(v, &exp);
+      const int lsb = exp - 53;
+      if (!std::isfinite(v) || lsb < LOWEST || exp > LOWEST + CHUNK * LIMBS) {
+        addOutside(stat * numSlots() + slot, v);
+        return;
+      }
+      const int64_t m = int64_t(std::ldexp(f, 53));   // |m| < 2^53, exact
+      const int shift = lsb - LOWEST;
+      unsigned __int128 t = (unsigned __int128)(m < 0 ? -m : m) << (shift % CHUNK);
+      std::atomic<int64_t>* limb = stripe + (stat * numSlots() + slot) * LIMBS + shift / CHUNK;
+      for (; t != 0; t >>= CHUNK, ++limb) {
+        const int64_t piece = int64_t(t & ((uint64_t(1) << CHUNK) - 1));
+        limb->fetch_add(m < 0 ? -piece : piece, std::memory_order_relaxed);
+      }
+    }
+
+    void addOutside(size_t cell, double v) {
+      std::lock_guard<std::mutex> lock(_outsideMutex);
+      if (!_outside) _outside.reset(new ExactSum[BinHisto::NSTATS * numSlots()]);
+      _outside[cell].add(v);
+    }
+
+    // Small per-thread number, handed out in order of first use
+    static size_t threadIndex() {
+      static std::atomic<size_t> next(0);
+      static thread_local size_t index = next++;
+      return index;
+    }
+
+    std::string _path;
+    std::vector<double> _edges;
+    size_t _nstripes, _stride;
+    std::unique_ptr<std::atomic<int64_t>[]> _storage;
+    std::atomic<int64_t>* _base;
+    std::mutex _outsideMutex;
+    std::unique_ptr<ExactSum[]> _outside;
+  };
+
+}
+
+#endif
@@ -0,0 +1,185 @@
+// -*- C++ -*-
+
+// Cut-parameter scans from a single clustering.
+//
+// An analysis declares the thresholds of its selection that can be
+// scanned, each with its nominal value and the sense of the comparison.
+// USPJWL_SCAN lists values for some of them,
+//   USPJWL_SCAN='xj_dphi=2.5,2.75,2.9;xj_eta=1.8,2.1'
+// (';' between parameters, ',' between values), and every analysis that
+// declares one of the listed parameters books one extra family of the
+// histograms that depend on them per grid point: the product of the listed
+// values, at most 64 points. The family of point p gets the suffix tag(p),
+// e.g. xJ_158_178_R0.4_SCAN_xj_dphi2.75_xj_eta2.1. Parameters that are not
+// listed keep their nominal value, and the nominal histograms are filled
+// as before.
+//
+// Per jet (or trigger, or jet pair) the analysis evaluates a feature once
+// and pass() returns the grid points whose threshold it passes as a
+// 64-bit mask. The values of each parameter are sorted at configure time,
+// so this is a count of the values below the feature and one table
+// lookup; masks of several parameters combine with &, and forEach() visits
+// the set bits to fill the families.
+
+#ifndef USPJWL_CUTSCAN_HH
+#define USPJWL_CUTSCAN_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace CutScan {
+
+    // How a feature x passes a threshold v
+    enum Sense { ABOVE,     // x > v
+                 ATLEAST,   // x >= v
+                 BELOW };   // x < v
+
+    const size_t MAXPOINTS = 64;
+
+
+    // Calls f(point) for every set bit of mask
+    template <typename F>
+    inline void forEach(uint64_t mask, F f) {
+      while (mask) {
+        f(size_t(__builtin_ctzll(mask)));
+        mask &= mask - 1;
+      }
+    }
+
+
+    class Grid {
+    public:
+
+      Grid() : _points(1) {}
+
+      // Declares a scannable threshold, before configure(); returns its index
+      size_t add(const std::string& name, Sense sense, double nominal) {
+        Parameter p;
+        p.name = name;
+        p.sense = sense;
+        p.nominal = nominal;
+        _parameters.push_back(p);
+        return _parameters.size() - 1;
+      }
+
+      void configure(const std::string& analysis) {
+        const char* env = getenv("USPJWL_SCAN");
+        if (!env) return;
+        std::istringstream in(env);
+        std::string item;
+        while (std::getline(in, item, ';')) {
+          const size_t eq = item.find('=');
+          if (eq == std::string::npos) throw std::invalid_argument("USPJWL_SCAN entry without '=': " + item);
+          for (Parameter& p : _parameters) {
+            if (p.name != item.substr(0, eq)) continue;
+            std::istringstream values(item.substr(eq + 1));
+            std::string v;
+            while (std::getline(values, v, ',')) {
+              if (!v.empty()) p.values.push_back(std::stod(v));
+            }
+            if (p.values.empty()) throw std::invalid_argument("USPJWL_SCAN without values: " + item);
+            _scanned.push_back(&p - _parameters.data());
+          }
+        }
+        if (_scanned.empty()) return;
+
+        for (size_t i : _scanned) _points *= _parameters[i].values.size();
+        if (_points > MAXPOINTS) throw std::invalid_argument("USPJWL_SCAN grid has more than 64 points");
+
+        // Point p is a mixed-radix number over the scanned parameters
+        size_t stride = 1;
+        for (size_t i : _scanned) {
+          Parameter& par = _parameters[i];
+          const size_t m = par.values.size();
+          std::vector<size_t> order(m);
+          for (size_t k = 0; k < m; k++) order[k] = k;
+          std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return par.values[a] < par.values[b]; });
+
+          par.sorted.resize(m);
+          std::vector<uint64_t> byValue(m, 0);
+          for (size_t k = 0; k < m; k++) par.sorted[k] = par.values[order[k]];
+          for (size_t pt = 0; pt < _points; pt++) {
+            const size_t k = (pt / stride) % m;
+            const size_t rank = std::find(order.begin(), order.end(), k) - order.begin();
+            byValue[rank] |= uint64_t(1) << pt;
+          }
+          // below[n]: points whose value is among the n smallest; above[n]: the others
+          par.below.assign(m + 1, 0);
+          par.above.assign(m + 1, 0);
+          for (size_t n = 1; n <= m; n++) par.below[n] = par.below[n - 1] | byValue[n - 1];
+          for (size_t n = 0; n <= m; n++) par.above[n] = all() & ~par.below[n];
+          par.stride = stride;
+          stride *= m;
+        }
+
+        std::cout << analysis << ": cut scan over " << _points << " points of";
+        for (size_t i : _scanned) std::cout << " " << _parameters[i].name;
+        std::cout << std::endl;
+      }
+
+      bool enabled() const { return !_scanned.empty(); }
+      size_t size() const { return enabled() ? _points : 0; }
+      uint64_t all() const { return _points == 64 ? ~uint64_t(0) : (uint64_t(1) << _points) - 1; }
+
+      // Value of parameter i at point p
+      double value(size_t p, size_t i) const {
+        const Parameter& par = _parameters[i];
+        return par.values.empty() ? par.nominal : par.values[(p / par.stride) % par.values.size()];
+      }
+
+      // Histogram name suffix of point p
+      std::string tag(size_t p) const {
+        std::ostringstream s;
+        s << "_SCAN";
+        for (size_t i : _scanned) s << "_" << _parameters[i].name << value(p, i);
+        return s.str();
+      }
+
+      // Points at which feature x passes threshold i, none without a scan
+      uint64_t pass(size_t i, double x) const {
+        if (!enabled()) return 0;
+        const Parameter& par = _parameters[i];
+        if (par.values.empty()) return test(par.sense, x, par.nominal) ? all() : 0;
+        size_t n = 0;
+        switch (par.sense) {
+          case ABOVE:   for (double v : par.sorted) n += v < x;  return par.below[n];
+          case ATLEAST: for (double v : par.sorted) n += v <= x; return par.below[n];
+          case BELOW:   for (double v : par.sorted) n += v <= x; return par.above[n];
+        }
+        return 0;
+      }
+
+    private:
+
+      static bool test(Sense sense, double x, double v) {
+        return sense == ABOVE ? x > v : sense == ATLEAST ? x >= v : x < v;
+      }
+
+      struct Parameter {
+        std::string name;
+        Sense sense;
+        double nominal;
+        std::vector<double> values;       // as listed, empty if not scanned
+        std::vector<double> sorted;
+        std::vector<uint64_t> below, above;
+        size_t stride = 1;
+      };
+
+      std::vector<Parameter> _parameters;
+      std::vector<size_t> _scanned;
+      size_t _points;
+    };
+
+  }
+
+}
+
+#endif
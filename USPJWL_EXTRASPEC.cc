@@ -16,6 +16,15 @@
 #include "HepMC/GenParticle.h"
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_JetStore.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Arena.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_CutScan.hh"
 #include <string>
 
 namespace Rivet {
@@ -27,42 +36,120 @@ namespace Rivet {
     DEFAULT_RIVET_ANALYSIS_CTOR(USPJWL_EXTRASPEC);
 
 
+    /// Histograms of one subtraction setting
+    struct Histos {
+      // R_AA; _hist_alice2 is projected from _hist_alice and _hist_alice3
+      Histo1DPtr _hist_jet, _hist_alice, _hist_alice2, _hist_alice3, _hist_cms;
+
+      // ALICEpT at each USPJWL_SCAN point of the leading-constituent cut
+      std::vector<Histo1DPtr> _scan;
+    };
+
+
     void init() {
 
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), INIT);
+
       // Grab variable jet R parameter from environment, default value of 0.4
       RJETS = getenv("RJETS") ? getenv("RJETS") : "0.4";
       RJETS_f = std::stof(RJETS);
       std::cout << "\nR chosen for jet algorithm: " << RJETS << std::endl;
 
-      SubtractedJewelEvent sev(1.0);
-      SubtractedJewelFinalState fs(sev, Cuts::abseta < 3.2);
-      declare(fs, "FS");
+      // Leading-constituent bias that USPJWL_SCAN can vary (see USPJWL_CutScan.hh)
+      _leadPt = _cuts.add("lead_pt", USPJWL::CutScan::ABOVE, 10 * RJETS_f + 3);
+      _cuts.configure(name());
+
+      // One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and
+      // one histogram set per setting and centrality class (see USPJWL_Runtime.hh)
+      _centrality.configure(name());
+      _subtraction.configure(name());
+      _sets.resize(_centrality.size() * _subtraction.size());
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        SubtractedJewelEvent sev(_subtraction.parameter(c));
+        SubtractedJewelFinalState fs(sev, Cuts::abseta < 3.2);
+        declare(fs, _subtraction.name("FS", c));
+
+        // Apply FastJet
+        FastJets fj(fs, FastJets::ANTIKT, RJETS_f);
+        fj.useInvisibles();
+        declare(fj, _subtraction.name("Jets", c));
+
+        for (size_t k = 0; k < _centrality.size(); k++) {
+          bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+        }
+      }
+
+      // Events of each centrality class, for the per-class normalisation
+      if (_centrality.enabled()) {
+        book(_centcount, "Centrality_counter", _centrality.size(), -0.5, _centrality.size() - 0.5);
+      }
+      _runtime.route(_centrality, _subtraction.size(), _centcount);
+
+      // Events rejected (bin 0) and accepted (bin 1) by the pre-filter
+      _skim.configure(RJETS_f, 3.2, 40 * GeV);
+      book(_skimcount, "Skim_counter_R" + RJETS, 2, -0.5, 1.5);
+      _runtime.prefilter(_skim, _skimcount);
 
-      // Apply FastJet
-      FastJets fj(fs, FastJets::ANTIKT, RJETS_f);
-      fj.useInvisibles();
-      declare(fj, "Jets");
+      // Optional per-jet output for re-binning without rerunning (see USPJWL_JetStore.hh)
+      if (getenv("USPJWL_JETSTORE")) {
+        _jetstore.open(std::string(getenv("USPJWL_JETSTORE")) + "_" + name() + "_R" + RJETS + ".jets");
+      }
 
+      // Checkpointing and resume (see USPJWL_Runtime.hh)
+      _runtime.init(*this, analysisObjects());
+    }
 
 
-      // Book histograms
+    // Book histograms, tag is appended to every name
+    void bookSet(Histos& hs, const std::string& tag) {
 
       // For R_AA:
-      _hist_jet = book(_hist_jet, "JetpT_R" + RJETS, PTEDGES);
-      _hist_alice = book(_hist_alice, "ALICEpT_R" + RJETS, PTEDGES_ALICE);
-      _hist_alice2 = book(_hist_alice2, "ALICEpT_nolead_R" + RJETS, PTEDGES_ALICE);
-      _hist_cms = book(_hist_cms, "CMSpT_R" + RJETS, PTEDGES_CMS);
+      hs._hist_jet = book(hs._hist_jet, "JetpT_R" + RJETS + tag, PTEDGES);
+      hs._hist_alice = book(hs._hist_alice, "ALICEpT_R" + RJETS + tag, PTEDGES_ALICE);
+      hs._hist_alice2 = book(hs._hist_alice2, "ALICEpT_nolead_R" + RJETS + tag, PTEDGES_ALICE);
+      hs._hist_cms = book(hs._hist_cms, "CMSpT_R" + RJETS + tag, PTEDGES_CMS);
+
+      // ALICE jets with and without a leading constituent are filled apart,
+      // and the no-lead spectrum is their sum at finalize (see USPJWL_Master.hh)
+      hs._hist_alice3 = book(hs._hist_alice3, "ALICEpT_withoutlead_R" + RJETS + tag, PTEDGES_ALICE);
+      _runtime.project("ALICEpT_nolead_R" + RJETS + tag, {"ALICEpT_R" + RJETS + tag, "ALICEpT_withoutlead_R" + RJETS + tag});
+
+      hs._scan.resize(_cuts.size());
+      for (size_t p = 0; p < _cuts.size(); p++) {
+        hs._scan[p] = book(hs._scan[p], "ALICEpT_R" + RJETS + tag + _cuts.tag(p), PTEDGES_ALICE);
+      }
     }
 
 
     /// Perform the per-event analysis
     void analyze(const Event& evt) {
 
+      // Timers, resumed events, centrality class and pre-filter (see USPJWL_Runtime.hh)
+      USPJWL::Runtime::Event event(_runtime, evt, _profile);
+      if (event.set() < 0) vetoEvent;
+
+      // Per-event scratch memory, released when the event is done
+      USPJWL::Arena::EventScope scratch(_arena);
+
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        analyzeSetting(evt, c, _sets[event.set() + c]);
+      }
+    }
+
+
+    // Observables of subtraction setting c, filled into hs
+    void analyzeSetting(const Event& evt, size_t c, Histos& hs) {
+      // Charged to its own stage instead of the first apply<FastJets>
+      USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("FS", c)));
+
       // Method definitions
-      Cut cutlead = Cuts::pT > (10 * RJETS_f + 3) * GeV;
-      // Vector that will store size of array of particles that
-      // passes cutlead
-      std::vector<int> sizelead = {};
+      const double ptlead = (10 * RJETS_f + 3) * GeV;
+      // Vector that will store the number of constituents that
+      // pass the leading pT cut
+      USPJWL::ScratchVector<int> sizelead(_arena);
+      // and the leading constituent pT, for the USPJWL_SCAN points
+      USPJWL::ScratchVector<double> maxlead(_arena);
       double etamax = 3.2 - RJETS_f;
       double etaspace;
       if (RJETS_f <= 0.4) {
@@ -76,12 +163,22 @@ namespace Rivet {
 
       // Get jets of event
       Cut jetcuts = Cuts::pT > 40 * GeV && Cuts::abseta < etamax;
-      const Jets jets = apply<FastJets>(evt, "Jets").jetsByPt(jetcuts);
+      const FastJets& fj = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("Jets", c)));
+      const Jets jets = USPJWL_TIMED(_profile, "jetsByPt", fj.jetsByPt(jetcuts));
 
       // Need to loop through jets before substraction to access constituents
+      sizelead.reserve(jets.size());
+      maxlead.reserve(jets.size());
       for (const Jet& j : jets) {
-        Particles plead = j.constituents(cutlead);
-        sizelead.push_back(plead.size());
+        USPJWL_TIME_SCOPE(_profile, "leading constituents");
+        int nlead = 0;
+        double maxpt = 0.;
+        for (const Particle& p : j.constituents()) {
+          if (p.pT() > ptlead) nlead++;
+          maxpt = std::max(maxpt, p.pT());
+        }
+        sizelead.push_back(nlead);
+        maxlead.push_back(maxpt);
       }
 
       // CALCULATE JET PT FOR RAA
@@ -89,41 +186,68 @@ namespace Rivet {
       // element in arraysizelead
       int counter_jets = 0;
       for (const Jet& j : jets) {
+        USPJWL_TIME_SCOPE(_profile, "jet fills");
+
         // Jet properties
         double y = j.absrap(), pt = j.pT(), eta = j.abseta();
 
         if (y <= 1.2) {
-          _hist_jet -> fill(pt);
+          hs._hist_jet -> fill(pt);
         }
 
 	if (eta <= 2) {
-	  _hist_cms -> fill(pt);
+	  hs._hist_cms -> fill(pt);
         }
 
         if (eta <= etaspace) {
-          _hist_alice2 -> fill(pt); // ALICE no lead method
-
+          // ALICE no lead method: the sum of both, projected at finalize
           if (sizelead[counter_jets] > 0) {
-            _hist_alice -> fill(pt);
+            hs._hist_alice -> fill(pt);
+          }
+          else {
+            hs._hist_alice3 -> fill(pt);
           }
+
+          USPJWL::CutScan::forEach(_cuts.pass(_leadPt, maxlead[counter_jets] / GeV),
+                                   [&](size_t p) { hs._scan[p] -> fill(pt); });
         }
 
         counter_jets++;
+
+        if (c == 0 && _jetstore.isOpen()) {
+          _jetstore.beginJet(evt.genEvent()->event_number(), evt.weights()[0], RJETS_f, j);
+          _jetstore.endJet();
+        }
       }
     }
 
 
     void finalize() {
       // Scale only after yoda merge
+      _jetstore.close();
+      _runtime.finalize();
+      _profile.report(name());
+      USPJWL_ALLOC_REPORT(name(), analysisObjects());
     }
 
 
     /// @name Histograms
-    // R_AA
-    Histo1DPtr _hist_jet, _hist_alice, _hist_alice2, _hist_cms;
+    std::vector<Histos> _sets;
+    USPJWL::Subtraction::Settings _subtraction;
+    USPJWL::Centrality::Classes _centrality;
+    USPJWL::CutScan::Grid _cuts;
+    size_t _leadPt;
+
+    Histo1DPtr _skimcount, _centcount;
+    USPJWL::Skim::Filter _skim;
+    USPJWL::Runtime _runtime;
+    USPJWL::Timing::Profile _profile;
+    USPJWL::Arena _arena;
 
     double RJETS_f;
     std::string RJETS;
+    USPJWL::JetStore::Writer _jetstore;
+
     std::vector<double> PTEDGES = {71., 79., 89., 100., 126., 158., 200., 251.,
                                    316., 398., 500., 650., 1000.};
 
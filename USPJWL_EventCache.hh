@@ -0,0 +1,280 @@
+// -*- C++ -*-
+
+// Compact binary cache of subtracted final states, shared by the
+// USPJWL_FSCACHE writer analysis and the uspjwl-replay driver.
+//
+// File layout (little endian, native alignment):
+//   FileHeader
+//   Block, Block, ...
+// Every block holds up to blockEvents events in columnar form:
+//   BlockHeader
+//   uint64  number[nEvents]       (HepMC event number)
+//   double  weight[nEvents]       (nominal event weight)
+//   uint64  offset[nEvents + 1]   (first particle of each event, block local)
+//   float   pt[nParticles], eta[nParticles], phi[nParticles], m[nParticles]
+//   int32   pid[nParticles]
+//   int8    charge3[nParticles]
+//   padding to 8 bytes
+// Blocks are self-delimiting, so a file cut short by a crash is readable
+// up to its last complete block.
+
+#ifndef USPJWL_EVENTCACHE_HH
+#define USPJWL_EVENTCACHE_HH
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace USPJWL {
+
+  namespace EventCache {
+
+    const char MAGIC[8] = {'U', 'S', 'P', 'J', 'W', 'L', 'F', 'S'};
+    const uint32_t VERSION = 1;
+    const uint32_t BLOCK_MAGIC = 0x4b4c4246; // "FBLK"
+
+    struct FileHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t reserved;
+    };
+
+    struct BlockHeader {
+      uint32_t magic;
+      uint32_t nEvents;
+      uint64_t nParticles;
+      uint64_t nBytes;      // Size of the block including this header
+    };
+
+    inline size_t padTo8(size_t n) { return (n + 7) & ~size_t(7); }
+
+    // Number of payload bytes after the block header
+    inline size_t payloadSize(uint64_t nev, uint64_t npart) {
+      return padTo8(nev * (2 * sizeof(uint64_t) + sizeof(double)) + sizeof(uint64_t)
+                    + npart * (4 * sizeof(float) + sizeof(int32_t) + sizeof(int8_t)));
+    }
+
+
+    // Streams events into a cache file, one block at a time
+    class Writer {
+    public:
+
+      Writer() : _file(nullptr), _blockEvents(1024), _nEvents(0) {}
+
+      ~Writer() { close(); }
+
+      void open(const std::string& path, size_t blockEvents = 1024) {
+        close();
+        _file = std::fopen(path.c_str(), "wb");
+        if (!_file) throw std::runtime_error("Cannot open event cache " + path);
+        _blockEvents = blockEvents > 0 ? blockEvents : 1;
+        FileHeader fh;
+        std::memcpy(fh.magic, MAGIC, sizeof(MAGIC));
+        fh.version = VERSION;
+        fh.reserved = 0;
+        std::fwrite(&fh, sizeof(fh), 1, _file);
+        _offset.assign(1, 0);
+      }
+
+      bool isOpen() const { return _file != nullptr; }
+
+      size_t numEvents() const { return _nEvents; }
+
+      void beginEvent(uint64_t number, double weight) {
+        _number.push_back(number);
+        _weight.push_back(weight);
+      }
+
+      void addParticle(float pt, float eta, float phi, float m, int32_t pid, int8_t charge3) {
+        _pt.push_back(pt);
+        _eta.push_back(eta);
+        _phi.push_back(phi);
+        _m.push_back(m);
+        _pid.push_back(pid);
+        _charge3.push_back(charge3);
+      }
+
+      void endEvent() {
+        _offset.push_back(_pt.size());
+        _nEvents++;
+        if (_number.size() >= _blockEvents) flush();
+      }
+
+      void flush() {
+        if (!_file || _number.empty()) return;
+        const uint64_t nev = _number.size(), npart = _pt.size();
+        BlockHeader bh;
+        bh.magic = BLOCK_MAGIC;
+        bh.nEvents = nev;
+        bh.nParticles = npart;
+        bh.nBytes = sizeof(BlockHeader) + payloadSize(nev, npart);
+        std::fwrite(&bh, sizeof(bh), 1, _file);
+        std::fwrite(_number.data(), sizeof(uint64_t), nev, _file);
+        std::fwrite(_weight.data(), sizeof(double), nev, _file);
+        std::fwrite(_offset.data(), sizeof(uint64_t), nev + 1, _file);
+        std::fwrite(_pt.data(), sizeof(float), npart, _file);
+        std::fwrite(_eta.data(), sizeof(float), npart, _file);
+        std::fwrite(_phi.data(), sizeof(float), npart, _file);
+        std::fwrite(_m.data(), sizeof(float), npart, _file);
+        std::fwrite(_pid.data(), sizeof(int32_t), npart, _file);
+        std::fwrite(_charge3.data(), sizeof(int8_t), npart, _file);
+        const size_t used = nev * (2 * sizeof(uint64_t) + sizeof(double)) + sizeof(uint64_t)
+                            + npart * (4 * sizeof(float) + sizeof(int32_t) + sizeof(int8_t));
+        const char zeros[8] = {0};
+        std::fwrite(zeros, 1, payloadSize(nev, npart) - used, _file);
+        std::fflush(_file);
+
+        _number.clear(); _weight.clear();
+        _pt.clear(); _eta.clear(); _phi.clear(); _m.clear();
+        _pid.clear(); _charge3.clear();
+        _offset.assign(1, 0);
+      }
+
+      void close() {
+        if (!_file) return;
+        flush();
+        std::fclose(_file);
+        _file = nullptr;
+      }
+
+    private:
+
+      std::FILE* _file;
+      size_t _blockEvents, _nEvents;
+      std::vector<uint64_t> _number, _offset;
+      std::vector<double> _weight;
+      std::vector<float> _pt, _eta, _phi, _m;
+      std::vector<int32_t> _pid;
+      std::vector<int8_t> _charge3;
+    };
+
+
+    // One cached event: views into the mapped file, valid while the Reader lives
+    struct EventView {
+      uint64_t number;
+      double weight;
+      size_t size;
+      const float *pt, *eta, *phi, *m;
+      const int32_t* pid;
+      const int8_t* charge3;
+    };
+
+
+    // Read-only, memory-mapped access to a cache file
+    class Reader {
+    public:
+
+      Reader() : _data(nullptr), _size(0) {}
+
+      explicit Reader(const std::string& path) : _data(nullptr), _size(0) { open(path); }
+
+      ~Reader() { close(); }
+
+      Reader(const Reader&) = delete;
+      Reader& operator=(const Reader&) = delete;
+
+      void open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open event cache " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FileHeader)) {
+          ::close(fd);
+          throw std::runtime_error("Truncated event cache " + path);
+        }
+        _size = st.st_size;
+        void* p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("Cannot map event cache " + path);
+        _data = static_cast<const char*>(p);
+        madvise(p, _size, MADV_SEQUENTIAL);
+
+        const FileHeader* fh = reinterpret_cast<const FileHeader*>(_data);
+        if (std::memcmp(fh->magic, MAGIC, sizeof(MAGIC)) != 0 || fh->version != VERSION)
+          throw std::runtime_error("Not a USPJWL event cache: " + path);
+
+        // Index the blocks; an incomplete trailing block is ignored
+        size_t pos = sizeof(FileHeader);
+        while (pos + sizeof(BlockHeader) <= _size) {
+          const BlockHeader* bh = reinterpret_cast<const BlockHeader*>(_data + pos);
+          if (bh->magic != BLOCK_MAGIC || pos + bh->nBytes > _size) break;
+          _blocks.push_back(pos);
+          _firstEvent.push_back(_firstEvent.empty() ? 0 : _firstEvent.back() + blockHeader(_blocks.size() - 2).nEvents);
+          pos += bh->nBytes;
+        }
+      }
+
+      void close() {
+        if (_data) munmap(const_cast<char*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+        _blocks.clear();
+        _firstEvent.clear();
+      }
+
+      size_t numEvents() const {
+        return _blocks.empty() ? 0 : _firstEvent.back() + blockHeader(_blocks.size() - 1).nEvents;
+      }
+
+      EventView event(size_t i) const {
+        // Blocks are few, a binary search over their first event is enough
+        size_t lo = 0, hi = _blocks.size();
+        while (hi - lo > 1) {
+          size_t mid = (lo + hi) / 2;
+          if (_firstEvent[mid] <= i) lo = mid;
+          else hi = mid;
+        }
+        return blockEvent(lo, i - _firstEvent[lo]);
+      }
+
+    private:
+
+      const BlockHeader& blockHeader(size_t b) const {
+        return *reinterpret_cast<const BlockHeader*>(_data + _blocks[b]);
+      }
+
+      EventView blockEvent(size_t b, size_t j) const {
+        const BlockHeader& bh = blockHeader(b);
+        const uint64_t nev = bh.nEvents, npart = bh.nParticles;
+        const char* p = _data + _blocks[b] + sizeof(BlockHeader);
+        const uint64_t* number = reinterpret_cast<const uint64_t*>(p);
+        const double* weight = reinterpret_cast<const double*>(number + nev);
+        const uint64_t* offset = reinterpret_cast<const uint64_t*>(weight + nev);
+        const float* pt = reinterpret_cast<const float*>(offset + nev + 1);
+        const float* eta = pt + npart;
+        const float* phi = eta + npart;
+        const float* m = phi + npart;
+        const int32_t* pid = reinterpret_cast<const int32_t*>(m + npart);
+        const int8_t* charge3 = reinterpret_cast<const int8_t*>(pid + npart);
+
+        EventView ev;
+        ev.number = number[j];
+        ev.weight = weight[j];
+        ev.size = offset[j + 1] - offset[j];
+        ev.pt = pt + offset[j];
+        ev.eta = eta + offset[j];
+        ev.phi = phi + offset[j];
+        ev.m = m + offset[j];
+        ev.pid = pid + offset[j];
+        ev.charge3 = charge3 + offset[j];
+        return ev;
+      }
+
+      const char* _data;
+      size_t _size;
+      std::vector<size_t> _blocks, _firstEvent;
+    };
+
+  }
+
+}
+
+#endif
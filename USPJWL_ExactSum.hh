@@ -0,0 +1,130 @@
+// -*- C++ -*-
+
+// Exact, order-independent summation of doubles (Kulisch accumulator).
+//
+// Every double is an integer mantissa times a power of two, so the whole
+// double range fits a 2150-bit fixed-point number. The accumulator keeps it
+// as 70 signed 64-bit limbs of 32 bits each; additions only touch the three
+// limbs under the mantissa and carries are propagated lazily. The sum is
+// therefore exact, and value() is the same for any order or grouping of
+// the additions, which is what makes parallel reductions reproducible.
+// value() rounds to nearest once at the end (subnormal results may be
+// off by one unit in the last place, but are still deterministic).
+
+#ifndef USPJWL_EXACTSUM_HH
+#define USPJWL_EXACTSUM_HH
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace USPJWL {
+
+  class ExactSum {
+  public:
+
+    // Lowest bit position, 2^-1126 is below the mantissa LSB of the smallest subnormal
+    static const int BIAS = 1126;
+    static const int NLIMBS = 70;
+
+    ExactSum() { clear(); }
+
+    explicit ExactSum(double x) {
+      clear();
+      add(x);
+    }
+
+    void clear() {
+      std::memset(_limb, 0, sizeof(_limb));
+      _pending = 0;
+      _nonfinite = 0.;
+    }
+
+    void add(double x) {
+      if (x == 0 || !std::isfinite(x)) {
+        if (!std::isfinite(x)) _nonfinite += x;
+        return;
+      }
+      int exp;
+      double f = std::frexp(x, &exp);
+      int64_t m = int64_t(std::ldexp(f, 53));   // |m| < 2^53, exact
+      int pos = exp - 53 + BIAS;
+      bool negative = m < 0;
+      unsigned __int128 t = (unsigned __int128)(negative ? -m : m) << (pos % 32);
+      int i = pos / 32;
+      int64_t l0 = int64_t(uint32_t(t)), l1 = int64_t(uint32_t(t >> 32)), l2 = int64_t(uint32_t(t >> 64));
+      if (negative) {
+        _limb[i] -= l0; _limb[i + 1] -= l1; _limb[i + 2] -= l2;
+      }
+      else {
+        _limb[i] += l0; _limb[i + 1] += l1; _limb[i + 2] += l2;
+      }
+      if (++_pending >= MAXPENDING) normalize();
+    }
+
+    ExactSum& operator+=(double x) {
+      add(x);
+      return *this;
+    }
+
+    ExactSum& operator+=(const ExactSum& other) {
+      ExactSum o(other);
+      o.normalize();
+      normalize();
+      for (int i = 0; i < NLIMBS; i++) _limb[i] += o._limb[i];
+      _nonfinite += o._nonfinite;
+      _pending = 1;
+      normalize();
+      return *this;
+    }
+
+    // Correctly rounded value of the exact sum
+    double value() const {
+      if (_nonfinite != 0 || std::isnan(_nonfinite)) return _nonfinite;
+      ExactSum s(*this);
+      s.normalize();
+      bool negative = s._limb[NLIMBS - 1] < 0;
+      if (negative) {
+        for (int i = 0; i < NLIMBS; i++) s._limb[i] = -s._limb[i];
+        s._pending = 1;
+        s.normalize();
+      }
+
+      int k = NLIMBS - 1;
+      while (k >= 0 && s._limb[k] == 0) k--;
+      if (k < 0) return 0.;
+
+      // Top 96 bits, plus a sticky bit for everything below them
+      unsigned __int128 top = 0;
+      for (int i = k; i >= k - 2; i--) top = (top << 32) | (i >= 0 ? uint64_t(s._limb[i]) : 0);
+      bool sticky = false;
+      for (int i = k - 3; i >= 0 && !sticky; i--) sticky = s._limb[i] != 0;
+      top = (top << 1) | (sticky ? 1 : 0);
+      double v = std::ldexp(double(top), 32 * (k - 2) - BIAS - 1);
+      return negative ? -v : v;
+    }
+
+  private:
+
+    // Limbs hold at most 2^32 per addition, so 2^30 additions cannot overflow
+    static const int64_t MAXPENDING = int64_t(1) << 30;
+
+    // Carries so that limbs 0..NLIMBS-2 are in [0, 2^32) and the top limb holds the sign
+    void normalize() {
+      if (_pending == 0) return;
+      for (int i = 0; i < NLIMBS - 1; i++) {
+        int64_t carry = _limb[i] >> 32;   // arithmetic shift, floor division
+        _limb[i] -= carry * (int64_t(1) << 32);
+        _limb[i + 1] += carry;
+      }
+      _pending = 0;
+    }
+
+    int64_t _limb[NLIMBS];
+    int64_t _pending;
+    double _nonfinite;   // inf/nan inputs, summed the ordinary way
+  };
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+// -*- C++ -*-
+
+// This is a Rivet analysis for JEWEL
+// It books no histograms: it writes the subtracted final state of every event
+// to a compact binary cache (see USPJWL_EventCache.hh), so that the other
+// USPJWL analyses can be rerun with new binnings or cuts through
+// tools/uspjwl-replay without reading HepMC or subtracting again.
+// The output path is read from the USPJWL_FSCACHE environment variable.
+
+#include "Rivet/Analysis.hh"
+#include "Rivet/Projections/FinalState.hh"
+#include "HepMC/GenEvent.h"
+#include "Rivet/Projections/SubtractedJewelEvent.hh"
+#include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_EventCache.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include <string>
+
+namespace Rivet {
+
+  class USPJWL_FSCACHE : public Analysis {
+  public:
+
+    /// Constructor
+    DEFAULT_RIVET_ANALYSIS_CTOR(USPJWL_FSCACHE);
+
+
+    void init() {
+
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), INIT);
+
+      // Grab output path from environment
+      CACHEPATH = getenv("USPJWL_FSCACHE") ? getenv("USPJWL_FSCACHE") : "USPJWL_FSCACHE.fscache";
+      std::cout << "\nSubtracted final state cache: " << CACHEPATH << std::endl;
+
+      // Widest acceptance used by the USPJWL analyses (|eta| < 3.2),
+      // tighter cuts are applied again by each analysis on replay
+      SubtractedJewelEvent sev(1.0);
+      SubtractedJewelFinalState fs(sev, Cuts::abseta < 3.2);
+      declare(fs, "FS");
+
+      _cache.open(CACHEPATH);
+    }
+
+
+    /// Perform the per-event analysis
+    void analyze(const Event& evt) {
+
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), ANALYZE);
+
+      // Stage timers, compiled in with -DUSPJWL_PROFILE (see USPJWL_Timing.hh)
+      USPJWL_TIME_SCOPE(_profile, "analyze");
+
+      const HepMC::GenEvent* ge = evt.genEvent();
+      double weight = ge->weights().size() > 0 ? ge->weights()[0] : 1.0;
+      _cache.beginEvent(ge->event_number(), weight);
+
+      const Particles& parts = USPJWL_TIMED(_profile, "subtracted final state", apply<SubtractedJewelFinalState>(evt, "FS").particles());
+      USPJWL_TIME_SCOPE(_profile, "cache write");
+      for (const Particle& p : parts) {
+        _cache.addParticle(p.pT(), p.eta(), p.phi(), p.mass(), p.pid(), p.charge3());
+      }
+
+      _cache.endEvent();
+    }
+
+
+    void finalize() {
+      std::cout << "Cached " << _cache.numEvents() << " events in " << CACHEPATH << std::endl;
+      _cache.close();
+      _profile.report(name());
+      USPJWL_ALLOC_REPORT(name(), analysisObjects());
+    }
+
+
+    std::string CACHEPATH;
+    USPJWL::EventCache::Writer _cache;
+    USPJWL::Timing::Profile _profile;
+
+  };
+
+
+
+  DECLARE_RIVET_PLUGIN(USPJWL_FSCACHE);
+
+}
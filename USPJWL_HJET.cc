@@ -28,6 +28,14 @@
 
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Arena.hh"
+#include "USPJWL_Kernels.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_CutScan.hh"
 
 
 #include "HepMC/PdfInfo.h"
@@ -53,8 +61,50 @@ namespace Rivet {
                   {   }
 
 
+            //Trigger candidate: what the trigger loops read from a Particle
+            struct Trigger {
+                  explicit Trigger(const Particle& p) : _pt(p.pT()), _phi(p.phi()), _pid(p.pid()) {}
+                  double pT() const { return _pt; }
+                  double phi() const { return _phi; }
+                  int pid() const { return _pid; }
+                  double _pt, _phi;
+                  int _pid;
+            };
+
+            //Recoil jet candidate: what the trigger x jet loops read from a Jet
+            struct RecoilJet {
+                  explicit RecoilJet(const Jet& j) : _pt(j.pT()), _phi(j.phi()) {}
+                  double pT() const { return _pt; }
+                  double phi() const { return _phi; }
+                  double _pt, _phi;
+            };
+
+            //Trigger spectra and counts of one centrality class; the counts (sums of
+            //weights) are merged with the outputs, for the per-trigger normalisation
+            struct Triggers {
+                  Histo1DPtr _hs_Ntrig, _hs_Ntrig_8_9, _hs_Ntrig_1, _hs_Ntrig_eta, _hs_Ntrig_6_7, _hs_Ntrig_12_50;
+                  CounterPtr _n, _n_8_9, _n_1, _n_eta, _n_6_7, _n_12_50;
+            };
+
+            //Recoil spectra of one USPJWL_SCAN point of the recoil window
+            struct Recoil {
+                  Histo1DPtr _hs_pTJet, _hs_pTJet_8_9, _hs_pTJet_1, _hs_pTJet_eta, _hs_pTJet_6_7, _hs_pTJet_12_50;
+            };
+
+            //Recoil-jet histograms of one subtraction setting and centrality class
+            struct Histos {
+                  Histo1DPtr _hs_pTJet, _hs_pTJet_8_9, _hs_pTJet_1, _hs_pTJet_eta, _hs_pTJet_all,
+                  _hs_pTJet_all_8_9, _hs_pTJet_all_1, _hs_pTJet_all_eta,
+                  _hs_pTJet_6_7, _hs_pTJet_all_6_7, _hs_pTJet_12_50, _hs_pTJet_all_12_50;
+                  std::vector<Recoil> _scan;
+            };
+
+
             void init() {
 
+                  //Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+                  USPJWL_ALLOC_SCOPE(name(), INIT);
+
                   
 
 
@@ -68,19 +118,10 @@ namespace Rivet {
                         
 
                   RJETS_f = 0.4;
-                  Ntrig = 0;
                   etamax = 0.9;                  
                   etamax_jet = etamax - RJETS_f;
 
 
-                  counter_hadrons = 0;                  
-                  counter_hadrons8_9 = 0;
-                  counter_hadrons6_7 = 0;
-                  counter_hadrons12_50 = 0;
-                  counter_hadrons1 = 0;
-                  counter_hadrons_eta = 0;
-
-
                   std::cout << "\nR jet algorithm: " << RJETS_f << std::endl;
 
 
@@ -88,52 +129,70 @@ namespace Rivet {
                   Cut cut(Cuts::abseta<0.9);
 
 
-                  SubtractedJewelEvent sev(1.0);
-                  SubtractedJewelFinalState fs(sev, cut);
+                  //Recoil window |dphi(trigger, jet)| >= pi - 0.6, which USPJWL_SCAN can vary (see USPJWL_CutScan.hh)
+                  _recoilDphi = _cuts.add("recoil_dphi", USPJWL::CutScan::ATLEAST, M_PI - 0.6);
+                  _cuts.configure(name());
 
-                  //const FinalState fs(cut);
-                  declare(fs, "FS");
+                  //One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and one
+                  //set of recoil-jet histograms per setting and centrality class (see
+                  //USPJWL_Runtime.hh); the triggers are taken from the unsubtracted event, so their
+                  //lists, counters and spectra are shared by all settings
+                  _centrality.configure(name());
+                  _subtraction.configure(name());
+                  _sets.resize(_centrality.size() * _subtraction.size());
+                  for (size_t c = 0; c < _subtraction.size(); c++) {
+                        SubtractedJewelEvent sev(_subtraction.parameter(c));
+                        SubtractedJewelFinalState fs(sev, cut);
 
-                  const ChargedFinalState cfs(fs);
-                  declare(cfs, "CFS");
+                        //const FinalState fs(cut);
+                        declare(fs, _subtraction.name("FS", c));
 
+                        const ChargedFinalState cfs(fs);
+                        declare(cfs, _subtraction.name("CFS", c));
 
-                  // Apply FastJet
-                  FastJets cfj(cfs, FastJets::ANTIKT, RJETS_f);                        
-                  declare(cfj, "C_Jets");
 
+                        // Apply FastJet
+                        FastJets cfj(cfs, FastJets::ANTIKT, RJETS_f);
+                        declare(cfj, _subtraction.name("C_Jets", c));
 
+                        for (size_t k = 0; k < _centrality.size(); k++) {
+                              bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+                        }
+                  }
+
+
+                  //Trigger spectra, one set per centrality class
                   vector<double> hjet_edges=linspace(100,0.0,100.0);
-                  //vector<double> edges_20_50=linspace(100,19.5,50.5);
-                  //vector<double> edges_8_9=linspace(100,7.5,9.5);
-                  //vector<double> edges_1=linspace(100,0.5,100.5);
+                  _triggers.resize(_centrality.size());
+                  for (size_t k = 0; k < _centrality.size(); k++) {
+                        book(_triggers[k]._hs_Ntrig,"hNtrig_20_50" + _centrality.tag(k),hjet_edges);
+                        book(_triggers[k]._hs_Ntrig_12_50,"hNtrig_12_50" + _centrality.tag(k),hjet_edges);
+                        book(_triggers[k]._hs_Ntrig_8_9,"hNtrig_8_9" + _centrality.tag(k),hjet_edges);
+                        book(_triggers[k]._hs_Ntrig_6_7,"hNtrig_6_7" + _centrality.tag(k),hjet_edges);
+                        book(_triggers[k]._hs_Ntrig_1,"hNtrig_1" + _centrality.tag(k),hjet_edges);
+                        book(_triggers[k]._hs_Ntrig_eta,"hNtrig_eta" + _centrality.tag(k),hjet_edges);
+
+                        book(_triggers[k]._n,"Ntrig_20_50_counter" + _centrality.tag(k));
+                        book(_triggers[k]._n_12_50,"Ntrig_12_50_counter" + _centrality.tag(k));
+                        book(_triggers[k]._n_8_9,"Ntrig_8_9_counter" + _centrality.tag(k));
+                        book(_triggers[k]._n_6_7,"Ntrig_6_7_counter" + _centrality.tag(k));
+                        book(_triggers[k]._n_1,"Ntrig_1_counter" + _centrality.tag(k));
+                        book(_triggers[k]._n_eta,"Ntrig_eta_counter" + _centrality.tag(k));
+                  }
 
-                  
+                  //Events analysed, for the per-event normalisation after the merge
+                  book(_evtcount,"Events_counter");
 
-                  
-                  
-                  // Book histograms
-                  book(_hs_pTJet,"Njet_20_50",hjet_edges);
-                  book(_hs_pTJet_12_50,"Njet_12_50",hjet_edges);
-                  book(_hs_pTJet_6_7,"Njet_6_7",hjet_edges);
-                  book(_hs_pTJet_8_9,"Njet_8_9",hjet_edges);
-                  book(_hs_pTJet_1,"Njet_1",hjet_edges);
-                  book(_hs_pTJet_eta,"Njet_eta",hjet_edges);
-
-                  book(_hs_Ntrig,"hNtrig_20_50",hjet_edges);
-                  book(_hs_Ntrig_12_50,"hNtrig_12_50",hjet_edges);
-                  book(_hs_Ntrig_8_9,"hNtrig_8_9",hjet_edges);
-                  book(_hs_Ntrig_6_7,"hNtrig_6_7",hjet_edges);
-                  book(_hs_Ntrig_1,"hNtrig_1",hjet_edges);
-                  book(_hs_Ntrig_eta,"hNtrig_eta",hjet_edges);
-
-                  book(_hs_pTJet_all,"Njet_all_20_50",hjet_edges);
-                  book(_hs_pTJet_all_12_50,"Njet_all_12_50",hjet_edges);
-                  book(_hs_pTJet_all_8_9,"Njet_all_8_9",hjet_edges);
-                  book(_hs_pTJet_all_6_7,"Njet_all_6_7",hjet_edges);
-                  book(_hs_pTJet_all_1,"Njet_all_1",hjet_edges);
-                  book(_hs_pTJet_all_eta,"Njet_all_eta",hjet_edges);
+                  //Events of each centrality class, for the per-class normalisation
+                  if (_centrality.enabled()) {
+                        book(_centcount,"Centrality_counter",_centrality.size(),-0.5,_centrality.size()-0.5);
+                  }
+                  _runtime.route(_centrality, _subtraction.size(), _centcount);
 
+
+                  //Checkpointing and resume (see USPJWL_Runtime.hh); the trigger counts are
+                  //booked counters and are carried like the histograms
+                  _runtime.init(*this, analysisObjects());
                   
                   
 
@@ -143,12 +202,56 @@ namespace Rivet {
 
                   
                   
+            }
+
+
+            //Book the recoil-jet histograms, tag is appended to every name
+            void bookSet(Histos& hs, const std::string& tag) {
+
+                  vector<double> hjet_edges=linspace(100,0.0,100.0);
+                  //vector<double> edges_20_50=linspace(100,19.5,50.5);
+                  //vector<double> edges_8_9=linspace(100,7.5,9.5);
+                  //vector<double> edges_1=linspace(100,0.5,100.5);
+
+                  book(hs._hs_pTJet,"Njet_20_50" + tag,hjet_edges);
+                  book(hs._hs_pTJet_12_50,"Njet_12_50" + tag,hjet_edges);
+                  book(hs._hs_pTJet_6_7,"Njet_6_7" + tag,hjet_edges);
+                  book(hs._hs_pTJet_8_9,"Njet_8_9" + tag,hjet_edges);
+                  book(hs._hs_pTJet_1,"Njet_1" + tag,hjet_edges);
+                  book(hs._hs_pTJet_eta,"Njet_eta" + tag,hjet_edges);
+
+                  book(hs._hs_pTJet_all,"Njet_all_20_50" + tag,hjet_edges);
+                  book(hs._hs_pTJet_all_12_50,"Njet_all_12_50" + tag,hjet_edges);
+                  book(hs._hs_pTJet_all_8_9,"Njet_all_8_9" + tag,hjet_edges);
+                  book(hs._hs_pTJet_all_6_7,"Njet_all_6_7" + tag,hjet_edges);
+                  book(hs._hs_pTJet_all_1,"Njet_all_1" + tag,hjet_edges);
+                  book(hs._hs_pTJet_all_eta,"Njet_all_eta" + tag,hjet_edges);
+
+                  hs._scan.resize(_cuts.size());
+                  for (size_t p = 0; p < _cuts.size(); p++) {
+                        Recoil& r = hs._scan[p];
+                        const std::string scan = tag + _cuts.tag(p);
+                        book(r._hs_pTJet,"Njet_20_50" + scan,hjet_edges);
+                        book(r._hs_pTJet_12_50,"Njet_12_50" + scan,hjet_edges);
+                        book(r._hs_pTJet_6_7,"Njet_6_7" + scan,hjet_edges);
+                        book(r._hs_pTJet_8_9,"Njet_8_9" + scan,hjet_edges);
+                        book(r._hs_pTJet_1,"Njet_1" + scan,hjet_edges);
+                        book(r._hs_pTJet_eta,"Njet_eta" + scan,hjet_edges);
+                  }
             }
 
 
             /// Perform the per-event analysis
             void analyze(const Event& evt) {
 
+                  //Timers, resumed events and centrality class (see USPJWL_Runtime.hh)
+                  USPJWL::Runtime::Event event(_runtime, evt, _profile);
+                  if (event.set() < 0) vetoEvent;
+                  _evtcount->fill();
+
+                  //Per-event scratch memory for the trigger lists, released when the event is done
+                  USPJWL::Arena::EventScope scratch(_arena);
+
                   
 
 
@@ -169,20 +272,23 @@ namespace Rivet {
 
                   
 
-                  //JETS
-                  //Cut for jets by paper 20 < pT < 100 GeV/c for R=0.2 and R=0.4
-                  Cut jetcuts = Cuts::pT >= 0.15 * GeV && Cuts::pT <= 100.0 * GeV && Cuts::abseta < etamax_jet;
-                  const Jets alljets = apply<FastJets>(evt, "C_Jets").jetsByPt(jetcuts);
-
-
-
                   //PARTICLES
-                  auto Particles  = evt.allParticles(partcuts);
-                  auto Particles8_9  = evt.allParticles(partcuts8_9);
-                  auto Particles6_7  = evt.allParticles(partcuts6_7);
-                  auto Particles12_50  = evt.allParticles(partcuts12_50);
-                  auto Particles1  = evt.allParticles(partcuts1);
-                  auto Particles_eta  = evt.allParticles(partcuts_eta);
+                  //One pass over the event fills the six trigger lists (same cuts and order as evt.allParticles(cut))
+                  USPJWL::ScratchVector<Trigger> Particles(_arena), Particles8_9(_arena), Particles6_7(_arena),
+                        Particles12_50(_arena), Particles1(_arena), Particles_eta(_arena);
+                  {
+                        USPJWL_TIME_SCOPE(_profile, "trigger lists");
+                        for (const Particle& p : evt.allParticles()) {
+                              if (!partcuts_eta->accept(p)) continue;
+                              const Trigger t(p);
+                              Particles_eta.push_back(t);
+                              if (partcuts->accept(p)) Particles.push_back(t);
+                              if (partcuts8_9->accept(p)) Particles8_9.push_back(t);
+                              if (partcuts6_7->accept(p)) Particles6_7.push_back(t);
+                              if (partcuts12_50->accept(p)) Particles12_50.push_back(t);
+                              if (partcuts1->accept(p)) Particles1.push_back(t);
+                        }
+                  }
 
                   //output << "size Particles = " << Particles.size() << "\n";
                   //output << "size Particles8_9 = " << Particles8_9.size() << "\n"; 
@@ -193,7 +299,41 @@ namespace Rivet {
 
 
 
+                  for (size_t c = 0; c < _subtraction.size(); c++) {
+                        analyzeSetting(evt, c, _sets[event.set() + c], _triggers[event.centralityClass()],
+                                       Particles, Particles8_9, Particles6_7, Particles12_50, Particles1, Particles_eta);
+                  }
+            }
+
+
+            //Recoil jets of subtraction setting c against the trigger lists of the event,
+            //filled into hs; the trigger spectra go to tt
+            void analyzeSetting(const Event& evt, size_t c, Histos& hs, Triggers& tt, const USPJWL::ScratchVector<Trigger>& Particles,
+                                const USPJWL::ScratchVector<Trigger>& Particles8_9, const USPJWL::ScratchVector<Trigger>& Particles6_7,
+                                const USPJWL::ScratchVector<Trigger>& Particles12_50, const USPJWL::ScratchVector<Trigger>& Particles1,
+                                const USPJWL::ScratchVector<Trigger>& Particles_eta) {
+
+                  //Trigger counters and spectra do not depend on the subtraction
+                  const bool nominal = c == 0;
+
+                  //Charged to its own stage instead of the first apply<FastJets>
+                  USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("FS", c)));
+
+                  //JETS
+                  //Cut for jets by paper 20 < pT < 100 GeV/c for R=0.2 and R=0.4
+                  Cut jetcuts = Cuts::pT >= 0.15 * GeV && Cuts::pT <= 100.0 * GeV && Cuts::abseta < etamax_jet;
+                  const FastJets& cfj = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("C_Jets", c)));
+                  const Jets alljets = USPJWL_TIMED(_profile, "jetsByPt", cfj.jetsByPt(jetcuts));
+
+                  //Jet phi and pT are computed once here instead of for every trigger
+                  USPJWL::ScratchVector<RecoilJet> recoils(_arena);
+                  recoils.reserve(alljets.size());
+                  for (const Jet& j : alljets) recoils.push_back(RecoilJet(j));
+
+
+
                   for (size_t i = 0; i < Particles.size(); i++) {
+                    USPJWL_TIME_SCOPE(_profile, "TT{20,50} trigger");
 
                     //double phi = Particles[i].phi(), eta = Particles[i].eta(), pt = Particles[i].pT();
                     double phi = Particles[i].phi(), pt = Particles[i].pT();
@@ -201,7 +341,7 @@ namespace Rivet {
 
                     //Charged hadrons selection
                     if (PID::isHadron(pid) && PID::isCharged(pid)){
-                        counter_hadrons+=1;
+                        if (nominal) tt._n->fill();
                         //Ntrig+=evt.weight();
 
                         //particles identification
@@ -209,22 +349,24 @@ namespace Rivet {
                         //output << "Particle (20-50) pT = " << pt << "\n";
 
 
-                        _hs_Ntrig->fill(pt/GeV);
+                        if (nominal) tt._hs_Ntrig->fill(pt/GeV);
                         //JETS 
-                        for(const Jet& j: alljets){
+                        for(const RecoilJet& j: recoils){
                               //Jets identification
                               //double phi_j = j.phi(), eta_j = j.eta(), pt_j = j.pT();
                               double phi_j = j.phi(), pt_j = j.pT();
                               
 
-                              _hs_pTJet_all->fill(pt_j/GeV);
+                              hs._hs_pTJet_all->fill(pt_j/GeV);
                               //selection condition for jets: difference in azimuthal angle >= pi - 0.6
-                              if(deltaPhi(phi,phi_j) >= M_PI - 0.6){
+                              const double dphi = USPJWL::Kernels::deltaPhi(phi,phi_j);
+                              USPJWL::CutScan::forEach(_cuts.pass(_recoilDphi, dphi), [&](size_t p){ hs._scan[p]._hs_pTJet->fill(pt_j/GeV); });
+                              if(dphi >= M_PI - 0.6){
 
                                     //output << "jet" << "\t" << phi_j << "\t" << eta_j << "\t" << pt_j << "\t" << counter_hadrons<< "\t" << "\n";
 
                                     //jet spectrum histogram 
-                                    _hs_pTJet->fill(pt_j/GeV);
+                                    hs._hs_pTJet->fill(pt_j/GeV);
                               }
                         }
                         
@@ -234,6 +376,7 @@ namespace Rivet {
                   }
 
                   for (size_t i = 0; i < Particles8_9.size(); i++) {
+                    USPJWL_TIME_SCOPE(_profile, "TT{8,9} trigger");
 
                     //double phi = Particles8_9[i].phi(), eta = Particles8_9[i].eta(), pt = Particles8_9[i].pT();
                     int pid = Particles8_9[i].pid(), pt = Particles8_9[i].pT();
@@ -241,34 +384,37 @@ namespace Rivet {
 
                     //Charged hadrons selection
                     if (PID::isHadron(pid) && PID::isCharged(pid)){
-                        counter_hadrons8_9+=1.;
+                        if (nominal) tt._n_8_9->fill();
                         //Ntrig8_9+=evt.weight();
 
 
-                        _hs_Ntrig_8_9->fill(pt/GeV);
+                        if (nominal) tt._hs_Ntrig_8_9->fill(pt/GeV);
                         //particles identification
                         //output << pid << "\t" << phi << "\t" << eta << "\t" << pt << "\t" << counter_hadrons8_9 << "\t" << Ntrig8_9 << "\n";  
 
                         //JETS 
-                        for(const Jet& j: alljets){
+                        for(const RecoilJet& j: recoils){
                               //Jets identification
                               //double phi_j = j.phi(), eta_j = j.eta(), pt_j = j.pT();
                               double phi_j = j.phi(), pt_j = j.pT();
 
-                              _hs_pTJet_all_8_9->fill(pt_j/GeV);
+                              hs._hs_pTJet_all_8_9->fill(pt_j/GeV);
                               //selection condition for jets: difference in azimuthal angle >= pi - 0.6
-                              if(deltaPhi(phi,phi_j) >= M_PI - 0.6){
+                              const double dphi = USPJWL::Kernels::deltaPhi(phi,phi_j);
+                              USPJWL::CutScan::forEach(_cuts.pass(_recoilDphi, dphi), [&](size_t p){ hs._scan[p]._hs_pTJet_8_9->fill(pt_j/GeV); });
+                              if(dphi >= M_PI - 0.6){
 
                                     //output << "jet" << "\t" << phi_j << "\t" << eta_j << "\t" << pt_j << "\t" << counter_hadrons8_9 << "\t" << "\n";
 
                                     //jet spectrum histogram 
-                                    _hs_pTJet_8_9->fill(pt_j/GeV);
+                                    hs._hs_pTJet_8_9->fill(pt_j/GeV);
                               }
                         }
                         
                     }
 
                   for (size_t i = 0; i < Particles6_7.size(); i++) {
+                    USPJWL_TIME_SCOPE(_profile, "TT{6,7} trigger");
 
                     //double phi = Particles6_7[i].phi(), eta = Particles6_7[i].eta(), pt = Particles6_7[i].pT();
                     int pid = Particles6_7[i].pid(), pt = Particles6_7[i].pT();
@@ -276,7 +422,7 @@ namespace Rivet {
 
                     //Charged hadrons selection
                     if (PID::isHadron(pid) && PID::isCharged(pid)){
-                        counter_hadrons6_7+=1;
+                        if (nominal) tt._n_6_7->fill();
                         //Ntrig+=evt.weight();
 
                         //particles identification
@@ -284,21 +430,23 @@ namespace Rivet {
                         //output << "Particle (6-7) pT = " << pt << "\n";
 
 
-                        _hs_Ntrig_6_7->fill(pt/GeV);
+                        if (nominal) tt._hs_Ntrig_6_7->fill(pt/GeV);
                         //JETS 
-                        for(const Jet& j: alljets){
+                        for(const RecoilJet& j: recoils){
                               //Jets identification
                               //double phi_j = j.phi(), eta_j = j.eta(), pt_j = j.pT();
                               double phi_j = j.phi(), pt_j = j.pT();
 
-                              _hs_pTJet_all_6_7->fill(pt_j/GeV);
+                              hs._hs_pTJet_all_6_7->fill(pt_j/GeV);
                               //selection condition for jets: difference in azimuthal angle >= pi - 0.6
-                              if(deltaPhi(phi,phi_j) >= M_PI - 0.6){
+                              const double dphi = USPJWL::Kernels::deltaPhi(phi,phi_j);
+                              USPJWL::CutScan::forEach(_cuts.pass(_recoilDphi, dphi), [&](size_t p){ hs._scan[p]._hs_pTJet_6_7->fill(pt_j/GeV); });
+                              if(dphi >= M_PI - 0.6){
 
                                     //output << "jet" << "\t" << phi_j << "\t" << eta_j << "\t" << pt_j << "\t" << counter_hadrons<< "\t" << "\n";
 
                                     //jet spectrum histogram 
-                                    _hs_pTJet_6_7->fill(pt_j/GeV);
+                                    hs._hs_pTJet_6_7->fill(pt_j/GeV);
                               }
                         }
                         
@@ -310,6 +458,7 @@ namespace Rivet {
               
                   }
                   for (size_t i = 0; i < Particles1.size(); i++) {
+                    USPJWL_TIME_SCOPE(_profile, "TT{1} trigger");
 
                     //double phi = Particles1[i].phi(), eta = Particles1[i].eta(), pt = Particles1[i].pT();
                     int pid = Particles1[i].pid(), pt = Particles1[i].pT();
@@ -317,29 +466,31 @@ namespace Rivet {
 
                     //Charged hadrons selection
                     if (PID::isHadron(pid) && PID::isCharged(pid)){
-                        counter_hadrons1+=1.;
+                        if (nominal) tt._n_1->fill();
                         //Ntrig1+=evt.weight();
 
 
-                        _hs_Ntrig_1->fill(pt/GeV);
+                        if (nominal) tt._hs_Ntrig_1->fill(pt/GeV);
                         //particles identification
                         //output << pid << "\t" << phi << "\t" << eta << "\t" << pt << "\t" << counter_hadrons1 << "\t" << Ntrig1 << "\n";  
 
                         //JETS 
-                        for(const Jet& j: alljets){
+                        for(const RecoilJet& j: recoils){
                               //Jets identification
                               //double phi_j = j.phi(), eta_j = j.eta(), pt_j = j.pT();
                               double phi_j = j.phi(), pt_j = j.pT();
 
 
-                              _hs_pTJet_all_1->fill(pt_j/GeV);
+                              hs._hs_pTJet_all_1->fill(pt_j/GeV);
                               //selection condition for jets: difference in azimuthal angle >= pi - 0.6
-                              if(deltaPhi(phi,phi_j) >= M_PI - 0.6){
+                              const double dphi = USPJWL::Kernels::deltaPhi(phi,phi_j);
+                              USPJWL::CutScan::forEach(_cuts.pass(_recoilDphi, dphi), [&](size_t p){ hs._scan[p]._hs_pTJet_1->fill(pt_j/GeV); });
+                              if(dphi >= M_PI - 0.6){
 
                                     //output << "jet" << "\t" << phi_j << "\t" << eta_j << "\t" << pt_j << "\t" << counter_hadrons1 << "\t" << "\n";
 
                                     //jet spectrum histogram 
-                                    _hs_pTJet_1->fill(pt_j/GeV);
+                                    hs._hs_pTJet_1->fill(pt_j/GeV);
                               }
                         }
 
@@ -349,6 +500,7 @@ namespace Rivet {
               
                   }
                   for (size_t i = 0; i < Particles_eta.size(); i++) {
+                    USPJWL_TIME_SCOPE(_profile, "TT{eta} trigger");
 
                     //double phi = Particles_eta[i].phi(), eta = Particles_eta[i].eta(), pt = Particles_eta[i].pT();
                     int pid = Particles_eta[i].pid(), pt = Particles_eta[i].pT();
@@ -356,28 +508,30 @@ namespace Rivet {
 
                     //Charged hadrons selection
                     if (PID::isHadron(pid) && PID::isCharged(pid)){
-                        counter_hadrons_eta+=1.;
+                        if (nominal) tt._n_eta->fill();
                         //Ntrig_eta+=evt.weight();
 
 
-                        _hs_Ntrig_eta->fill(pt/GeV);
+                        if (nominal) tt._hs_Ntrig_eta->fill(pt/GeV);
                         //particles identification
                         //output << pid << "\t" << phi << "\t" << eta << "\t" << pt << "\t" << counter_hadrons_eta << "\t" << Ntrig_eta << "\n";  
 
                         //JETS 
-                        for(const Jet& j: alljets){
+                        for(const RecoilJet& j: recoils){
                               //Jets identification
                               //double phi_j = j.phi(), eta_j = j.eta(), pt_j = j.pT();
                               double phi_j = j.phi(), pt_j = j.pT();
 
-                              _hs_pTJet_all_eta->fill(pt_j/GeV);
+                              hs._hs_pTJet_all_eta->fill(pt_j/GeV);
                               //selection condition for jets: difference in azimuthal angle >= pi - 0.6
-                              if(deltaPhi(phi,phi_j) >= M_PI - 0.6){
+                              const double dphi = USPJWL::Kernels::deltaPhi(phi,phi_j);
+                              USPJWL::CutScan::forEach(_cuts.pass(_recoilDphi, dphi), [&](size_t p){ hs._scan[p]._hs_pTJet_eta->fill(pt_j/GeV); });
+                              if(dphi >= M_PI - 0.6){
 
                                     //output << "jet" << "\t" << phi_j << "\t" << eta_j << "\t" << pt_j << "\t" << counter_hadrons_eta << "\t" << "\n";
 
                                     //jet spectrum histogram 
-                                    _hs_pTJet_eta->fill(pt_j/GeV);
+                                    hs._hs_pTJet_eta->fill(pt_j/GeV);
                               }
                         }
                         //
@@ -386,6 +540,7 @@ namespace Rivet {
               
                   }
                   for (size_t i = 0; i < Particles12_50.size(); i++) {
+                    USPJWL_TIME_SCOPE(_profile, "TT{12,50} trigger");
 
                     //double phi = Particles12_50[i].phi(), eta = Particles12_50[i].eta(), pt = Particles12_50[i].pT();
                     int pid = Particles12_50[i].pid(), pt = Particles12_50[i].pT();
@@ -393,29 +548,31 @@ namespace Rivet {
 
                     //Charged hadrons selection
                     if (PID::isHadron(pid) && PID::isCharged(pid)){
-                        counter_hadrons12_50+=1.;
+                        if (nominal) tt._n_12_50->fill();
                         //Ntrig_eta+=evt.weight();
 
 
-                        _hs_Ntrig_12_50->fill(pt/GeV);
+                        if (nominal) tt._hs_Ntrig_12_50->fill(pt/GeV);
                         //particles identification
                         //output << pid << "\t" << phi << "\t" << eta << "\t" << pt << "\t" << counter_hadrons_eta << "\t" << Ntrig_eta << "\n";  
 
                         //JETS 
-                        for(const Jet& j: alljets){
+                        for(const RecoilJet& j: recoils){
                               //Jets identification
                               //double phi_j = j.phi(), eta_j = j.eta(), pt_j = j.pT();
                               double phi_j = j.phi(), pt_j = j.pT();
 
 
-                              _hs_pTJet_all_12_50->fill(pt_j/GeV);
+                              hs._hs_pTJet_all_12_50->fill(pt_j/GeV);
                               //selection condition for jets: difference in azimuthal angle >= pi - 0.6
-                              if(deltaPhi(phi,phi_j) >= M_PI - 0.6){
+                              const double dphi = USPJWL::Kernels::deltaPhi(phi,phi_j);
+                              USPJWL::CutScan::forEach(_cuts.pass(_recoilDphi, dphi), [&](size_t p){ hs._scan[p]._hs_pTJet_12_50->fill(pt_j/GeV); });
+                              if(dphi >= M_PI - 0.6){
 
                                     //output << "jet" << "\t" << phi_j << "\t" << eta_j << "\t" << pt_j << "\t" << counter_hadrons_eta << "\t" << "\n";
 
                                     //jet spectrum histogram 
-                                    _hs_pTJet_12_50->fill(pt_j/GeV);
+                                    hs._hs_pTJet_12_50->fill(pt_j/GeV);
                               }
                         }
                         //
@@ -443,13 +600,12 @@ namespace Rivet {
 
 
 
-                  scale(_hs_pTJet,  1/(2*etamax_jet));      //Normalization and divide by dN/d_eta 
-                  scale(_hs_pTJet_8_9,  1/(2*etamax_jet));
-                  scale(_hs_pTJet_6_7,  1/(2*etamax_jet));
-                  scale(_hs_pTJet_12_50,  1/(2*etamax_jet));
-                  scale(_hs_pTJet_1,  1/(2*etamax_jet));
-                  scale(_hs_pTJet_eta,  1/(2*etamax_jet));
+                  //Scale only after yoda merge: the per-trigger and 1/(2 etamax_jet) normalisations
+                  //are in tools/uspjwl-derive.recipe
 
+                  _runtime.finalize();
+                  _profile.report(name());
+                  USPJWL_ALLOC_REPORT(name(), analysisObjects());
 
 
                   
@@ -458,27 +614,24 @@ namespace Rivet {
 
             //constants
             double RJETS_f;
-            double Ntrig;
-            double Ntrig1;
-            double Ntrig8_9;
-            double Ntrig_eta;
             double etamax;
             double etamax_jet;
-            double counter_hadrons;                  
-            double counter_hadrons8_9;
-            double counter_hadrons6_7;
-            double counter_hadrons12_50;
-            double counter_hadrons1;
-            double counter_hadrons_eta;
 
 
+            USPJWL::Runtime _runtime;
+            USPJWL::Timing::Profile _profile;
+            USPJWL::Arena _arena;
+
             //std::ofstream output;
 
-            Histo1DPtr _hs_Ntrig, _hs_pTJet, _hs_Ntrig_8_9, _hs_pTJet_8_9,
-            _hs_Ntrig_1, _hs_pTJet_1, _hs_Ntrig_eta, _hs_pTJet_eta, _hs_pTJet_all,
-            _hs_pTJet_all_8_9, _hs_pTJet_all_1, _hs_pTJet_all_eta, _hs_Ntrig_6_7, 
-            _hs_pTJet_6_7, _hs_pTJet_all_6_7, _hs_Ntrig_12_50, _hs_pTJet_12_50,
-            _hs_pTJet_all_12_50;
+            std::vector<Triggers> _triggers;
+            std::vector<Histos> _sets;
+            USPJWL::Subtraction::Settings _subtraction;
+            USPJWL::Centrality::Classes _centrality;
+            USPJWL::CutScan::Grid _cuts;
+            size_t _recoilDphi;
+            Histo1DPtr _centcount;
+            CounterPtr _evtcount;
 
 
             
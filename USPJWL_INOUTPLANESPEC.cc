@@ -17,6 +17,15 @@
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
 #include "Rivet/Projections/ChargedFinalState.hh"
+#include "USPJWL_JetStore.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Kernels.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_CutScan.hh"
 #include <string>
 
 namespace Rivet {
@@ -40,8 +49,25 @@ namespace Rivet {
     DEFAULT_RIVET_ANALYSIS_CTOR(USPJWL_INOUTPLANESPEC);
 
 
+    /// Spectra of one leading-track selection
+    struct Planes {
+      // R_AA
+      Histo1DPtr _hist_inplane2, _hist_outplane2, _hist_inplane3, _hist_outplane3, _hist_inplane4, _hist_outplane4, _hist_allplane;
+    };
+
+    /// Histograms of one subtraction setting
+    struct Histos {
+      // Nominal leading-track window, and one family per USPJWL_SCAN point
+      Planes _planes;
+      std::vector<Planes> _scan;
+    };
+
+
     void init() {
 
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), INIT);
+
       // Grab variable jet R parameter from environment, default value of 0.4
       RJETS = getenv("RJETS") ? getenv("RJETS") : "0.4";
       RJETS_f = std::stof(RJETS);
@@ -60,48 +86,131 @@ namespace Rivet {
       std::cout << getenv("PSI3") << " -> " << PSI3 << std::endl;
       std::cout << getenv("PSI4") << " -> " << PSI4 << std::endl;
 
-      SubtractedJewelEvent sev(1.0);
-      SubtractedJewelFinalState fs(sev, Cuts::abseta < 0.9);
-	    ChargedFinalState cfs(fs);
-      declare(cfs, "CFS");
+      // Leading-track window that USPJWL_SCAN can vary (see USPJWL_CutScan.hh)
+      _leadMin = _cuts.add("lead_min", USPJWL::CutScan::ABOVE, 5);
+      _leadMax = _cuts.add("lead_max", USPJWL::CutScan::BELOW, 100);
+      _cuts.configure(name());
+
+      // One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and
+      // one histogram set per setting and centrality class (see USPJWL_Runtime.hh)
+      _centrality.configure(name());
+      _subtraction.configure(name());
+      _sets.resize(_centrality.size() * _subtraction.size());
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        SubtractedJewelEvent sev(_subtraction.parameter(c));
+        SubtractedJewelFinalState fs(sev, Cuts::abseta < 0.9);
+        ChargedFinalState cfs(fs);
+        declare(cfs, _subtraction.name("CFS", c));
+
+        // Apply FastJet
+        FastJets fj(cfs, FastJets::ANTIKT, RJETS_f);
+        fj.useInvisibles();
+        declare(fj, _subtraction.name("Jets", c));
+
+        for (size_t k = 0; k < _centrality.size(); k++) {
+          bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+        }
+      }
+
+      // Events of each centrality class, for the per-class normalisation
+      if (_centrality.enabled()) {
+        book(_centcount, "Centrality_counter", _centrality.size(), -0.5, _centrality.size() - 0.5);
+      }
+      _runtime.route(_centrality, _subtraction.size(), _centcount);
+
+      // Events rejected (bin 0) and accepted (bin 1) by the pre-filter
+      _skim.configure(RJETS_f, 0.9, 20 * GeV);
+      book(_skimcount, "Skim_counter_R" + RJETS, 2, -0.5, 1.5);
+      _runtime.prefilter(_skim, _skimcount);
+
+      // Optional per-jet output for re-binning without rerunning (see USPJWL_JetStore.hh)
+      if (getenv("USPJWL_JETSTORE")) {
+        _jetstore.open(std::string(getenv("USPJWL_JETSTORE")) + "_" + name() + "_R" + RJETS + ".jets");
+      }
+
+      // Checkpointing and resume (see USPJWL_Runtime.hh)
+      _runtime.init(*this, analysisObjects());
+    }
 
-      // Apply FastJet
-      FastJets fj(cfs, FastJets::ANTIKT, RJETS_f);
-      fj.useInvisibles();
-      declare(fj, "Jets");
 
-      // Book histograms
-      _hist_inplane2 = book(_hist_inplane2, "InPlaneSpec_N2_R" + RJETS, PTEDGES);
-      _hist_outplane2 = book(_hist_outplane2, "OutPlaneSpec_N2_R" + RJETS, PTEDGES);
+    // Book histograms, tag is appended to every name
+    void bookSet(Histos& hs, const std::string& tag) {
+      bookPlanes(hs._planes, tag);
+      hs._scan.resize(_cuts.size());
+      for (size_t p = 0; p < _cuts.size(); p++) bookPlanes(hs._scan[p], tag + _cuts.tag(p));
+    }
+
+
+    void bookPlanes(Planes& h, const std::string& tag) {
+      h._hist_inplane2 = book(h._hist_inplane2, "InPlaneSpec_N2_R" + RJETS + tag, PTEDGES);
+      h._hist_outplane2 = book(h._hist_outplane2, "OutPlaneSpec_N2_R" + RJETS + tag, PTEDGES);
       
-      _hist_inplane3 = book(_hist_inplane3, "InPlaneSpec_N3_R" + RJETS, PTEDGES);
-      _hist_outplane3 = book(_hist_outplane3, "OutPlaneSpec_N3_R" + RJETS, PTEDGES);
+      h._hist_inplane3 = book(h._hist_inplane3, "InPlaneSpec_N3_R" + RJETS + tag, PTEDGES);
+      h._hist_outplane3 = book(h._hist_outplane3, "OutPlaneSpec_N3_R" + RJETS + tag, PTEDGES);
 	  
-      _hist_inplane4 = book(_hist_inplane4, "InPlaneSpec_N4_R" + RJETS, PTEDGES);
-      _hist_outplane4 = book(_hist_outplane4, "OutPlaneSpec_N4_R" + RJETS, PTEDGES);
+      h._hist_inplane4 = book(h._hist_inplane4, "InPlaneSpec_N4_R" + RJETS + tag, PTEDGES);
+      h._hist_outplane4 = book(h._hist_outplane4, "OutPlaneSpec_N4_R" + RJETS + tag, PTEDGES);
 	  
-	    _hist_allplane = book(_hist_allplane, "Spec_R" + RJETS, PTEDGES);
+	    h._hist_allplane = book(h._hist_allplane, "Spec_R" + RJETS + tag, PTEDGES);
     }
 
 
     /// Perform the per-event analysis
     void analyze(const Event& evt) {
 
+      // Timers, resumed events, centrality class and pre-filter (see USPJWL_Runtime.hh)
+      USPJWL::Runtime::Event event(_runtime, evt, _profile);
+      if (event.set() < 0) vetoEvent;
+
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        analyzeSetting(evt, c, _sets[event.set() + c]);
+      }
+    }
+
+
+    // Observables of subtraction setting c, filled into hs
+    void analyzeSetting(const Event& evt, size_t c, Histos& hs) {
+      // Charged to its own stage instead of the first apply<FastJets>
+      USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("CFS", c)));
+
       // Method definitions
       Cut cutlead = Cuts::pT > 5 * GeV && Cuts::pT < 100 * GeV;
       double etamax = 0.9 - RJETS_f;
 
       // Get jets of event
       Cut jetcuts = Cuts::pT > 20 * GeV && Cuts::abseta < etamax;
-      const Jets jets = apply<FastJets>(evt, "Jets").jetsByPt(jetcuts);
+      const FastJets& fj = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("Jets", c)));
+      const Jets jets = USPJWL_TIMED(_profile, "jetsByPt", fj.jetsByPt(jetcuts));
 
       for (const Jet& j : jets) {
+        USPJWL_TIME_SCOPE(_profile, "jet");
+
         // Jet properties
         double pt = j.pT(), phi = j.phi();
+
+        // Stored before the leading-track selection, which can be redone from leadpt
+        if (c == 0 && _jetstore.isOpen()) {
+          _jetstore.beginJet(evt.genEvent()->event_number(), evt.weights()[0], RJETS_f, j);
+          _jetstore.endJet();
+        }
 		
+        // Leading-track window at the USPJWL_SCAN points: some constituent lies inside it
+        uint64_t scan = 0;
+        if (_cuts.enabled()) {
+          for (const Particle& p : j.constituents()) scan |= _cuts.pass(_leadMin, p.pT() / GeV) & _cuts.pass(_leadMax, p.pT() / GeV);
+        }
+        USPJWL::CutScan::forEach(scan, [&](size_t p) { fillPlanes(hs._scan[p], phi, pt); });
+
 		    // Check leading particle respects selection cuts
-        Particles plead = j.constituents(cutlead);
+        Particles plead = USPJWL_TIMED(_profile, "leading track", j.constituents(cutlead));
         if (plead.size() == 0) continue;
+        fillPlanes(hs._planes, phi, pt);
+      }
+    }
+
+
+    // Fills the spectra of one leading-track selection
+    void fillPlanes(Planes& h, double phi, double pt) {
 	
 		    // Fill histograms
 		    // If not in-plane, check if it is in-plane considering out-of-plane angle
@@ -111,41 +220,53 @@ namespace Rivet {
 		    
 		    // n = 2	
 		    if (isInPlane(phi, PSI2, 2)) {
-		    	_hist_inplane2 -> fill(pt);
+		    	h._hist_inplane2 -> fill(pt);
 		    } else if (isInPlane(phi, PSI2 + M_PI / 2, 2)) {
-		    	_hist_outplane2 -> fill(pt);
+		    	h._hist_outplane2 -> fill(pt);
 		    }
 		    
 		    // n = 3	
 		    if (isInPlane(phi, PSI3, 3)) {
-		    	_hist_inplane3 -> fill(pt);
+		    	h._hist_inplane3 -> fill(pt);
 		    } else if (isInPlane(phi, PSI2 + M_PI / 3, 2)) {
-		    	_hist_outplane3 -> fill(pt);
+		    	h._hist_outplane3 -> fill(pt);
 		    }
 		    
 		    // n = 4	
 		    if (isInPlane(phi, PSI4, 4)) {
-		    	_hist_inplane4 -> fill(pt);
+		    	h._hist_inplane4 -> fill(pt);
 		    } else if (isInPlane(phi, PSI2 + M_PI / 4, 2)) {
-		    	_hist_outplane4 -> fill(pt);
+		    	h._hist_outplane4 -> fill(pt);
 		    }
 	
-		    _hist_allplane -> fill(pt);
-      }
+		    h._hist_allplane -> fill(pt);
     }
 
 
     void finalize() {
       // Scale only after yoda merge
+      _jetstore.close();
+      _runtime.finalize();
+      _profile.report(name());
+      USPJWL_ALLOC_REPORT(name(), analysisObjects());
     }
 
 
     /// @name Histograms
-    // R_AA
-    Histo1DPtr _hist_inplane2, _hist_outplane2, _hist_inplane3, _hist_outplane3, _hist_inplane4, _hist_outplane4, _hist_allplane;
+    std::vector<Histos> _sets;
+    USPJWL::Subtraction::Settings _subtraction;
+    USPJWL::Centrality::Classes _centrality;
+    USPJWL::CutScan::Grid _cuts;
+    size_t _leadMin, _leadMax;
+
+    Histo1DPtr _skimcount, _centcount;
+    USPJWL::Skim::Filter _skim;
+    USPJWL::Runtime _runtime;
+    USPJWL::Timing::Profile _profile;
 
     double RJETS_f, PSI2, PSI3, PSI4;
     std::string RJETS;
+    USPJWL::JetStore::Writer _jetstore;
 
     std::vector<double> PTEDGES = {20., 25., 35., 40., 50., 60., 80., 100., 120., 140., 200.};
   };
@@ -176,19 +297,12 @@ namespace Rivet {
   	// This is done by finding the minimum distance between phi
   	// and all symmentry angles of psi (mindist) and comparing to maximum
   	// distance of in-plane angle (maxinplanedist) 
-    std::vector<double> dists = {};
 
   	// Usually, maxinpladist for n = 2 is pi / 4. 
   	// ALICE used pi / 6 for a better contrast between in- and out-of-plane yields
   	// Thus a 2/3 factor is added in the generalized formula
-  	double maxinplanedist = (2. / 3.) * M_PI / (2 * n);
-  
-  	for (int i = 0; i < n - 1; i++) {
-        dists.push_back(angDistance(phi, psi + 2 * M_PI * i / n));
-  	}
-  
-  	double mindist = *std::min_element(std::begin(dists), std::end(dists));
-  	return mindist < maxinplanedist;
+  	// (see USPJWL_Kernels.hh, which stops at the first angle within it)
+  	return USPJWL::Kernels::inPlane(phi, psi, n);
   }
 
 }
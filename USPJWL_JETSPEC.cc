@@ -25,6 +25,17 @@
 #include "HepMC/GenParticle.h"
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_JetStore.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Arena.hh"
+#include "USPJWL_Kernels.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_CutScan.hh"
+#include "USPJWL_JetShape.hh"
 #include <string>
 
 namespace Rivet {
@@ -44,29 +55,41 @@ namespace Rivet {
     /// Constructor
     DEFAULT_RIVET_ANALYSIS_CTOR(USPJWL_JETSPEC);
 
-      // Necessary functions
 
-      int absrapRange(double jety) {
-        // Given a absrap, returns in which interval it belongs to (0 = out of bounds)
+    /// x_J and J_AA histograms of one dijet selection
+    struct Dijet {
+      // x_J
+      Histo1DPtr _xj_1, _xj_2, _xj_3, _xj_4, _xj_5, _xj_6, _xj_7, _xj_8, _xj_9,
+                 _xj_10, _xj_11, _xj_12, _xj_13, _xj_14, _xj_15, _xj_16, _xj_17,
+                 _xj_18;
 
-        // ATLAS absolute rapidity bin edges
-        std::vector<double> ABSRAPEDGES = {0., 0.3, 0.8, 1.2, 1.6, 2.1, 2.8};
+      // J_AA
+      Histo1DPtr _lead, _sublead, _counter;
+    };
 
-        int pos = 0;
-        for (double edge : ABSRAPEDGES) {
-          if (jety > edge) {
-            pos++;
-          }
+    /// Histograms of one subtraction setting
+    struct Histos {
+      // R_AA; 1-6 and 11 are filled, the inclusive 7-10 projected from them
+      Histo1DPtr _hist_1, _hist_2, _hist_3, _hist_4, _hist_5, _hist_6, _hist_7,
+                 _hist_8, _hist_9, _hist_10, _hist_11;
 
-          // Just need to check until fails
-          else {
-            return pos;
-          }
+      // Nominal dijet cuts, and one family per USPJWL_SCAN point
+      Dijet _dijet;
+      std::vector<Dijet> _scan;
 
-        }
+      // Jet shapes per jet pT class, and the jets of each class
+      std::vector<Histo1DPtr> _rho, _psi;
+      std::vector<CounterPtr> _shapecount;
+    };
 
-        // If absrap is larger than every edge => out of bounds
-        return 0;
+      // Necessary functions
+
+      int absrapRange(double jety) {
+        // Given a absrap, returns in which interval it belongs to (0 = out of bounds)
+
+        // ATLAS absolute rapidity bin edges
+        static const double ABSRAPEDGES[] = {0., 0.3, 0.8, 1.2, 1.6, 2.1, 2.8};
+        return USPJWL::Kernels::edgeRange(ABSRAPEDGES, jety);
       }
 
 
@@ -75,29 +98,18 @@ namespace Rivet {
         // Given a jetpT, returns in which interval it belongs to (0 = out of bounds)
 
         // ATLAS pT bins + super lower testing
-        std::vector<double> PTEDGES = {10., 30., 60., 90., 100., 112., 126., 141.,
-                                       158., 178., 200., 224., 251., 282., 316.,
-                                       398., 562., 630., 1000.};
-        int pos = 0;
-        for (double edge : PTEDGES) {
-          if (jetpT > edge) {
-            pos++;
-          }
-
-          // Just need to check until fails
-          else {
-            return pos;
-          }
-
-        }
-
-        // If pT is larger than every edge => out of bounds
-        return 0;
+        static const double PTEDGES[] = {10., 30., 60., 90., 100., 112., 126., 141.,
+                                         158., 178., 200., 224., 251., 282., 316.,
+                                         398., 562., 630., 1000.};
+        return USPJWL::Kernels::edgeRange(PTEDGES, jetpT);
       }
 
 
     void init() {
 
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), INIT);
+
 
       // Jet spectrum/RAA based on ATLAS arxiv:1805.05635 (hepdata: https://www.hepdata.net/record/ins1673184)
       // xJ based on ATLAS arXiv:2205.00682 (hepdata: missing?)      
@@ -109,257 +121,422 @@ namespace Rivet {
 
       Cut cut(Cuts::abseta < 3.2);
 
-      SubtractedJewelEvent sev(1.0);
-      SubtractedJewelFinalState fs(sev, cut);
-      declare(fs, "FS");
+      // Dijet cuts that USPJWL_SCAN can vary (see USPJWL_CutScan.hh)
+      _xjDphi = _cuts.add("xj_dphi", USPJWL::CutScan::ABOVE, 7 * M_PI / 8);
+      _xjEta = _cuts.add("xj_eta", USPJWL::CutScan::BELOW, 2.1);
+      _cuts.configure(name());
+
+      // Jet shapes in annuli of 0.02 out to the jet radius (see USPJWL_JetShape.hh)
+      _shape.configure(RJETS_f, size_t(std::lround(RJETS_f / 0.02)), SHAPE_PTEDGES);
+
+      // One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and
+      // one histogram set per setting and centrality class (see USPJWL_Runtime.hh)
+      _centrality.configure(name());
+      _subtraction.configure(name());
+      _sets.resize(_centrality.size() * _subtraction.size());
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        SubtractedJewelEvent sev(_subtraction.parameter(c));
+        SubtractedJewelFinalState fs(sev, cut);
+        declare(fs, _subtraction.name("FS", c));
+
+        // Apply FastJet
+        FastJets fj(fs, FastJets::ANTIKT, RJETS_f);
+        fj.useInvisibles();
+        declare(fj, _subtraction.name("Jets", c));
+
+        for (size_t k = 0; k < _centrality.size(); k++) {
+          bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+        }
+      }
+
+      // Events of each centrality class, for the per-class normalisation
+      if (_centrality.enabled()) {
+        book(_centcount, "Centrality_counter", _centrality.size(), -0.5, _centrality.size() - 0.5);
+      }
+      _runtime.route(_centrality, _subtraction.size(), _centcount);
+
+      // Events rejected (bin 0) and accepted (bin 1) by the pre-filter
+      _skim.configure(RJETS_f, 3.2, 20 * GeV);
+      book(_skimcount, "Skim_counter_R" + RJETS, 2, -0.5, 1.5);
+      _runtime.prefilter(_skim, _skimcount);
+
+      // Optional per-jet output for re-binning without rerunning (see USPJWL_JetStore.hh)
+      if (getenv("USPJWL_JETSTORE")) {
+        _jetstore.open(std::string(getenv("USPJWL_JETSTORE")) + "_" + name() + "_R" + RJETS + ".jets");
+      }
 
-      // Apply FastJet
-      FastJets fj(fs, FastJets::ANTIKT, RJETS_f);
-      fj.useInvisibles();
-      declare(fj, "Jets");
 
+      // Checkpointing and resume (see USPJWL_Runtime.hh)
+      _runtime.init(*this, analysisObjects());
+    }
 
 
-      // Book histograms
+    // Book histograms, tag is appended to every name
+    void bookSet(Histos& hs, const std::string& tag) {
 
       // For R_AA:
       // Name convention: _hist_[rapidity range index], except for inclusive
 
-      // absrap bins: 0–0.3, 0.3–0.8, 0.8–1.2, 1.2–1.6, 1.6–2.1, 2.1–2.8
+      // absrap bins: 0–0.3, 0.3–0.8, 0.8–1.2, 1.2–1.6, 1.6–2.1, 2.1–2.8,
+      // and above 2.8 (only for the inclusive spectrum)
       // inclusive: 0-2.1, 0-2.8
-      book(_hist_1,"JetpT_0_0.3_R" + RJETS, PTEDGES);
-      book(_hist_2,"JetpT_0.3_0.8_R" + RJETS, PTEDGES);
-      book(_hist_3,"JetpT_0.8_1.2_R" + RJETS, PTEDGES);
-      book(_hist_4,"JetpT_1.2_1.6_R" + RJETS, PTEDGES);
-      book(_hist_5,"JetpT_1.6_2.1_R" + RJETS, PTEDGES);
-      book(_hist_6,"JetpT_2.1_2.8_R" + RJETS, PTEDGES);
-      book(_hist_7,"JetpT_0_2.1_R" + RJETS, PTEDGES);
-      book(_hist_8,"JetpT_0_2.8_R" + RJETS, PTEDGES);
-      book(_hist_9,"JetpT_0_1.2_R" + RJETS, PTEDGES);
-      book(_hist_10,"JetpT_R" + RJETS, PTEDGES);
+      book(hs._hist_1,"JetpT_0_0.3_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_2,"JetpT_0.3_0.8_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_3,"JetpT_0.8_1.2_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_4,"JetpT_1.2_1.6_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_5,"JetpT_1.6_2.1_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_6,"JetpT_2.1_2.8_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_7,"JetpT_0_2.1_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_8,"JetpT_0_2.8_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_9,"JetpT_0_1.2_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_10,"JetpT_R" + RJETS + tag, PTEDGES);
+      book(hs._hist_11,"JetpT_2.8_inf_R" + RJETS + tag, PTEDGES);
+
+      // Every jet enters one exclusive rapidity class; the inclusive spectra
+      // are their sums, filled at finalize (see USPJWL_Master.hh)
+      std::vector<std::string> classes;
+      for (const char* y : {"0_0.3", "0.3_0.8", "0.8_1.2", "1.2_1.6", "1.6_2.1", "2.1_2.8", "2.8_inf"}) {
+        classes.push_back("JetpT_" + std::string(y) + "_R" + RJETS + tag);
+      }
+      _runtime.project("JetpT_0_1.2_R" + RJETS + tag, std::vector<std::string>(classes.begin(), classes.begin() + 3));
+      _runtime.project("JetpT_0_2.1_R" + RJETS + tag, std::vector<std::string>(classes.begin(), classes.begin() + 5));
+      _runtime.project("JetpT_0_2.8_R" + RJETS + tag, std::vector<std::string>(classes.begin(), classes.begin() + 6));
+      _runtime.project("JetpT_R" + RJETS + tag, classes);
+
+      // rho(r) and Psi(r) per jet pT class, |y| < 2.1
+      const std::vector<double> shape_edges = _shape.edges();
+      hs._rho.resize(_shape.classes());
+      hs._psi.resize(_shape.classes());
+      hs._shapecount.resize(_shape.classes());
+      for (size_t k = 0; k < _shape.classes(); k++) {
+        book(hs._rho[k],"JetShape_rho" + _shape.tag(k) + "_R" + RJETS + tag, shape_edges);
+        book(hs._psi[k],"JetShape_psi" + _shape.tag(k) + "_R" + RJETS + tag, shape_edges);
+        book(hs._shapecount[k],"JetShape_counter" + _shape.tag(k) + "_R" + RJETS + tag);
+      }
+
+      // For x_J and R_AA^Lead/Sublead, nominal and at the scan points
+      bookDijet(hs._dijet, tag);
+      hs._scan.resize(_cuts.size());
+      for (size_t p = 0; p < _cuts.size(); p++) bookDijet(hs._scan[p], tag + _cuts.tag(p));
+    }
+
 
+    void bookDijet(Dijet& d, const std::string& tag) {
       // For x_J:
       // Name convention: _xj_[pT range index]
 
       // leading jet pt binning is: 158-178, 178-200, 200-224, 224-251, 251-282,
       // 282-316, 316-398, 398-562, 562-700, 700-1000
       // LOW PT EDGES = {10., 30., 60., 90., 120., 158.}
-      book(_xj_1,"xJ_10_30_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_2,"xJ_30_60_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_3,"xJ_60_90_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_4,"xJ_90_100_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_5,"xJ_100_112_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_6,"xJ_112_126_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_7,"xJ_126_141_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_8,"xJ_141_158_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_9,"xJ_158_178_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_10,"xJ_178_200_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_11,"xJ_200_224_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_12,"xJ_224_251_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_13,"xJ_251_282_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_14,"xJ_282_316_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_15,"xJ_316_398_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_16,"xJ_398_562_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_17,"xJ_562_630_R" + RJETS, 20, 0.32, 1.0);
-      book(_xj_18,"xJ_630_1000_R" + RJETS, 20, 0.32, 1.0);
+      book(d._xj_1,"xJ_10_30_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_2,"xJ_30_60_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_3,"xJ_60_90_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_4,"xJ_90_100_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_5,"xJ_100_112_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_6,"xJ_112_126_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_7,"xJ_126_141_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_8,"xJ_141_158_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_9,"xJ_158_178_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_10,"xJ_178_200_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_11,"xJ_200_224_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_12,"xJ_224_251_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_13,"xJ_251_282_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_14,"xJ_282_316_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_15,"xJ_316_398_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_16,"xJ_398_562_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_17,"xJ_562_630_R" + RJETS + tag, 20, 0.32, 1.0);
+      book(d._xj_18,"xJ_630_1000_R" + RJETS + tag, 20, 0.32, 1.0);
 
       // For R_AA^Lead and R_AA^Sublead
-      book(_lead,"JetpT1_R" + RJETS, PTEDGES_J);
-      book(_sublead,"JetpT2_R" + RJETS, PTEDGES_J);
-      book(_counter,"xJ_counter_R" + RJETS, 2., -0.5, 1.5);
-
-
+      book(d._lead,"JetpT1_R" + RJETS + tag, PTEDGES_J);
+      book(d._sublead,"JetpT2_R" + RJETS + tag, PTEDGES_J);
+      book(d._counter,"xJ_counter_R" + RJETS + tag, 2., -0.5, 1.5);
     }
 
 
     /// Perform the per-event analysis
     void analyze(const Event& evt) {
 
+      // Timers, resumed events, centrality class and pre-filter (see USPJWL_Runtime.hh)
+      USPJWL::Runtime::Event event(_runtime, evt, _profile);
+      if (event.set() < 0) vetoEvent;
+
+      // Per-event scratch memory, released when the event is done
+      USPJWL::Arena::EventScope scratch(_arena);
+
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        analyzeSetting(evt, c, _sets[event.set() + c]);
+      }
+    }
+
+
+    // Observables of subtraction setting c, filled into hs
+    void analyzeSetting(const Event& evt, size_t c, Histos& hs) {
+      // Charged to its own stage instead of the first apply<FastJets>
+      USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("FS", c)));
+
       // Get jets of event
       double etamax = 3.2 - RJETS_f;
       Cut jetcuts = Cuts::pT > 20 * GeV && Cuts::abseta < etamax;
 
-      const Jets& jets = apply<FastJets>(evt, "Jets").jetsByPt(jetcuts);
+      const FastJets& fj = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("Jets", c)));
+      const Jets& jets = USPJWL_TIMED(_profile, "jetsByPt", fj.jetsByPt(jetcuts));
  
       // CALCULATE JET PT FOR RAA
       for (const Jet& j : jets) {
+        USPJWL_TIME_SCOPE(_profile, "RAA jet");
+
         // Jet properties
         double y = j.absrap(), pt = j.pT();
 
-        // Fill the right histograms for each pT range
-        switch (absrapRange(y)) {
+        // Fill the right histograms for each pT range; y = 0 is the first class,
+        // as for the inclusive spectra
+        switch (y == 0 ? 1 : absrapRange(y)) {
           case 1:
-            _hist_1 -> fill(pt);
+            hs._hist_1 -> fill(pt);
             break;
 
           case 2:
-            _hist_2 -> fill(pt);
+            hs._hist_2 -> fill(pt);
             break;
 
           case 3:
-            _hist_3 -> fill(pt);
+            hs._hist_3 -> fill(pt);
             break;
 
           case 4:
-            _hist_4 -> fill(pt);
+            hs._hist_4 -> fill(pt);
             break;
 
           case 5:
-            _hist_5 -> fill(pt);
+            hs._hist_5 -> fill(pt);
             break;
 
           case 6:
-            _hist_6 -> fill(pt);
+            hs._hist_6 -> fill(pt);
             break;
 
-          // If something weird happens, signalize and ignore from analysis
+          // Above 2.8, only in the inclusive spectrum
           default:
             //std::cout << "|y| out of bounds: " << y << std::endl;
+            hs._hist_11 -> fill(pt);
             break;
         }
+      }
 
-        // Fill inclusive histograms
-        if (y <= 2.1) {
-          _hist_7 -> fill(pt);
-        }
-
-        if (y <= 2.8) {
-          _hist_8 -> fill(pt);
-        }
-
-        if (y <= 1.2) {
-          _hist_9 -> fill(pt);
-        }
-
-        _hist_10 -> fill(pt);
 
+      // JET SHAPES: one pass over the constituents of each jet
+      for (const Jet& j : jets) {
+        if (j.absrap() >= 2.1) continue;
+        const int k = _shape.classify(j.pT());
+        if (k < 0) continue;
+        USPJWL_TIME_SCOPE(_profile, "jet shape");
+        _shape.measure(j.rap(), j.phi(), j.constituents());
+        _shape.fill(hs._rho[k], hs._psi[k], j.pT());
+        hs._shapecount[k] -> fill();
       }
 
 
       // CALCULATE JET PT LEADING AND SUBLEADING FOR XJ
       // Apply new cuts (with selectors) before sorting -> no need anymore, as jets are Jets not PseudoJets (new subtraction method)
       
-      Cut xjcuts = Cuts::abseta < 2.1 && Cuts::pT > 20 * GeV;
-      vector<Jet> sorted_jets = select(jets, xjcuts);
+      // |eta| < 2.1 and pT > 20 GeV, keeping the pT ordering (pointers, no Jet copies)
+      USPJWL::ScratchVector<const Jet*> sorted_jets(_arena);
+      sorted_jets.reserve(jets.size());
+      for (const Jet& j : jets) {
+        if (j.abseta() < 2.1 && j.pT() > 20 * GeV) sorted_jets.push_back(&j);
+      }
 
       if (sorted_jets.size() >= 2) { // Need at least two jets
-        double pTLead = sorted_jets[0].pt(), pTSubLead = sorted_jets[1].pt();
-        double Dphi = deltaPhi(sorted_jets[0].phi(), sorted_jets[1].phi());
+        USPJWL_TIME_SCOPE(_profile, "xJ");
+        double pTLead = sorted_jets[0]->pt(), pTSubLead = sorted_jets[1]->pt();
+        double Dphi = deltaPhi(sorted_jets[0]->phi(), sorted_jets[1]->phi());
 
 
         // Two conditions must be satisfied: both |eta| < 2.1 and Dphi > 7pi / 8
         // We add pTSubLead > 20 GeV to eliminate weird events
-        if (Dphi > 7 * M_PI / 8) {
-          // Add to the counter if the event pass the criteria
-          _counter -> fill(1.);
-          _lead -> fill(pTLead);
-          _sublead -> fill(pTSubLead);
+        fillDijet(hs._dijet, pTLead, pTSubLead, Dphi > 7 * M_PI / 8);
+      }
+
+      if (_cuts.enabled()) scanDijets(jets, hs);
+
+
+      // Per-jet output, the leading and subleading jets of the x_J selection
+      // are each other's dijet partner (nominal subtraction only)
+      if (c == 0 && _jetstore.isOpen()) {
+        USPJWL_TIME_SCOPE(_profile, "jet store");
+        int ilead = -1, isublead = -1;
+        for (size_t i = 0; i < jets.size() && isublead < 0; i++) {
+          if (jets[i].abseta() < 2.1) {
+            if (ilead < 0) ilead = i;
+            else isublead = i;
+          }
+        }
+
+        for (size_t i = 0; i < jets.size(); i++) {
+          _jetstore.beginJet(evt.genEvent()->event_number(), evt.weights()[0], RJETS_f, jets[i]);
+          int ipartner = int(i) == ilead ? isublead : (int(i) == isublead ? ilead : -1);
+          if (ipartner >= 0) {
+            _jetstore.set(USPJWL::JetStore::PARTNER_PT, jets[ipartner].pT());
+            _jetstore.set(USPJWL::JetStore::PARTNER_DPHI, deltaPhi(jets[i].phi(), jets[ipartner].phi()));
+          }
+          _jetstore.endJet();
+        }
+      }
+    }
+
 
-          double xj = pTSubLead / pTLead;
+    // Fills one dijet selection; back: the pair passed the Dphi cut
+    void fillDijet(Dijet& d, double pTLead, double pTSubLead, bool back) {
+      if (back) {
+        // Add to the counter if the event pass the criteria
+        d._counter -> fill(1.);
+        d._lead -> fill(pTLead);
+        d._sublead -> fill(pTSubLead);
 
+        double xj = pTSubLead / pTLead;
 
-          switch (pTRange(pTLead)) {
-            case 1:
-              _xj_1 -> fill(xj);
-              break;
 
-            case 2:
-              _xj_2 -> fill(xj);
-              break;
+        switch (pTRange(pTLead)) {
+          case 1:
+            d._xj_1 -> fill(xj);
+            break;
 
-            case 3:
-              _xj_3 -> fill(xj);
-              break;
+          case 2:
+            d._xj_2 -> fill(xj);
+            break;
 
-            case 4:
-              _xj_4 -> fill(xj);
-              break;
+          case 3:
+            d._xj_3 -> fill(xj);
+            break;
 
-            case 5:
-              _xj_5 -> fill(xj);
-              break;
+          case 4:
+            d._xj_4 -> fill(xj);
+            break;
+
+          case 5:
+            d._xj_5 -> fill(xj);
+            break;
 
-            case 6:
-              _xj_6 -> fill(xj);
-              break;
+          case 6:
+            d._xj_6 -> fill(xj);
+            break;
 
-            case 7:
-              _xj_7 -> fill(xj);
-              break;
+          case 7:
+            d._xj_7 -> fill(xj);
+            break;
 
-            case 8:
-              _xj_8 -> fill(xj);
-              break;
+          case 8:
+            d._xj_8 -> fill(xj);
+            break;
 
-            case 9:
-              _xj_9 -> fill(xj);
-              break;
+          case 9:
+            d._xj_9 -> fill(xj);
+            break;
 
-            case 10:
-              _xj_10 -> fill(xj);
-              break;
+          case 10:
+            d._xj_10 -> fill(xj);
+            break;
 
-            case 11:
-              _xj_11 -> fill(xj);
-              break;
+          case 11:
+            d._xj_11 -> fill(xj);
+            break;
 
-            case 12:
-              _xj_12 -> fill(xj);
-              break;
+          case 12:
+            d._xj_12 -> fill(xj);
+            break;
 
-            case 13:
-              _xj_13 -> fill(xj);
-              break;
+          case 13:
+            d._xj_13 -> fill(xj);
+            break;
 
-            case 14:
-              _xj_14 -> fill(xj);
-              break;
+          case 14:
+            d._xj_14 -> fill(xj);
+            break;
 
-            case 15:
-              _xj_15 -> fill(xj);
-              break;
+          case 15:
+            d._xj_15 -> fill(xj);
+            break;
 
-            case 16:
-              _xj_16 -> fill(xj);
-              break;
+          case 16:
+            d._xj_16 -> fill(xj);
+            break;
 
-            case 17:
-              _xj_17 -> fill(xj);
-              break;
+          case 17:
+            d._xj_17 -> fill(xj);
+            break;
 
-            case 18:
-              _xj_18 -> fill(xj);
-              break;
+          case 18:
+            d._xj_18 -> fill(xj);
+            break;
 
-            default:
-              break;
-          }
+          default:
+            break;
         }
+      }
 
-        else {
-          _counter -> fill(0.);
-        }
+      else {
+        d._counter -> fill(0.);
+      }
+    }
+
+
+    // The dijet selection at every USPJWL_SCAN point: the leading two jets
+    // within the |eta| cut of the point, then its Dphi cut. Points that end
+    // up with the same jet pair share its Dphi.
+    void scanDijets(const Jets& jets, Histos& hs) {
+      USPJWL_TIME_SCOPE(_profile, "xJ scan");
+      const uint64_t all = _cuts.all();
+      uint64_t haveLead = 0, haveSub = 0;
+      size_t lead[USPJWL::CutScan::MAXPOINTS], sub[USPJWL::CutScan::MAXPOINTS];
+      for (size_t i = 0; i < jets.size() && haveSub != all; i++) {
+        if (!(jets[i].pT() > 20 * GeV)) continue;
+        const uint64_t in = _cuts.pass(_xjEta, jets[i].abseta());
+        const uint64_t first = in & ~haveLead, second = in & haveLead & ~haveSub;
+        USPJWL::CutScan::forEach(first, [&](size_t p) { lead[p] = i; });
+        USPJWL::CutScan::forEach(second, [&](size_t p) { sub[p] = i; });
+        haveLead |= first;
+        haveSub |= second;
+      }
+
+      uint64_t todo = haveSub;
+      while (todo) {
+        const size_t p0 = __builtin_ctzll(todo);
+        uint64_t pair = 0;
+        USPJWL::CutScan::forEach(todo, [&](size_t p) {
+          if (lead[p] == lead[p0] && sub[p] == sub[p0]) pair |= uint64_t(1) << p;
+        });
+        todo &= ~pair;
+        const Jet& j1 = jets[lead[p0]];
+        const Jet& j2 = jets[sub[p0]];
+        const uint64_t back = _cuts.pass(_xjDphi, deltaPhi(j1.phi(), j2.phi()));
+        USPJWL::CutScan::forEach(pair, [&](size_t p) { fillDijet(hs._scan[p], j1.pt(), j2.pt(), (back >> p) & 1); });
       }
     }
 
 
     void finalize() {
       // Scale only after yoda merge
+      _jetstore.close();
+      _runtime.finalize();
+      _profile.report(name());
+      USPJWL_ALLOC_REPORT(name(), analysisObjects());
     }
 
 
     /// @name Histograms
-    // R_AA
-    Histo1DPtr _hist_1, _hist_2, _hist_3, _hist_4, _hist_5, _hist_6, _hist_7,
-               _hist_8, _hist_9, _hist_10;
+    std::vector<Histos> _sets;
+    USPJWL::Subtraction::Settings _subtraction;
+    USPJWL::Centrality::Classes _centrality;
+    USPJWL::CutScan::Grid _cuts;
+    size_t _xjDphi, _xjEta;
 
-    // x_J
-    Histo1DPtr _xj_1, _xj_2, _xj_3, _xj_4, _xj_5, _xj_6, _xj_7, _xj_8, _xj_9,
-               _xj_10, _xj_11, _xj_12, _xj_13, _xj_14, _xj_15, _xj_16, _xj_17,
-               _xj_18;
-
-    // J_AA
-    Histo1DPtr _lead, _sublead, _counter;
+    Histo1DPtr _skimcount, _centcount;
+    USPJWL::Skim::Filter _skim;
+    USPJWL::Runtime _runtime;
+    USPJWL::Timing::Profile _profile;
+    USPJWL::Arena _arena;
+    USPJWL::JetShape::Profile _shape;
 
 
     double RJETS_f;
@@ -368,9 +545,14 @@ namespace Rivet {
                                    125, 141, 158, 177, 199, 223, 251, 281,
                                    316, 354, 398, 501, 630, 1000};
 
+    USPJWL::JetStore::Writer _jetstore;
+
     std::vector<double> PTEDGES_J = {100, 112, 126, 141, 158, 178, 200, 224,
                                      251, 282, 316, 398, 562, 630, 1000};
 
+    // Jet pT classes of the jet shapes
+    std::vector<double> SHAPE_PTEDGES = {30, 60, 100, 150, 200, 300, 1000};
+
     
 
   };
@@ -16,6 +16,16 @@
 #include "HepMC/GenParticle.h"
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_JetStore.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Kernels.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_SoftDrop.hh"
+#include "USPJWL_JetShape.hh"
 
 //Not sure if I must include these yet, probably not since Rivet already does it
 #include "fstream"
@@ -57,8 +67,27 @@ namespace Rivet {
 
                   
 
+                  //! Soft Drop histograms of one grooming setting
+                  struct Groomed{
+                        Histo1DPtr _hs_mass[13];
+                        Histo1DPtr _h_zg, _h_rg, _h_nsd;
+                  };
+
+                  //! Histograms of one subtraction setting
+                  struct Histos{
+                        Histo1DPtr _hs_mass[13];
+                        Histo1DPtr _h_JetpT_NSub_04;
+                        std::vector<Groomed> _sd;
+                        //! Jet shapes per jet pT class, and the jets of each class
+                        std::vector<Histo1DPtr> _hs_rho, _hs_psi;
+                        std::vector<CounterPtr> _h_shapecount;
+                  };
+
                   void init() {
 
+                        //!Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+                        USPJWL_ALLOC_SCOPE(name(), INIT);
+
                         
                         //! verbosity flag
                         verbose = false;
@@ -98,55 +127,127 @@ namespace Rivet {
                         Cut cut(Cuts::abseta<0.9);
                         //Cut cut(Cuts::pt>0.300*GeV && Cuts::abseta<4.5);
                         
-                        SubtractedJewelEvent sev(1.0);
-                        SubtractedJewelFinalState fs(sev, cut);
+                        //! One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and
+                        //! one histogram set per setting and centrality class (see USPJWL_Runtime.hh)
+                        _centrality.configure(name());
+                        _subtraction.configure(name());
+                        _softdrop.configure(name());
+                        //! Jet shapes in annuli of 0.02 (see USPJWL_JetShape.hh)
+                        _shape.configure(_jetR, 20, _shapeedges);
+                        _sets.resize(_centrality.size() * _subtraction.size());
+                        for(size_t c = 0; c < _subtraction.size(); ++c){
+                              SubtractedJewelEvent sev(_subtraction.parameter(c));
+                              SubtractedJewelFinalState fs(sev, cut);
+
+                              //const FinalState fs(cut);
+                              declare(fs, _subtraction.name("FS", c));
+
+                              //Final State Particles with pseudo-rapidity cuts
+                              //ALICE <0.9
+                              //ATLAS <2.something
+                              const ChargedFinalState cfs(fs);
+                              declare(cfs, _subtraction.name("CFS", c));
+
+                              //Aplying Fast-Jet algorithms
+                              //Anti-kt Algorithm R=0.4
+                              FastJets ak_04(fs, FastJets::ANTIKT, 0.4);
+                              ak_04.useInvisibles();
+                              declare(ak_04, _subtraction.name("AntiKt_04", c));
+
+                              for(size_t k = 0; k < _centrality.size(); ++k){
+                                    bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+                              }
+                        }
 
-                        //const FinalState fs(cut);
-                        declare(fs, "FS");
+                        //! Events of each centrality class, for the per-class normalisation
+                        if(_centrality.enabled()){
+                              book(_centcount,"Centrality_counter",_centrality.size(),-0.5,_centrality.size()-0.5);
+                        }
+                        _runtime.route(_centrality, _subtraction.size(), _centcount);
 
-                        //Final State Particles with pseudo-rapidity cuts
-                        //ALICE <0.9
-                        //ATLAS <2.something
-                        Cut ChargedCut(Cuts::abseta<0.9);
-                        const ChargedFinalState cfs(fs);
-                        declare(cfs, "CFS");
+                        //! Events rejected (bin 0) and accepted (bin 1) by the pre-filter,
+                        //! no histogram takes jets below 20 GeV
+                        _skim.configure(_jetR, _etaMax, 20.0*GeV);
+                        book(_skimcount,"Skim_counter",2,-0.5,1.5);
+                        _runtime.prefilter(_skim, _skimcount);
 
-                        //Aplying Fast-Jet algorithms
-                        //Anti-kt Algorithm R=0.4
-                        FastJets ak_04(fs, FastJets::ANTIKT, 0.4);
-                        ak_04.useInvisibles();
-                        declare(ak_04, "AntiKt_04");
+                        //! Checkpointing and resume (see USPJWL_Runtime.hh)
+                        _runtime.init(*this, analysisObjects());
 
+                        //! Optional per-jet output for re-binning without rerunning (see USPJWL_JetStore.hh)
+                        if(getenv("USPJWL_JETSTORE")){
+                              _jetstore.open(std::string(getenv("USPJWL_JETSTORE")) + "_" + name() + "_R0.4.jets");
+                        }
+                       
 
                         
-                        vector<double> mass_edges=linspace(200,0.0,100.0);
-                        book(_hs_mass[0],"Jet_Mass_60_80",mass_edges);
-                        book(_hs_mass[1],"Jet_Mass_80_100",mass_edges);
-                        book(_hs_mass[2],"Jet_Mass_100_120",mass_edges);
-                        book(_hs_mass[3],"Jet_Mass_120_140",mass_edges);
-                        book(_hs_mass[4],"Jet_Mass_140_160",mass_edges);
-                        book(_hs_mass[5],"Jet_Mass_160_180",mass_edges);
-                        book(_hs_mass[6],"Jet_Mass_180_200",mass_edges);
-                        book(_hs_mass[7],"Jet_Mass_200_220",mass_edges);
-                        book(_hs_mass[8],"Jet_Mass_220_240",mass_edges);
-                        book(_hs_mass[9],"Jet_Mass_240_260",mass_edges);
-                        book(_hs_mass[10],"Jet_Mass_260_280",mass_edges);
-                        book(_hs_mass[11],"Jet_Mass_280_300",mass_edges);
-                        book(_hs_mass[12],"Jet_Mass_300",mass_edges);
-
+                  }
 
+                  //! Book histograms, tag is appended to every name
+                  void bookSet(Histos& hs, const std::string& tag){
+                        vector<double> mass_edges=linspace(200,0.0,100.0);
+                        book(hs._hs_mass[0],"Jet_Mass_60_80" + tag,mass_edges);
+                        book(hs._hs_mass[1],"Jet_Mass_80_100" + tag,mass_edges);
+                        book(hs._hs_mass[2],"Jet_Mass_100_120" + tag,mass_edges);
+                        book(hs._hs_mass[3],"Jet_Mass_120_140" + tag,mass_edges);
+                        book(hs._hs_mass[4],"Jet_Mass_140_160" + tag,mass_edges);
+                        book(hs._hs_mass[5],"Jet_Mass_160_180" + tag,mass_edges);
+                        book(hs._hs_mass[6],"Jet_Mass_180_200" + tag,mass_edges);
+                        book(hs._hs_mass[7],"Jet_Mass_200_220" + tag,mass_edges);
+                        book(hs._hs_mass[8],"Jet_Mass_220_240" + tag,mass_edges);
+                        book(hs._hs_mass[9],"Jet_Mass_240_260" + tag,mass_edges);
+                        book(hs._hs_mass[10],"Jet_Mass_260_280" + tag,mass_edges);
+                        book(hs._hs_mass[11],"Jet_Mass_280_300" + tag,mass_edges);
+                        book(hs._hs_mass[12],"Jet_Mass_300" + tag,mass_edges);
 
                         vector<double> pt_edges=linspace(50,20.0,520.0);
+                        book(hs._h_JetpT_NSub_04,"JetpT_NSub_04" + tag,pt_edges);
+
+                        //! Groomed mass in the same pT slices, z_g, R_g and n_SD of the jets
+                        //! above 60 GeV, per Soft Drop setting (see USPJWL_SoftDrop.hh)
+                        static const char* MASS_SLICE_NAMES[13] = {"60_80", "80_100", "100_120", "120_140", "140_160",
+                                                                   "160_180", "180_200", "200_220", "220_240", "240_260",
+                                                                   "260_280", "280_300", "300"};
+                        hs._sd.resize(_softdrop.size());
+                        for(size_t i = 0; i < _softdrop.size(); ++i){
+                              const std::string sd = _softdrop.tag(i) + tag;
+                              for(int k = 0; k < 13; ++k){
+                                    book(hs._sd[i]._hs_mass[k],"Jet_Mass_" + std::string(MASS_SLICE_NAMES[k]) + sd,mass_edges);
+                              }
+                              book(hs._sd[i]._h_zg,"Jet_zg" + sd,20,0.0,0.5);
+                              book(hs._sd[i]._h_rg,"Jet_Rg" + sd,20,0.0,_jetR);
+                              book(hs._sd[i]._h_nsd,"Jet_nSD" + sd,15,-0.5,14.5);
+                        }
 
-                        book(_h_JetpT_NSub_04,"JetpT_NSub_04",pt_edges);
-                       
-
-                        
+                        //! rho(r) and Psi(r) of the same jets per jet pT class
+                        const vector<double> shape_edges = _shape.edges();
+                        hs._hs_rho.resize(_shape.classes());
+                        hs._hs_psi.resize(_shape.classes());
+                        hs._h_shapecount.resize(_shape.classes());
+                        for(size_t k = 0; k < _shape.classes(); ++k){
+                              book(hs._hs_rho[k],"JetShape_rho" + _shape.tag(k) + tag,shape_edges);
+                              book(hs._hs_psi[k],"JetShape_psi" + _shape.tag(k) + tag,shape_edges);
+                              book(hs._h_shapecount[k],"JetShape_counter" + _shape.tag(k) + tag);
+                        }
                   }
 
                   /// Perform the per-evt analysis
                   void analyze(const Event& evt){
 
+                        //! Timers, resumed events, centrality class and pre-filter (see USPJWL_Runtime.hh)
+                        USPJWL::Runtime::Event event(_runtime, evt, _profile);
+                        if(event.set() < 0) vetoEvent;
+
+                        for(size_t c = 0; c < _subtraction.size(); ++c){
+                              analyzeSetting(evt, c, _sets[event.set() + c]);
+                        }
+                  }
+
+                  //! Observables of subtraction setting c, filled into hs
+                  void analyzeSetting(const Event& evt, size_t c, Histos& hs){
+                        //!Charged to its own stage instead of the first apply<FastJets>
+                        USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("FS", c)));
+
 
                         //Here I create my array of jetsets to ensure I have
                         //fewer variable names, this array contains both
@@ -164,8 +265,8 @@ namespace Rivet {
                         if(verbose) std::cout<<"Jet Collection built without subtraction"<<std::endl;
                         Cut cuts = (Cuts::abseta < _etaMax) & (Cuts::pT > _pTCut*GeV);
 
-                        const FastJets& AJets_04 = apply<FastJets>(evt, "AntiKt_04");
-                        const Jets jets_noSub_04 = AJets_04.jetsByPt(cuts);
+                        const FastJets& AJets_04 = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("AntiKt_04", c)));
+                        const Jets jets_noSub_04 = USPJWL_TIMED(_profile, "jetsByPt", AJets_04.jetsByPt(cuts));
 
 
                         //! **************************************
@@ -175,8 +276,15 @@ namespace Rivet {
                         //PseudoJets jets_4MomSub_04 = do4MomSub(jets_noSub_04, pscat, doSubtraction);
                         //jetAr[1] = jets_4MomSub_04;  
                         for(const Jet& jet: jets_noSub_04) {
+                              USPJWL_TIME_SCOPE(_profile, "jet pT");
                               if(jet.abseta()<0.5 && jet.pt()>20.0){
-                                    _h_JetpT_NSub_04->fill(jet.pt());
+                                    hs._h_JetpT_NSub_04->fill(jet.pt());
+
+                                    //! Only jets entering some histogram are stored
+                                    if(c == 0 && _jetstore.isOpen()){
+                                          _jetstore.beginJet(evt.genEvent()->event_number(), evt.weights()[0], _jetR, jet);
+                                          _jetstore.endJet();
+                                    }
                               }
                         }
 
@@ -186,58 +294,57 @@ namespace Rivet {
 
                         //Jet mass analysis here for jets with R=0.4
                         //using 4MomSub method
+                        //! Lower pT edges of the _hs_mass slices
+                        static const double MASS_PT_SLICES[13] = {60.0, 80.0, 100.0, 120.0, 140.0, 160.0, 180.0,
+                                                                  200.0, 220.0, 240.0, 260.0, 280.0, 300.0};
                         for(const Jet& jet: jets_noSub_04){
+                              USPJWL_TIME_SCOPE(_profile, "jet mass");
                               // The leading jet
                               //const PseudoJet& jet = jetAr[alg][0];
                               const double m   = jet.mass();
                               const double eta = jet.eta();
                               const double pt  = jet.pt();
 
-                              if(m>=0 && abs(eta)<(_etaMax-_jetR)){
-                                    if(60.0 <= pt && pt < 80.0){
-                                          _hs_mass[0]->fill(m/GeV);
-                                    }
-                                    if(80.0 <= pt && pt < 100.0){
-                                          _hs_mass[1]->fill(m/GeV);
-                                    }
-                                    if(100.0 <= pt && pt < 120.0){
-                                          _hs_mass[2]->fill(m/GeV);
-                                    }
-                                    if(120.0 <= pt && pt < 140.0){
-                                          _hs_mass[3]->fill(m/GeV);
-                                    }
-                                    if(140.0 <= pt && pt < 160.0){
-                                          _hs_mass[4]->fill(m/GeV);
-                                    }
-                                    if(160.0 <= pt && pt < 180.0){
-                                          _hs_mass[5]->fill(m/GeV);
-                                    }
-                                    if(180.0 <= pt && pt < 200.0){
-                                          _hs_mass[6]->fill(m/GeV);
-                                    }
-                                    if(200.0 <= pt && pt < 220.0){
-                                          _hs_mass[7]->fill(m/GeV);
-                                    }
-                                    if(220.0 <= pt && pt < 240.0){
-                                          _hs_mass[8]->fill(m/GeV);
-                                    }
-                                    if(240.0 <= pt && pt < 260.0){
-                                          _hs_mass[9]->fill(m/GeV);
-                                    }
-                                    if(260.0 <= pt && pt < 280.0){
-                                          _hs_mass[10]->fill(m/GeV);
-                                    }
-                                    if(280.0 <= pt && pt < 300.0){
-                                          _hs_mass[11]->fill(m/GeV);
-                                    }
-                                    if(300.0 <= pt){
-                                          _hs_mass[12]->fill(m/GeV);
+                              if(abs(eta)>=(_etaMax-_jetR)) continue;
+                              //! The last slice is open above (see USPJWL_Kernels.hh)
+                              const int slice = USPJWL::Kernels::slice(MASS_PT_SLICES, pt);
+                              if(slice < 0) continue;
+                              if(m>=0){
+                                    hs._hs_mass[slice]->fill(m/GeV);
+                              }
+
+                              //! Jet shape from one pass over the constituents
+                              const int shape = _shape.classify(pt);
+                              if(shape >= 0){
+                                    USPJWL_TIME_SCOPE(_profile, "jet shape");
+                                    _shape.measure(jet.rap(), jet.phi(), jet.constituents());
+                                    _shape.fill(hs._hs_rho[shape], hs._hs_psi[shape], pt);
+                                    hs._h_shapecount[shape]->fill();
+                              }
+
+                              //! One C/A reclustering per jet serves every Soft Drop setting;
+                              //! jets without a tagged splitting go to the z_g and R_g underflow
+                              USPJWL_TIME_SCOPE(_profile, "soft drop");
+                              _sdconstituents.clear();
+                              for(const Particle& p : jet.constituents()) _sdconstituents.push_back(p.pseudojet());
+                              _sdtree.build(_sdconstituents);
+                              for(size_t i = 0; i < _softdrop.size(); ++i){
+                                    const USPJWL::SoftDrop::Result sd = _sdtree.groom(_softdrop[i], _jetR);
+                                    if(sd.mass>=0){
+                                          hs._sd[i]._hs_mass[slice]->fill(sd.mass/GeV);
                                     }
+                                    hs._sd[i]._h_zg->fill(sd.zg);
+                                    hs._sd[i]._h_rg->fill(sd.rg);
+                                    hs._sd[i]._h_nsd->fill(sd.nsd);
                               }
                         }
                   }                  
 
                   void finalize(){
+                        _jetstore.close();
+                        _runtime.finalize();
+                        _profile.report(name());
+                        USPJWL_ALLOC_REPORT(name(), analysisObjects());
                         //std::cout << _h_NinPlane->sumW() << std::endl;
                         //std::cout << _h_Nout->sumW() << std::endl;
                   }
@@ -268,9 +375,23 @@ namespace Rivet {
 
                   
 
-                  Histo1DPtr _hs_mass[13];
-
-                  Histo1DPtr _h_JetpT_NSub_04;
+                  std::vector<Histos> _sets;
+                  USPJWL::Subtraction::Settings _subtraction;
+                  USPJWL::Centrality::Classes _centrality;
+                  USPJWL::SoftDrop::Settings _softdrop;
+                  USPJWL::SoftDrop::Tree _sdtree;
+                  //! Constituents handed to _sdtree, storage kept across jets
+                  PseudoJets _sdconstituents;
+                  USPJWL::JetShape::Profile _shape;
+                  //! Jet pT classes of the jet shapes
+                  vector<double> _shapeedges = {60.0, 100.0, 140.0, 200.0, 300.0, 1000.0};
+
+                  Histo1DPtr _skimcount, _centcount;
+                  USPJWL::Skim::Filter _skim;
+                  USPJWL::Runtime _runtime;
+                  USPJWL::Timing::Profile _profile;
+
+                  USPJWL::JetStore::Writer _jetstore;
 
                   
 
@@ -0,0 +1,117 @@
+// -*- C++ -*-
+
+// Jet radial profiles from one pass over the constituents of each jet.
+//
+// The differential jet shape rho(r) and the integrated one Psi(r) are
+// measured in annuli of equal width dr around the jet axis, out to the
+// jet radius R:
+//   rho(r) = 1/dr 1/N_jet sum_jets pT(r - dr/2, r + dr/2) / pT_jet
+//   Psi(r) = 1/N_jet sum_jets pT(0, r) / pT(0, R)
+// Profile::measure() computes the distance of each constituent to the
+// axis once, finds its annulus by one multiplication (the annuli are
+// uniform, so no search and no sorting) and adds its pT to a contiguous
+// array of annulus sums; Psi is the running sum of that array. Rivet's
+// JetShape projection would rescan the particles for every radius.
+//
+// The analyses fill, per jet pT class, rho_hist with pT(annulus) / pT_jet
+// at each annulus and psi_hist with Psi at the upper edge of each annulus
+// (in the bin of that annulus), and count the jets of each class. Every
+// counted jet is filled into both: a jet without constituent pT inside R
+// (possible after subtraction) has Psi = 0 at every r, so that rho and Psi
+// share the N_jet of the counter. The 1/dr and 1/N_jet factors are applied
+// after the merge.
+
+#ifndef USPJWL_JETSHAPE_HH
+#define USPJWL_JETSHAPE_HH
+
+#include "USPJWL_Kernels.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace JetShape {
+
+    class Profile {
+    public:
+
+      // n annuli out to radius, for jets in the pT classes between ptEdges
+      void configure(double radius, size_t n, const std::vector<double>& ptEdges) {
+        _radius = radius;
+        _ptEdges = ptEdges;
+        _sums.assign(n, 0.);
+        _inv = n / radius;
+      }
+
+      size_t annuli() const { return _sums.size(); }
+      size_t classes() const { return _ptEdges.size() - 1; }
+
+      // Annulus edges, for booking
+      std::vector<double> edges() const {
+        std::vector<double> e(annuli() + 1);
+        for (size_t i = 0; i <= annuli(); i++) e[i] = i * _radius / annuli();
+        return e;
+      }
+
+      double center(size_t i) const { return (i + 0.5) * _radius / annuli(); }
+
+      // Histogram name suffix of pT class k
+      std::string tag(size_t k) const {
+        std::ostringstream s;
+        s << "_" << _ptEdges[k] << "_" << _ptEdges[k + 1];
+        return s.str();
+      }
+
+      // pT class of a jet, -1 outside every class
+      int classify(double pt) const {
+        int pos = 0;
+        for (double e : _ptEdges) pos += pt >= e;
+        return pos > 0 && pos < int(_ptEdges.size()) ? pos - 1 : -1;
+      }
+
+      // Sums the constituent pT in each annulus around (rap, phi); returns
+      // the pT within the radius. Constituents need rap(), phi() and pT().
+      template <typename Constituents>
+      double measure(double rap, double phi, const Constituents& constituents) {
+        std::fill(_sums.begin(), _sums.end(), 0.);
+        double total = 0.;
+        for (const auto& p : constituents) {
+          const double dy = p.rap() - rap, dphi = Kernels::deltaPhi(p.phi(), phi);
+          const size_t i = size_t(std::sqrt(dy * dy + dphi * dphi) * _inv);
+          if (i >= _sums.size()) continue;
+          _sums[i] += p.pT();
+          total += p.pT();
+        }
+        _total = total;
+        return total;
+      }
+
+      // pT in annulus i of the last measure()
+      double sum(size_t i) const { return _sums[i]; }
+
+      // Fills the last measure(), of a jet of pT pt, into rho and psi
+      template <typename Histo>
+      void fill(Histo& rho, Histo& psi, double pt) const {
+        double inside = 0.;
+        for (size_t i = 0; i < annuli(); i++) {
+          inside += _sums[i];
+          rho->fill(center(i), _sums[i] / pt);
+          psi->fill(center(i), _total > 0 ? inside / _total : 0.);
+        }
+      }
+
+    private:
+      double _radius = 0., _inv = 0., _total = 0.;
+      std::vector<double> _ptEdges;
+      std::vector<double> _sums;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,284 @@
+// -*- C++ -*-
+
+// Per-jet columnar store: one row per selected jet, written by the USPJWL
+// analyses when USPJWL_JETSTORE is set and read back by
+// tools/uspjwl-jetstore-hist to rebuild histograms with any binning.
+//
+// File layout (little endian, native alignment):
+//   FileHeader
+//   Block, Block, ...
+// Every block holds up to blockJets rows in columnar form:
+//   BlockHeader
+//   uint64  event[nJets]
+//   double  weight[nJets]
+//   uint64  zoffset[NZ][nJets + 1]               (ragged inclusive z_r)
+//   float   column[NCOLUMNS][nJets]              (NaN when not measured)
+//   float   z[0][nZ[0]], z[1][nZ[1]]
+//   padding to 8 bytes
+
+#ifndef USPJWL_JETSTORE_HH
+#define USPJWL_JETSTORE_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace USPJWL {
+
+  namespace JetStore {
+
+    const char MAGIC[8] = {'U', 'S', 'P', 'J', 'W', 'L', 'J', 'S'};
+    const uint32_t VERSION = 1;
+    const uint32_t BLOCK_MAGIC = 0x4b4c424a; // "JBLK"
+
+    // Fixed per-jet columns
+    enum Column { R, PT, Y, ETA, PHI, MASS, LEADPT, ZLEAD_R01, ZLEAD_R02,
+                  PARTNER_PT, PARTNER_DPHI, NCOLUMNS };
+
+    const char* const COLUMN_NAMES[NCOLUMNS] = {
+      "R", "pt", "y", "eta", "phi", "mass", "leadpt", "zlead_r01", "zlead_r02",
+      "partner_pt", "partner_dphi"
+    };
+
+    // Ragged per-jet columns: inclusive subjet z_r for r = 0.1, 0.2
+    const size_t NZ = 2;
+    const char* const Z_NAMES[NZ] = {"zincl_r01", "zincl_r02"};
+
+    struct FileHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t nColumns;
+    };
+
+    struct BlockHeader {
+      uint32_t magic;
+      uint32_t nJets;
+      uint64_t nZ[NZ];
+      uint64_t nBytes;      // Size of the block including this header
+    };
+
+    inline size_t padTo8(size_t n) { return (n + 7) & ~size_t(7); }
+
+    inline size_t payloadUsed(uint64_t njets, const uint64_t* nz) {
+      size_t used = njets * (sizeof(uint64_t) + sizeof(double) + NCOLUMNS * sizeof(float))
+                    + NZ * (njets + 1) * sizeof(uint64_t);
+      for (size_t k = 0; k < NZ; k++) used += nz[k] * sizeof(float);
+      return used;
+    }
+
+
+    // Streams jet rows into a store file, one block at a time
+    class Writer {
+    public:
+
+      Writer() : _file(nullptr), _blockJets(4096), _nJets(0) {}
+
+      ~Writer() { close(); }
+
+      void open(const std::string& path, size_t blockJets = 4096) {
+        close();
+        _file = std::fopen(path.c_str(), "wb");
+        if (!_file) throw std::runtime_error("Cannot open jet store " + path);
+        _blockJets = blockJets > 0 ? blockJets : 1;
+        FileHeader fh;
+        std::memcpy(fh.magic, MAGIC, sizeof(MAGIC));
+        fh.version = VERSION;
+        fh.nColumns = NCOLUMNS;
+        std::fwrite(&fh, sizeof(fh), 1, _file);
+        for (size_t k = 0; k < NZ; k++) _zoffset[k].assign(1, 0);
+      }
+
+      bool isOpen() const { return _file != nullptr; }
+
+      size_t numJets() const { return _nJets; }
+
+      // Starts a new row, every column is NaN until set
+      void beginJet(uint64_t event, double weight) {
+        _event.push_back(event);
+        _weight.push_back(weight);
+        for (size_t c = 0; c < NCOLUMNS; c++)
+          _column[c].push_back(std::numeric_limits<float>::quiet_NaN());
+      }
+
+      // Starts a new row filled with the kinematics of a Rivet Jet
+      template <typename JET>
+      void beginJet(uint64_t event, double weight, double radius, const JET& jet) {
+        beginJet(event, weight);
+        set(R, radius);
+        set(PT, jet.pT());
+        set(Y, jet.rap());
+        set(ETA, jet.eta());
+        set(PHI, jet.phi());
+        set(MASS, jet.mass());
+        double leadpt = 0.;
+        for (const auto& p : jet.constituents()) leadpt = std::max(leadpt, p.pT());
+        set(LEADPT, leadpt);
+      }
+
+      void set(Column c, double value) { _column[c].back() = value; }
+
+      void addZ(size_t k, double z) { _z[k].push_back(z); }
+
+      void endJet() {
+        for (size_t k = 0; k < NZ; k++) _zoffset[k].push_back(_z[k].size());
+        _nJets++;
+        if (_event.size() >= _blockJets) flush();
+      }
+
+      void flush() {
+        if (!_file || _event.empty()) return;
+        const uint64_t njets = _event.size();
+        BlockHeader bh;
+        bh.magic = BLOCK_MAGIC;
+        bh.nJets = njets;
+        for (size_t k = 0; k < NZ; k++) bh.nZ[k] = _z[k].size();
+        const size_t used = payloadUsed(njets, bh.nZ);
+        bh.nBytes = sizeof(BlockHeader) + padTo8(used);
+        std::fwrite(&bh, sizeof(bh), 1, _file);
+        std::fwrite(_event.data(), sizeof(uint64_t), njets, _file);
+        std::fwrite(_weight.data(), sizeof(double), njets, _file);
+        for (size_t k = 0; k < NZ; k++)
+          std::fwrite(_zoffset[k].data(), sizeof(uint64_t), njets + 1, _file);
+        for (size_t c = 0; c < NCOLUMNS; c++)
+          std::fwrite(_column[c].data(), sizeof(float), njets, _file);
+        for (size_t k = 0; k < NZ; k++)
+          std::fwrite(_z[k].data(), sizeof(float), _z[k].size(), _file);
+        const char zeros[8] = {0};
+        std::fwrite(zeros, 1, padTo8(used) - used, _file);
+        std::fflush(_file);
+
+        _event.clear();
+        _weight.clear();
+        for (size_t c = 0; c < NCOLUMNS; c++) _column[c].clear();
+        for (size_t k = 0; k < NZ; k++) {
+          _z[k].clear();
+          _zoffset[k].assign(1, 0);
+        }
+      }
+
+      void close() {
+        if (!_file) return;
+        flush();
+        std::fclose(_file);
+        _file = nullptr;
+      }
+
+    private:
+
+      std::FILE* _file;
+      size_t _blockJets, _nJets;
+      std::vector<uint64_t> _event;
+      std::vector<double> _weight;
+      std::vector<float> _column[NCOLUMNS];
+      std::vector<uint64_t> _zoffset[NZ];
+      std::vector<float> _z[NZ];
+    };
+
+
+    // Column views of one block, valid while the Reader lives
+    struct BlockView {
+      size_t nJets;
+      const uint64_t* event;
+      const double* weight;
+      const float* column[NCOLUMNS];
+      const uint64_t* zoffset[NZ];
+      const float* z[NZ];
+    };
+
+
+    // Read-only, memory-mapped access to a store file
+    class Reader {
+    public:
+
+      Reader() : _data(nullptr), _size(0) {}
+
+      explicit Reader(const std::string& path) : _data(nullptr), _size(0) { open(path); }
+
+      ~Reader() { close(); }
+
+      Reader(const Reader&) = delete;
+      Reader& operator=(const Reader&) = delete;
+
+      void open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open jet store " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FileHeader)) {
+          ::close(fd);
+          throw std::runtime_error("Truncated jet store " + path);
+        }
+        _size = st.st_size;
+        void* p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("Cannot map jet store " + path);
+        _data = static_cast<const char*>(p);
+        madvise(p, _size, MADV_SEQUENTIAL);
+
+        const FileHeader* fh = reinterpret_cast<const FileHeader*>(_data);
+        if (std::memcmp(fh->magic, MAGIC, sizeof(MAGIC)) != 0 || fh->version != VERSION
+            || fh->nColumns != NCOLUMNS)
+          throw std::runtime_error("Not a USPJWL jet store: " + path);
+
+        // An incomplete trailing block is ignored
+        size_t pos = sizeof(FileHeader);
+        while (pos + sizeof(BlockHeader) <= _size) {
+          const BlockHeader* bh = reinterpret_cast<const BlockHeader*>(_data + pos);
+          if (bh->magic != BLOCK_MAGIC || pos + bh->nBytes > _size) break;
+          _blocks.push_back(pos);
+          pos += bh->nBytes;
+        }
+      }
+
+      void close() {
+        if (_data) munmap(const_cast<char*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+        _blocks.clear();
+      }
+
+      size_t numBlocks() const { return _blocks.size(); }
+
+      BlockView block(size_t b) const {
+        const BlockHeader* bh = reinterpret_cast<const BlockHeader*>(_data + _blocks[b]);
+        const size_t njets = bh->nJets;
+        const char* p = _data + _blocks[b] + sizeof(BlockHeader);
+
+        BlockView bv;
+        bv.nJets = njets;
+        bv.event = reinterpret_cast<const uint64_t*>(p);
+        bv.weight = reinterpret_cast<const double*>(bv.event + njets);
+        const uint64_t* off = reinterpret_cast<const uint64_t*>(bv.weight + njets);
+        for (size_t k = 0; k < NZ; k++, off += njets + 1) bv.zoffset[k] = off;
+        const float* col = reinterpret_cast<const float*>(off);
+        for (size_t c = 0; c < NCOLUMNS; c++, col += njets) bv.column[c] = col;
+        const float* z = col;
+        for (size_t k = 0; k < NZ; k++) {
+          bv.z[k] = z;
+          z += bh->nZ[k];
+        }
+        return bv;
+      }
+
+    private:
+
+      const char* _data;
+      size_t _size;
+      std::vector<size_t> _blocks;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+// -*- C++ -*-
+
+// Inner loops of the analyses in a form that gives exactly the results of
+// the code they replace, without its per-call allocations and repeated
+// work. Each kernel has a copy of the original in
+// tools/uspjwl-microbench.cc, which times the two and checks that the
+// outputs agree bit for bit.
+
+#ifndef USPJWL_KERNELS_HH
+#define USPJWL_KERNELS_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include("fastjet/ClusterSequence.hh")
+#include "fastjet/ClusterSequence.hh"
+#define USPJWL_KERNELS_FASTJET 1
+#endif
+#endif
+
+namespace USPJWL {
+
+  namespace Kernels {
+
+    // Interval of x among the sorted edges, as returned by the pTRange and
+    // absrapRange loops: i for edges[i-1] < x <= edges[i], 0 if x is not
+    // above the first edge, above the last one, or NaN.
+    // Counting the edges below x compiles to branch-free code.
+    template <size_t N>
+    inline int edgeRange(const double (&edges)[N], double x) {
+      int pos = 0;
+      for (size_t i = 0; i < N; i++) pos += x > edges[i];
+      return pos == int(N) ? 0 : pos;
+    }
+
+
+    // Slice i with edges[i] <= x < edges[i+1], the last one open above;
+    // -1 below the first edge or for NaN (the jet-mass pT slices)
+    template <size_t N>
+    inline int slice(const double (&edges)[N], double x) {
+      int pos = 0;
+      for (size_t i = 0; i < N; i++) pos += x >= edges[i];
+      return pos - 1;
+    }
+
+
+    // Rivet::deltaPhi(phi1, phi2). The fmod only runs when it can change
+    // the difference, i.e. never for two angles in [0, 2pi).
+    inline double deltaPhi(double phi1, double phi2) {
+      const double TWOPI = 2 * M_PI;
+      double d = phi1 - phi2;
+      if (!(std::fabs(d) < TWOPI)) d = std::fmod(d, TWOPI);
+      if (std::fabs(d) < 1e-8) return 0.;
+      if (d > M_PI) d -= TWOPI;
+      if (d <= -M_PI) d += TWOPI;
+      return std::fabs(d);
+    }
+
+
+    // isInPlane(phi, psi, n) of USPJWL_INOUTPLANESPEC: phi is within the
+    // in-plane window of one of the first n-1 symmetry angles psi + 2pi i/n.
+    // The minimum over a vector of distances becomes an early exit.
+    inline bool inPlane(double phi, double psi, int n) {
+      const double maxinplanedist = (2. / 3.) * M_PI / (2 * n);
+      const double phiConv = std::fmod(phi + 2 * M_PI, 2 * M_PI);
+      for (int i = 0; i < n - 1; i++) {
+        double diff = std::fabs(phiConv - std::fmod(psi + 2 * M_PI * i / n + 2 * M_PI, 2 * M_PI));
+        double dist = diff > M_PI ? 2 * M_PI - diff : diff;
+        if (dist < maxinplanedist) return true;
+      }
+      return false;
+    }
+
+
+#ifdef USPJWL_KERNELS_FASTJET
+    // pT of the inclusive kt subjets of radius r, hardest first: the
+    // perp() values of sorted_by_pt(cs.inclusive_jets()). The constituents
+    // are converted to PseudoJets once by the caller and reused for every r.
+    template <typename Container>
+    inline void ktSubjetPts(const std::vector<fastjet::PseudoJet>& constituents, double r, Container& pts) {
+      fastjet::ClusterSequence cs(constituents, fastjet::JetDefinition(fastjet::kt_algorithm, r));
+      pts.clear();
+      for (const fastjet::PseudoJet& subjet : cs.inclusive_jets()) pts.push_back(subjet.perp());
+      std::sort(pts.begin(), pts.end(), std::greater<double>());
+    }
+#endif
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+// -*- C++ -*-
+
+// Histograms that are not filled but projected from master histograms.
+//
+// An analysis fills its masters: histograms over disjoint selections
+// (e.g. exclusive rapidity classes) whose bin edges are the union of the
+// edges of every histogram derived from them (unionEdges()). A projected
+// histogram is the sum of some masters, rebinned to its own edges; the
+// masters' bins between two of its edges add up to its bin, those below
+// its first edge to its underflow and those above its last edge to its
+// overflow, so the projection is exact. Every edge of the projected
+// histogram must be an edge of the masters.
+//
+// Analyses declare projections with Runtime::project() (USPJWL_Runtime.hh)
+// and book the projected histograms as usual. They stay empty during the
+// run, and the Runtime fills them from the masters in finalize, in the
+// binary output, the live snapshots and the bootstrap replicas. Merged
+// outputs can be projected to further binnings with tools/uspjwl-rebin.
+
+#ifndef USPJWL_MASTER_HH
+#define USPJWL_MASTER_HH
+
+#include "USPJWL_BinHisto.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Master {
+
+    // Edges closer than this (relative) are the same edge, as after a round trip through YODA text
+    inline bool sameEdge(double a, double b) {
+      return std::fabs(a - b) <= 1e-6 * std::max(1., std::max(std::fabs(a), std::fabs(b)));
+    }
+
+
+    // Sorted union of several sets of bin edges: the binning of a master
+    inline std::vector<double> unionEdges(const std::vector<std::vector<double> >& sets) {
+      std::vector<double> all;
+      for (const std::vector<double>& edges : sets) all.insert(all.end(), edges.begin(), edges.end());
+      std::sort(all.begin(), all.end());
+      std::vector<double> out;
+      for (double e : all) {
+        if (out.empty() || !sameEdge(out.back(), e)) out.push_back(e);
+      }
+      return out;
+    }
+
+
+    // Edges from n equal bins in [lo, hi), as booked with book(h, name, n, lo, hi)
+    inline std::vector<double> linearEdges(size_t n, double lo, double hi) {
+      std::vector<double> edges(n + 1);
+      for (size_t i = 0; i <= n; i++) edges[i] = lo + i * (hi - lo) / n;
+      return edges;
+    }
+
+
+    // Adds master into target (both HISTO1D)
+    inline void addProjection(const BinHisto::Object& master, BinHisto::Object& target) {
+      using namespace BinHisto;
+      const std::vector<double>& me = master.edges;
+      const std::vector<double>& te = target.edges;
+      const auto below = [](double e, double x) { return e < x || sameEdge(e, x); };
+      const std::runtime_error notEdges("Bin edges of " + target.path + " are not edges of " + master.path);
+      if (!below(me.front(), te.front()) || !below(te.back(), me.back())) throw notEdges;
+
+      // Slot of target that each master slot goes to
+      std::vector<size_t> slot(master.numSlots());
+      slot[TOTAL] = TOTAL;
+      slot[UNDERFLOW] = UNDERFLOW;
+      slot[OVERFLOW] = OVERFLOW;
+      size_t t = 0;     // Target edges at or below the low edge of master bin i
+      for (size_t i = 0; i < master.numBins(); i++) {
+        while (t < te.size() && below(te[t], me[i])) t++;
+        if (t < te.size() && !below(me[i + 1], te[t])) throw notEdges;
+        slot[FIRSTBIN + i] = t == 0 ? size_t(UNDERFLOW) : t == te.size() ? size_t(OVERFLOW) : FIRSTBIN + t - 1;
+      }
+
+      for (int s = 0; s < NSTATS; s++) {
+        for (size_t i = 0; i < master.numSlots(); i++) target.at(s, slot[i]) += master.at(s, i);
+      }
+    }
+
+
+    class Projections {
+    public:
+
+      // target = sum of masters; names as booked, i.e. relative to the analysis
+      void add(const std::string& target, const std::vector<std::string>& masters) {
+        _declared.push_back(std::make_pair(target, masters));
+      }
+
+      bool empty() const { return _declared.empty(); }
+
+      void configure(const std::string& analysis) {
+        _masters.clear();
+        for (const auto& d : _declared) {
+          std::vector<std::string>& paths = _masters["/" + analysis + "/" + d.first];
+          for (const std::string& m : d.second) paths.push_back("/" + analysis + "/" + m);
+        }
+      }
+
+      // Path without a trailing "[...]" (weight variations, bootstrap replicas)
+      static std::string basePath(const std::string& path, std::string* suffix = nullptr) {
+        const size_t open = path.empty() || path.back() != ']' ? std::string::npos : path.rfind('[');
+        if (suffix) *suffix = open == std::string::npos ? "" : path.substr(open);
+        return path.substr(0, open);
+      }
+
+      bool isTarget(const std::string& path) const { return _masters.count(basePath(path)) > 0; }
+
+      // Fills every projected histogram among objects from the masters with the same suffix
+      void apply(std::vector<BinHisto::Object>& objects) const {
+        if (_masters.empty()) return;
+        std::unordered_map<std::string, size_t> index;
+        for (size_t i = 0; i < objects.size(); i++) index[objects[i].path] = i;
+        for (BinHisto::Object& target : objects) {
+          std::string suffix;
+          const auto it = _masters.find(basePath(target.path, &suffix));
+          if (it == _masters.end() || target.kind != BinHisto::HISTO1D) continue;
+          target.resize();
+          for (const std::string& m : it->second) {
+            const auto mi = index.find(m + suffix);
+            if (mi == index.end()) throw std::runtime_error("Master " + m + suffix + " of " + target.path + " is missing");
+            addProjection(objects[mi->second], target);
+          }
+        }
+      }
+
+    private:
+      std::vector<std::pair<std::string, std::vector<std::string> > > _declared;
+      std::unordered_map<std::string, std::vector<std::string> > _masters;
+    };
+
+  }
+
+}
+
+#endif
@@ -16,6 +16,14 @@
 #include "HepMC/GenParticle.h"
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_JetStore.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Kernels.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
 #include <string>
 
 namespace Rivet {
@@ -32,30 +40,26 @@ namespace Rivet {
     DEFAULT_RIVET_ANALYSIS_CTOR(USPJWL_PHIDIST);
 
 
+    /// Histograms of one subtraction setting, one per jet pT bin
+    struct Histos {
+      Histo1DPtr _hist_1, _hist_2, _hist_3, _hist_4, _hist_5, _hist_6, _hist_7,
+      _hist_8, _hist_9, _hist_10, _hist_11, _hist_12;
+    };
+
+
     int pTRange(double jetpT) {
       // Given a jetpT, returns in which interval it belongs to (0 = out of bounds)
       // ATLAS pT bins
-      std::vector<double> PTBINS = {71., 79., 89., 100., 126., 158., 200., 251., 316., 398., 500., 650., 1000.};
-      int pos = 0;
-      for (double edge : PTBINS) {
-        if (jetpT > edge) {
-          pos++;
-        }
-
-        // Just need to check until fails
-        else {
-          return pos;
-        }
-
-      }
-
-      // If pT is larger than every edge => out of bounds
-      return 0;
+      static const double PTBINS[] = {71., 79., 89., 100., 126., 158., 200., 251., 316., 398., 500., 650., 1000.};
+      return USPJWL::Kernels::edgeRange(PTBINS, jetpT);
     }
 
 
     void init() {
 
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), INIT);
+
       // Jet anisotropies based on arXiv:2111.06606 (hepdata: https://www.hepdata.net/record/ins1967021)
 
       // Grab variable jet R parameter from environment, default value of 0.2
@@ -64,42 +68,92 @@ namespace Rivet {
       std::cout << "\nR chosen for jet algorithm: " << RJETS << std::endl;
 
       Cut cut(Cuts::abseta < 3.2); 
-  
-      SubtractedJewelEvent sev(1.0); 
-      SubtractedJewelFinalState fs(sev, cut); 
-      declare(fs, "FS"); 
-
-      // Apply FastJet
-      FastJets fj(fs, FastJets::ANTIKT, RJETS_f);
-      fj.useInvisibles();
-      declare(fj, "Jets");
-
-
-      // Book histograms, each for a pt bin
-      book(_hist_1, "71_79_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_2, "79_89_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_3, "89_100_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_4, "100_126_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_5, "126_158_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_6, "158_200_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_7, "200_251_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_8, "251_316_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_9, "316_398_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_10, "398_500_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_11, "500_650_phi_R" + RJETS, 64, 0., 2 * M_PI);
-      book(_hist_12, "650_1000_phi_R" + RJETS, 64, 0., 2 * M_PI);
+
+      // One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and
+      // one histogram set per setting and centrality class (see USPJWL_Runtime.hh)
+      _centrality.configure(name());
+      _subtraction.configure(name());
+      _sets.resize(_centrality.size() * _subtraction.size());
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        SubtractedJewelEvent sev(_subtraction.parameter(c));
+        SubtractedJewelFinalState fs(sev, cut);
+        declare(fs, _subtraction.name("FS", c));
+
+        // Apply FastJet
+        FastJets fj(fs, FastJets::ANTIKT, RJETS_f);
+        fj.useInvisibles();
+        declare(fj, _subtraction.name("Jets", c));
+
+        for (size_t k = 0; k < _centrality.size(); k++) {
+          bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+        }
+      }
+
+      // Events of each centrality class, for the per-class normalisation
+      if (_centrality.enabled()) {
+        book(_centcount, "Centrality_counter", _centrality.size(), -0.5, _centrality.size() - 0.5);
+      }
+      _runtime.route(_centrality, _subtraction.size(), _centcount);
+
+      // Events rejected (bin 0) and accepted (bin 1) by the pre-filter
+      _skim.configure(RJETS_f, 3.2, 70 * GeV);
+      book(_skimcount, "Skim_counter_R" + RJETS, 2, -0.5, 1.5);
+      _runtime.prefilter(_skim, _skimcount);
+
+      // Optional per-jet output for re-binning without rerunning (see USPJWL_JetStore.hh)
+      if (getenv("USPJWL_JETSTORE")) {
+        _jetstore.open(std::string(getenv("USPJWL_JETSTORE")) + "_" + name() + "_R" + RJETS + ".jets");
+      }
+
+      // Checkpointing and resume (see USPJWL_Runtime.hh)
+      _runtime.init(*this, analysisObjects());
+    }
+
+
+    // Book histograms, each for a pt bin; tag is appended to every name
+    void bookSet(Histos& hs, const std::string& tag) {
+      book(hs._hist_1, "71_79_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_2, "79_89_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_3, "89_100_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_4, "100_126_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_5, "126_158_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_6, "158_200_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_7, "200_251_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_8, "251_316_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_9, "316_398_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_10, "398_500_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_11, "500_650_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
+      book(hs._hist_12, "650_1000_phi_R" + RJETS + tag, 64, 0., 2 * M_PI);
     }
 
 
     /// Perform the per-event analysis
     void analyze(const Event& evt) {
 
+      // Timers, resumed events, centrality class and pre-filter (see USPJWL_Runtime.hh)
+      USPJWL::Runtime::Event event(_runtime, evt, _profile);
+      if (event.set() < 0) vetoEvent;
+
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        analyzeSetting(evt, c, _sets[event.set() + c]);
+      }
+    }
+
+
+    // Observables of subtraction setting c, filled into hs
+    void analyzeSetting(const Event& evt, size_t c, Histos& hs) {
+      // Charged to its own stage instead of the first apply<FastJets>
+      USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("FS", c)));
+
       // Method definitions
       double etamax = 3.2 - RJETS_f;
       Cut jetcuts = Cuts::pT > 70 * GeV && Cuts::absrap < 1.2 && Cuts::abseta < etamax;
-      const Jets jets = apply<FastJets>(evt, "Jets").jetsByPt(jetcuts);
+      const FastJets& fj = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("Jets", c)));
+      const Jets jets = USPJWL_TIMED(_profile, "jetsByPt", fj.jetsByPt(jetcuts));
 
       for (const Jet& j : jets) {
+        USPJWL_TIME_SCOPE(_profile, "jet fills");
+
         // Jet properties
         double phi = j.phi(), pt = j.pT();
 
@@ -107,40 +161,40 @@ namespace Rivet {
         // Fill the right histograms for each pT range
         switch (pTRange(pt)) {
           case 1:
-            _hist_1 -> fill(phi);
+            hs._hist_1 -> fill(phi);
             break;
           case 2:
-            _hist_2 -> fill(phi);
+            hs._hist_2 -> fill(phi);
             break;
           case 3:
-            _hist_3 -> fill(phi);
+            hs._hist_3 -> fill(phi);
             break;
           case 4:
-            _hist_4 -> fill(phi);
+            hs._hist_4 -> fill(phi);
             break;
           case 5:
-            _hist_5 -> fill(phi);
+            hs._hist_5 -> fill(phi);
             break;
           case 6:
-            _hist_6 -> fill(phi);
+            hs._hist_6 -> fill(phi);
             break;
           case 7:
-            _hist_7 -> fill(phi);
+            hs._hist_7 -> fill(phi);
             break;
           case 8:
-            _hist_8 -> fill(phi);
+            hs._hist_8 -> fill(phi);
             break;
           case 9:
-            _hist_9 -> fill(phi);
+            hs._hist_9 -> fill(phi);
             break;
           case 10:
-            _hist_10 -> fill(phi);
+            hs._hist_10 -> fill(phi);
             break;
           case 11:
-            _hist_11 -> fill(phi);
+            hs._hist_11 -> fill(phi);
             break;
           case 12:
-            _hist_12 -> fill(phi);
+            hs._hist_12 -> fill(phi);
             break;
           default:
              //std::cout << "pT out of bounds: " << pt << " GeV!" << std::endl;
@@ -149,6 +203,11 @@ namespace Rivet {
 
         }
 
+        if (c == 0 && _jetstore.isOpen()) {
+          _jetstore.beginJet(evt.genEvent()->event_number(), evt.weights()[0], RJETS_f, j);
+          _jetstore.endJet();
+        }
+
       }
 
     }
@@ -156,16 +215,26 @@ namespace Rivet {
 
     void finalize() {
       // Scale only after yoda merge
+      _jetstore.close();
+      _runtime.finalize();
+      _profile.report(name());
+      USPJWL_ALLOC_REPORT(name(), analysisObjects());
     }
 
 
     /// @name Histograms
-    // R_AA
-    Histo1DPtr _hist_1, _hist_2, _hist_3, _hist_4, _hist_5, _hist_6, _hist_7,
-    _hist_8, _hist_9, _hist_10, _hist_11, _hist_12;
+    std::vector<Histos> _sets;
+    USPJWL::Subtraction::Settings _subtraction;
+    USPJWL::Centrality::Classes _centrality;
+
+    Histo1DPtr _skimcount, _centcount;
+    USPJWL::Skim::Filter _skim;
+    USPJWL::Runtime _runtime;
+    USPJWL::Timing::Profile _profile;
 
     double RJETS_f;
     std::string RJETS;
+    USPJWL::JetStore::Writer _jetstore;
 
   };
 
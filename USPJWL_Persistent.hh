@@ -0,0 +1,33 @@
+// -*- C++ -*-
+
+// Accumulated YODA objects of a USPJWL analysis.
+//
+// In Rivet 3 the Histo1DPtr used in analyze() points to a per-event fill
+// proxy; the running sums live in the wrapper's persistent objects, one per
+// event weight. The run services (USPJWL_Runtime.hh) and the allocation
+// report (USPJWL_AllocProfile.hh) read the nominal one.
+
+#ifndef USPJWL_PERSISTENT_HH
+#define USPJWL_PERSISTENT_HH
+
+#include "Rivet/Analysis.hh"
+
+#include <memory>
+#include <vector>
+
+namespace USPJWL {
+
+  // Accumulated YODA objects of type T booked by an analysis (nominal weight)
+  template <typename T>
+  std::vector<std::shared_ptr<T> > persistentObjects(const std::vector<Rivet::MultiweightAOPtr>& aos) {
+    std::vector<std::shared_ptr<T> > out;
+    for (const Rivet::MultiweightAOPtr& ao : aos) {
+      std::shared_ptr<Rivet::Wrapper<T> > w = std::dynamic_pointer_cast<Rivet::Wrapper<T> >(ao.get());
+      if (w) out.push_back(w->persistent(0));
+    }
+    return out;
+  }
+
+}
+
+#endif
@@ -0,0 +1,210 @@
+// -*- C++ -*-
+
+// Run control by statistical precision.
+//
+// USPJWL_PRECISION lists goals as comma-separated
+//   <path part>[@<xlow>:<xhigh>]=<relative uncertainty>
+// e.g.
+//   USPJWL_PRECISION='JetpT_R0.4@100:300=0.02,xJ_630_1000=0.05'
+// Every booked histogram whose path contains <path part> must reach
+// sqrt(sumw2)/|sumw| below the goal in each bin whose centre lies in the
+// x range (all bins if no range is given).
+//
+// The sums are the ones the persistent histograms keep anyway, so nothing
+// is added to the event loop: the goals are evaluated every
+// USPJWL_PRECISION_EVERY events (default 5000) from Runtime::beginEvent, on
+// a copy of the histograms in which the projected ones (USPJWL_Master.hh)
+// are already filled from their masters.
+// Each evaluation rewrites <prefix>_<ANALYSIS>.precision, with the worst
+// bin of every goal and the number of events it needs at the current rate
+// (N (err/goal)^2), where <prefix> is USPJWL_PRECISION_FILE (default
+// "uspjwl"). Once all goals of the analysis are met, <prefix>_<ANALYSIS>.done
+// is created; a driver or batch wrapper can poll for it to stop the job or
+// hand its events to another one. With USPJWL_PRECISION_STOP=1 the process
+// sends itself SIGINT when every analysis with goals is done, and the rivet
+// command finalizes and writes its output as after a normal end of input.
+
+#ifndef USPJWL_PRECISION_HH
+#define USPJWL_PRECISION_HH
+
+#include "USPJWL_BinHisto.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Precision {
+
+    struct Goal {
+      std::string pattern;
+      double xlow = -std::numeric_limits<double>::infinity();
+      double xhigh = std::numeric_limits<double>::infinity();
+      double relerr = 0.;
+    };
+
+
+    inline std::vector<Goal> parseGoals(const std::string& spec) {
+      std::vector<Goal> goals;
+      std::istringstream in(spec);
+      std::string item;
+      while (std::getline(in, item, ',')) {
+        if (item.empty()) continue;
+        const size_t eq = item.rfind('=');
+        if (eq == std::string::npos) throw std::invalid_argument("precision goal without '=': " + item);
+        Goal g;
+        g.pattern = item.substr(0, eq);
+        g.relerr = std::stod(item.substr(eq + 1));
+        const size_t at = g.pattern.find('@');
+        if (at != std::string::npos) {
+          const std::string range = g.pattern.substr(at + 1);
+          const size_t colon = range.find(':');
+          if (colon == std::string::npos) throw std::invalid_argument("precision range without ':': " + item);
+          if (colon > 0) g.xlow = std::stod(range.substr(0, colon));
+          if (colon + 1 < range.size()) g.xhigh = std::stod(range.substr(colon + 1));
+          g.pattern = g.pattern.substr(0, at);
+        }
+        if (g.pattern.empty() || !(g.relerr > 0)) throw std::invalid_argument("bad precision goal: " + item);
+        goals.push_back(g);
+      }
+      return goals;
+    }
+
+
+    // Analyses in this process with goals, and how many of them are done
+    struct Registry {
+      int active = 0, done = 0;
+      static Registry& instance() {
+        static Registry r;
+        return r;
+      }
+    };
+
+
+    class Monitor {
+    public:
+
+      Monitor() : _every(0), _done(false), _stop(false) {}
+
+      bool enabled() const { return _every > 0; }
+      size_t every() const { return _every; }
+
+      // objects as written by the Runtime (Runtime::binaryObjects())
+      void configure(const std::string& name, const std::vector<BinHisto::Object>& objects) {
+        const char* spec = getenv("USPJWL_PRECISION");
+        if (!spec) return;
+        _name = name;
+        try {
+          _goals = parseGoals(spec);
+        }
+        catch (const std::exception& e) {
+          std::cerr << _name << ": USPJWL_PRECISION: " << e.what() << std::endl;
+          return;
+        }
+
+        // Only the goals that match a histogram of this analysis are kept
+        std::vector<Goal> mine;
+        for (const Goal& g : _goals) {
+          for (const BinHisto::Object& h : objects) {
+            if (h.kind == BinHisto::HISTO1D && h.path.find(g.pattern) != std::string::npos) {
+              mine.push_back(g);
+              break;
+            }
+          }
+        }
+        _goals = mine;
+        if (_goals.empty()) return;
+
+        const std::string prefix = getenv("USPJWL_PRECISION_FILE") ? getenv("USPJWL_PRECISION_FILE") : "uspjwl";
+        _statusPath = prefix + "_" + _name + ".precision";
+        _donePath = prefix + "_" + _name + ".done";
+        std::remove(_donePath.c_str());
+        _every = getenv("USPJWL_PRECISION_EVERY") ? std::atol(getenv("USPJWL_PRECISION_EVERY")) : 5000;
+        if (_every == 0) _every = 1;
+        const char* stop = getenv("USPJWL_PRECISION_STOP");
+        _stop = stop && std::string(stop) == "1";
+        Registry::instance().active++;
+        std::cout << _name << ": " << _goals.size() << " precision goals, checked every " << _every
+                  << " events, status in " << _statusPath << std::endl;
+      }
+
+      // Evaluates the goals on objects after nevt events
+      void check(size_t nevt, const std::vector<BinHisto::Object>& objects) {
+        if (!enabled() || _done) return;
+
+        std::ostringstream status;
+        status << "# " << _name << " after " << nevt << " events\n";
+        status << "# goal target worst_relerr worst_histo worst_xlow events_needed\n";
+        bool allMet = true;
+        double needed = double(nevt);
+        for (const Goal& g : _goals) {
+          double worst = 0.;
+          std::string worstPath = "-";
+          double worstX = 0.;
+          for (const BinHisto::Object& h : objects) {
+            if (h.kind != BinHisto::HISTO1D || h.path.find(g.pattern) == std::string::npos) continue;
+            for (size_t i = 0; i < h.numBins(); i++) {
+              const double xmid = 0.5 * (h.edges[i] + h.edges[i + 1]);
+              if (xmid < g.xlow || xmid > g.xhigh) continue;
+              const double sumw = h.at(BinHisto::SUMW, BinHisto::FIRSTBIN + i), sumw2 = h.at(BinHisto::SUMW2, BinHisto::FIRSTBIN + i);
+              const double err = sumw != 0 ? std::sqrt(sumw2) / std::fabs(sumw) : std::numeric_limits<double>::infinity();
+              if (err > worst) {
+                worst = err;
+                worstPath = h.path;
+                worstX = h.edges[i];
+              }
+            }
+          }
+          const double n = std::isfinite(worst) ? nevt * (worst / g.relerr) * (worst / g.relerr) : std::numeric_limits<double>::infinity();
+          if (worst > g.relerr) allMet = false;
+          needed = std::max(needed, n);
+          status << g.pattern << " " << g.relerr << " " << worst << " " << worstPath << " " << worstX << " " << n << "\n";
+        }
+        status << "# events needed for all goals: " << needed << "\n";
+        writeAtomically(_statusPath, status.str());
+
+        if (!allMet) return;
+        _done = true;
+        writeAtomically(_donePath, status.str());
+        std::cout << _name << ": all precision goals met after " << nevt << " events" << std::endl;
+
+        Registry& r = Registry::instance();
+        if (++r.done == r.active && _stop) {
+          std::cout << _name << ": every analysis has met its goals, stopping the run" << std::endl;
+          std::raise(SIGINT);
+        }
+      }
+
+    private:
+
+      // Pollers never see a partly written file
+      static void writeAtomically(const std::string& path, const std::string& text) {
+        const std::string tmp = path + ".tmp";
+        {
+          std::ofstream out(tmp);
+          out << text;
+        }
+        std::rename(tmp.c_str(), path.c_str());
+      }
+
+      std::string _name, _statusPath, _donePath;
+      std::vector<Goal> _goals;
+      size_t _every;
+      bool _done, _stop;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,416 @@
+// -*- C++ -*-
+
+// Per-analysis run services shared by the USPJWL analyses.
+//
+// Every analysis owns one Runtime and calls
+//   _runtime.init(*this, analysisObjects());   at the end of init()
+//   USPJWL::Runtime::Event event(_runtime, evt, _profile);
+//   if (event.set() < 0) vetoEvent;            at the start of analyze()
+//   _runtime.finalize();                       in finalize()
+//
+// Event selection (Runtime::Event): opened on the first line of analyze(),
+// an Event times the whole call for USPJWL_SLOWEVENTS, charges its
+// allocations to the analysis (-DUSPJWL_ALLOC_PROFILE) and opens the
+// "analyze" stage timer (-DUSPJWL_PROFILE). It then skips the events
+// already covered by a resumed checkpoint, looks up the centrality class
+// of the event (route(), see USPJWL_Centrality.hh) and applies the
+// pre-filter (prefilter(), see USPJWL_Skim.hh), which rejects only events
+// in which no jet can pass the selection, before any subtraction or
+// clustering. The class is looked up first, so that the class counts
+// include the events the pre-filter rejects; the pre-filter counts the
+// rejected (bin 0) and accepted (bin 1) events. The analyses keep one
+// histogram set per centrality class and subtraction setting, laid out
+// [class][setting]; set() is the first set of the event's class, or -1
+// for an event to veto.
+//
+// Periodic checkpoints (USPJWL_CHECKPOINT=<prefix>): every
+// USPJWL_CHECKPOINT_EVERY events (default 10000) the booked histograms and
+// counters, any extra analysis counters registered with addCounter() and
+// the number of processed events are copied and written in the background
+// to <prefix>_<ANALYSIS>.ckpt.yoda (see USPJWL_Checkpoint.hh).
+// With USPJWL_RESUME=1 the last checkpoint is loaded at init and the events
+// it already covers are skipped, so the job can be restarted on the same
+// input after being killed. Checkpoints hold the nominal weight only, so
+// both are refused for runs with more than one event weight: resuming would
+// restore the nominal histograms and leave the variations without the
+// skipped events.
+//
+// Binary output (USPJWL_BINOUT=<prefix>): at finalize the unscaled
+// histograms and counters are also written to <prefix>_<ANALYSIS>.ybin
+// (see USPJWL_BinHisto.hh), which uspjwl-merge reads without parsing.
+//
+// Slow-event capture (USPJWL_SLOWEVENTS=<prefix>): the slowest events are
+// kept and written at finalize (see USPJWL_SlowEvents.hh).
+//
+// Precision goals (USPJWL_PRECISION=...): the relative uncertainty of the
+// listed histogram bins is checked every few thousand events and the job
+// is flagged, or stopped, once all goals are met (see USPJWL_Precision.hh).
+//
+// Live snapshots (USPJWL_SNAPSHOT=<tag>): every USPJWL_SNAPSHOT_EVERY
+// events (default 1000) the unscaled histograms are published to shared
+// memory for tools/uspjwl-inspect (see USPJWL_Snapshot.hh).
+//
+// Bootstrap replicas (USPJWL_BOOTSTRAP=K): K Poisson-reweighted copies of
+// the histograms are accumulated from the changes of the bins each event
+// fills and written at finalize (see USPJWL_Bootstrap.hh).
+//
+// Projected histograms (project()): histograms declared as sums of master
+// histograms are left empty during the run and filled from the masters at
+// finalize, in every output above (see USPJWL_Master.hh).
+
+#ifndef USPJWL_RUNTIME_HH
+#define USPJWL_RUNTIME_HH
+
+#include "Rivet/Analysis.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_BinHisto.hh"
+#include "USPJWL_Bootstrap.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_Checkpoint.hh"
+#include "USPJWL_Master.hh"
+#include "USPJWL_Persistent.hh"
+#include "USPJWL_Precision.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_SlowEvents.hh"
+#include "USPJWL_Snapshot.hh"
+#include "USPJWL_Timing.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace USPJWL {
+
+  class Runtime {
+  public:
+
+    Runtime() : _nevt(0), _skip(0), _every(0), _snapshotEvery(0), _settings(1),
+                _centrality(nullptr), _centcount(nullptr), _skim(nullptr), _skimcount(nullptr) {}
+
+    // Open for the whole of analyze(); see the header
+    class Event {
+    public:
+
+      Event(Runtime& runtime, const Rivet::Event& evt, Timing::Profile& profile)
+        : _runtime(runtime), _timer(runtime.slowEvents(), evt)
+#ifdef USPJWL_ALLOC_PROFILE
+        , _alloc(runtime._name, AllocProfile::ANALYZE)
+#endif
+#ifdef USPJWL_PROFILE
+        , _scope(profile, "analyze")
+#endif
+      {
+        _class = runtime.select(evt, profile);
+        _set = _class < 0 ? -1 : _class * int(runtime._settings);
+      }
+
+      ~Event() { _runtime.endEvent(); }
+
+      Event(const Event&) = delete;
+      Event& operator=(const Event&) = delete;
+
+      // First histogram set of the event's class, -1 to veto the event
+      int set() const { return _set; }
+      int centralityClass() const { return _class; }
+
+    private:
+      Runtime& _runtime;
+      SlowEvents::Timer _timer;
+#ifdef USPJWL_ALLOC_PROFILE
+      AllocProfile::Scope _alloc;
+#endif
+#ifdef USPJWL_PROFILE
+      Timing::Scope _scope;
+#endif
+      int _class, _set;
+    };
+
+    // Centrality classes of the histogram sets, settings sets per class, and
+    // the event count of each class (booked only if the classes are enabled)
+    void route(Centrality::Classes& centrality, size_t settings, Rivet::Histo1DPtr& centcount) {
+      _centrality = &centrality;
+      _settings = settings;
+      _centcount = &centcount;
+    }
+
+    // Pre-filter of the events, and the counts of rejected and accepted ones
+    void prefilter(Skim::Filter& skim, Rivet::Histo1DPtr& skimcount) {
+      _skim = &skim;
+      _skimcount = &skimcount;
+    }
+
+    // Plain analysis counters (e.g. trigger counts) to carry in checkpoints
+    void addCounter(const std::string& name, double& value) {
+      _counters.push_back(std::make_pair(name, &value));
+    }
+
+    // Histogram target, booked as usual, is filled at finalize with the sum of
+    // the masters (see USPJWL_Master.hh); names as booked, before init()
+    void project(const std::string& target, const std::vector<std::string>& masters) {
+      _projections.add(target, masters);
+    }
+
+    void init(const Rivet::Analysis& ana, const std::vector<Rivet::MultiweightAOPtr>& aos) {
+      _name = ana.name();
+      _aos = aos;
+      _projections.configure(_name);
+
+      if (getenv("USPJWL_CHECKPOINT") && ana.handler().weightNames().size() > 1) {
+        std::cerr << _name << ": USPJWL_CHECKPOINT and USPJWL_RESUME ignored, the run has "
+                  << ana.handler().weightNames().size() << " event weights and checkpoints hold only the nominal one" << std::endl;
+      }
+      else if (getenv("USPJWL_CHECKPOINT")) {
+        _ckptpath = std::string(getenv("USPJWL_CHECKPOINT")) + "_" + _name + ".ckpt.yoda";
+        _every = getenv("USPJWL_CHECKPOINT_EVERY") ? std::atol(getenv("USPJWL_CHECKPOINT_EVERY")) : 10000;
+        std::cout << _name << ": checkpoint every " << _every << " events to " << _ckptpath << std::endl;
+
+        const char* resume = getenv("USPJWL_RESUME");
+        if (resume && std::string(resume) == "1" && access(_ckptpath.c_str(), R_OK) == 0) restore();
+      }
+      if (getenv("USPJWL_BINOUT")) _binpath = std::string(getenv("USPJWL_BINOUT")) + "_" + _name + ".ybin";
+      if (getenv("USPJWL_SLOWEVENTS")) {
+        size_t k = getenv("USPJWL_SLOWEVENTS_K") ? std::atol(getenv("USPJWL_SLOWEVENTS_K")) : 20;
+        _slow.configure(_name, getenv("USPJWL_SLOWEVENTS"), k);
+      }
+      if (getenv("USPJWL_PRECISION")) _precision.configure(_name, binaryObjects());
+      _bootstrap.configure(_name, _aos);
+      if (getenv("USPJWL_SNAPSHOT")) {
+        const std::string shm = Snapshot::segmentName(getenv("USPJWL_SNAPSHOT"), _name);
+        try {
+          const std::vector<char> first = BinHisto::encode(binaryObjects());
+          _snapshot.open(shm, first);
+          _snapshot.publish(first, _nevt);
+          _snapshotEvery = getenv("USPJWL_SNAPSHOT_EVERY") ? std::atol(getenv("USPJWL_SNAPSHOT_EVERY")) : 1000;
+          if (_snapshotEvery == 0) _snapshotEvery = 1;
+          std::cout << _name << ": snapshot every " << _snapshotEvery << " events to /dev/shm" << shm << std::endl;
+        }
+        catch (const std::exception& e) {
+          std::cerr << _name << ": " << e.what() << std::endl;
+        }
+      }
+    }
+
+    // False for events already covered by a resumed checkpoint; called by Event
+    bool beginEvent(const Rivet::Event& evt) {
+      // All fills of the previous events are in the persistent objects by now
+      if (_every > 0 && _nevt > _skip && _nevt % _every == 0) checkpoint();
+      if (_precision.enabled() && _nevt > 0 && _nevt % _precision.every() == 0) _precision.check(_nevt, binaryObjects());
+      if (_snapshotEvery > 0 && _nevt > 0 && _nevt % _snapshotEvery == 0) _snapshot.publish(BinHisto::encode(binaryObjects()), _nevt);
+      if (_bootstrap.enabled()) _bootstrap.beginEvent(evt.genEvent()->event_number());
+      _nevt++;
+      return _nevt > _skip;
+    }
+
+    void finalize() {
+      projectActive();
+      if (_every > 0) {
+        checkpoint();
+        Checkpoint::Writer::instance().wait();
+      }
+      if (!_binpath.empty()) writeBinary();
+      if (_bootstrap.enabled()) _bootstrap.finalize(binaryObjects(), _projections);
+      _slow.write();
+      _snapshot.close();
+    }
+
+    size_t numEvents() const { return _nevt; }
+
+    SlowEvents::Recorder& slowEvents() { return _slow; }
+
+  private:
+
+    // Centrality class of the event, -1 to veto it
+    int select(const Rivet::Event& evt, Timing::Profile& profile) {
+      (void)profile;    // only timed with USPJWL_PROFILE
+      if (!beginEvent(evt)) return -1;
+      const int cls = _centrality ? _centrality->classify(evt.genEvent()) : 0;
+      if (cls < 0) return -1;
+      if (_centrality && _centrality->enabled()) (*_centcount)->fill(cls);
+      if (_skim) {
+        const bool accept = USPJWL_TIMED(profile, "skim", _skim->accept(evt.genEvent()));
+        (*_skimcount)->fill(accept ? 1. : 0.);
+        if (!accept) return -1;
+      }
+      return cls;
+    }
+
+    // The fills of the event are still in Rivet's per-event proxies
+    void endEvent() {
+      if (_bootstrap.enabled()) _bootstrap.endEvent();
+    }
+
+    std::string counterPath(const std::string& name) const {
+      return "/_USPJWL_CKPT/" + _name + "/" + name;
+    }
+
+    void checkpoint() {
+      Checkpoint::Snapshot snapshot;
+      for (const auto& h : persistentObjects<YODA::Histo1D>(_aos))
+        snapshot.push_back(std::make_shared<YODA::Histo1D>(*h));
+      for (const auto& c : persistentObjects<YODA::Counter>(_aos))
+        snapshot.push_back(std::make_shared<YODA::Counter>(*c));
+
+      std::shared_ptr<YODA::Counter> nevt = std::make_shared<YODA::Counter>(counterPath("events"));
+      nevt->fill(_nevt);
+      snapshot.push_back(nevt);
+      for (const auto& c : _counters) {
+        std::shared_ptr<YODA::Counter> value = std::make_shared<YODA::Counter>(counterPath(c.first));
+        value->fill(*c.second);
+        snapshot.push_back(value);
+      }
+
+      Checkpoint::Writer::instance().submit(_ckptpath, snapshot);
+    }
+
+    // "Key: value" lines as in the YODA text header
+    static std::string annotationLines(const YODA::AnalysisObject& ao) {
+      std::vector<std::string> keys = ao.annotations();
+      if (std::find(keys.begin(), keys.end(), "Type") == keys.end()) keys.push_back("Type");
+      std::sort(keys.begin(), keys.end());
+      std::string lines;
+      for (const std::string& key : keys) {
+        if (!lines.empty()) lines += "\n";
+        lines += key + ": " + (key == "Type" ? ao.type() : ao.annotation(key));
+      }
+      return lines;
+    }
+
+    template <typename DBN>
+    static void setSlot(BinHisto::Object& bo, size_t slot, const DBN& d) {
+      bo.at(BinHisto::SUMW, slot) = d.sumW();
+      bo.at(BinHisto::SUMW2, slot) = d.sumW2();
+      bo.at(BinHisto::SUMWX, slot) = d.sumWX();
+      bo.at(BinHisto::SUMWX2, slot) = d.sumWX2();
+      bo.at(BinHisto::NUMENTRIES, slot) = d.numEntries();
+    }
+
+    static BinHisto::Object histoObject(const YODA::Histo1D& h) {
+      BinHisto::Object bo;
+      bo.kind = BinHisto::HISTO1D;
+      bo.path = h.path();
+      bo.annotations = annotationLines(h);
+      bo.scaledBy = h.hasAnnotation("ScaledBy") ? std::stod(h.annotation("ScaledBy")) : 1.;
+      for (size_t i = 0; i < h.numBins(); i++) bo.edges.push_back(h.bin(i).xMin());
+      bo.edges.push_back(h.bin(h.numBins() - 1).xMax());
+      bo.resize();
+      setSlot(bo, BinHisto::TOTAL, h.totalDbn());
+      setSlot(bo, BinHisto::UNDERFLOW, h.underflow());
+      setSlot(bo, BinHisto::OVERFLOW, h.overflow());
+      for (size_t i = 0; i < h.numBins(); i++) setSlot(bo, BinHisto::FIRSTBIN + i, h.bin(i).dbn());
+      return bo;
+    }
+
+    static YODA::Dbn1D slotDbn(const BinHisto::Object& bo, size_t slot) {
+      return YODA::Dbn1D(bo.at(BinHisto::NUMENTRIES, slot), bo.at(BinHisto::SUMW, slot), bo.at(BinHisto::SUMW2, slot),
+                         bo.at(BinHisto::SUMWX, slot), bo.at(BinHisto::SUMWX2, slot));
+    }
+
+    std::vector<BinHisto::Object> binaryObjects() const {
+      std::vector<BinHisto::Object> objects;
+      for (const auto& h : persistentObjects<YODA::Histo1D>(_aos)) {
+        if (h->numBins() > 0) objects.push_back(histoObject(*h));
+      }
+      for (const auto& c : persistentObjects<YODA::Counter>(_aos)) {
+        BinHisto::Object bo;
+        bo.kind = BinHisto::COUNTER;
+        bo.path = c->path();
+        bo.annotations = annotationLines(*c);
+        bo.resize();
+        bo.at(BinHisto::SUMW, 0) = c->sumW();
+        bo.at(BinHisto::SUMW2, 0) = c->sumW2();
+        bo.at(BinHisto::NUMENTRIES, 0) = c->numEntries();
+        objects.push_back(bo);
+      }
+      _projections.apply(objects);
+      return objects;
+    }
+
+    // Projected histograms of the weight being finalized, as written by Rivet
+    void projectActive() {
+      if (_projections.empty()) return;
+      std::vector<std::shared_ptr<YODA::Histo1D> > histos;
+      std::vector<BinHisto::Object> objects;
+      for (const Rivet::MultiweightAOPtr& ao : _aos) {
+        std::shared_ptr<YODA::Histo1D> h = std::dynamic_pointer_cast<YODA::Histo1D>(ao.get()->activeYODAPtr());
+        if (!h || h->numBins() == 0) continue;
+        histos.push_back(h);
+        objects.push_back(histoObject(*h));
+      }
+      try {
+        _projections.apply(objects);
+      }
+      catch (const std::exception& e) {
+        std::cerr << _name << ": " << e.what() << std::endl;
+        return;
+      }
+      for (size_t i = 0; i < objects.size(); i++) {
+        if (!_projections.isTarget(objects[i].path)) continue;
+        YODA::Histo1D& h = *histos[i];
+        h.totalDbn() = slotDbn(objects[i], BinHisto::TOTAL);
+        h.underflow() = slotDbn(objects[i], BinHisto::UNDERFLOW);
+        h.overflow() = slotDbn(objects[i], BinHisto::OVERFLOW);
+        for (size_t b = 0; b < h.numBins(); b++) h.bin(b).dbn() = slotDbn(objects[i], BinHisto::FIRSTBIN + b);
+      }
+    }
+
+    void writeBinary() const {
+      const std::vector<BinHisto::Object> objects = binaryObjects();
+      try {
+        BinHisto::write(_binpath, objects);
+        std::cout << _name << ": wrote " << objects.size() << " objects to " << _binpath << std::endl;
+      }
+      catch (const std::exception& e) {
+        std::cerr << _name << ": " << e.what() << std::endl;
+      }
+    }
+
+    void restore() {
+      std::map<std::string, YODA::AnalysisObject*> saved;
+      std::vector<YODA::AnalysisObject*> aos = YODA::read(_ckptpath);
+      for (YODA::AnalysisObject* ao : aos) saved[ao->path()] = ao;
+
+      for (const auto& h : persistentObjects<YODA::Histo1D>(_aos)) {
+        YODA::Histo1D* src = saved.count(h->path()) ? dynamic_cast<YODA::Histo1D*>(saved[h->path()]) : nullptr;
+        if (src) *h = *src;
+      }
+      for (const auto& c : persistentObjects<YODA::Counter>(_aos)) {
+        YODA::Counter* src = saved.count(c->path()) ? dynamic_cast<YODA::Counter*>(saved[c->path()]) : nullptr;
+        if (src) *c = *src;
+      }
+      for (const auto& c : _counters) {
+        YODA::Counter* src = saved.count(counterPath(c.first)) ? dynamic_cast<YODA::Counter*>(saved[counterPath(c.first)]) : nullptr;
+        if (src) *c.second = src->sumW();
+      }
+      YODA::Counter* nevt = saved.count(counterPath("events")) ? dynamic_cast<YODA::Counter*>(saved[counterPath("events")]) : nullptr;
+      if (nevt) _skip = size_t(nevt->sumW() + 0.5);
+
+      for (YODA::AnalysisObject* ao : aos) delete ao;
+      std::cout << _name << ": resumed from " << _ckptpath << ", skipping the first "
+                << _skip << " events" << std::endl;
+    }
+
+    std::string _name, _ckptpath, _binpath;
+    std::vector<Rivet::MultiweightAOPtr> _aos;
+    std::vector<std::pair<std::string, double*> > _counters;
+    size_t _nevt, _skip, _every, _snapshotEvery, _settings;
+    Centrality::Classes* _centrality;
+    Rivet::Histo1DPtr* _centcount;
+    Skim::Filter* _skim;
+    Rivet::Histo1DPtr* _skimcount;
+    SlowEvents::Recorder _slow;
+    Precision::Monitor _precision;
+    Snapshot::Publisher _snapshot;
+    Bootstrap::Replicas _bootstrap;
+    Master::Projections _projections;
+  };
+
+}
+
+#endif
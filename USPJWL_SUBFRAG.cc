@@ -14,6 +14,16 @@
 #include "Rivet/Projections/JetShape.hh"
 #include "Rivet/Projections/SubtractedJewelEvent.hh"
 #include "Rivet/Projections/SubtractedJewelFinalState.hh"
+#include "USPJWL_JetStore.hh"
+#include "USPJWL_Skim.hh"
+#include "USPJWL_Runtime.hh"
+#include "USPJWL_Arena.hh"
+#include "USPJWL_Kernels.hh"
+#include "USPJWL_Timing.hh"
+#include "USPJWL_AllocProfile.hh"
+#include "USPJWL_Subtraction.hh"
+#include "USPJWL_Centrality.hh"
+#include "USPJWL_SoftDrop.hh"
 #include <string>
 
 namespace Rivet {
@@ -27,8 +37,30 @@ namespace Rivet {
     /// Constructor
     DEFAULT_RIVET_ANALYSIS_CTOR(USPJWL_SUBFRAG);
 
+    /// Soft Drop histograms of one grooming setting
+    struct Groomed {
+      Histo1DPtr zg, rg, mass, nsd;
+    };
+
+    /// Histograms of one subtraction setting
+    struct Histos {
+      Histo1DPtr zfull_1, zhigh_1, zhighd_1, zcustom_1,
+                 zfull_2, zhigh_2, zhighd_2, zcustom_2,
+                 jetcount;
+
+      // Leading z_r in the jet pT classes [0, 100], (100, 120), [120, inf) GeV,
+      // from which High, HighD and Custom are projected
+      Histo1DPtr zlead_1[3], zlead_2[3];
+
+      std::vector<Groomed> sd;
+    };
+
+
     void init() {
 
+      // Allocations charged to this analysis, with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh)
+      USPJWL_ALLOC_SCOPE(name(), INIT);
+
       // Subjet fragmentation based on arXiv:2204.10270 (hepdata: https://www.hepdata.net/record/ins2070434)
 
       // Grab variable jet R parameter from environment, default value of 0.4
@@ -40,100 +72,212 @@ namespace Rivet {
       // abseta range on ALICE TPC:
       Cut cut(Cuts::abseta < 0.9);
 
-      SubtractedJewelEvent sev(1.0);
-      SubtractedJewelFinalState fs(sev, cut);
-      declare(fs, "FS");
-      ChargedFinalState cfs(fs);
-      declare(cfs, "CFS");
+      // One subtraction and jet definition per setting of USPJWL_SUBTRACTION, and
+      // one histogram set per setting and centrality class (see USPJWL_Runtime.hh)
+      _centrality.configure(name());
+      _subtraction.configure(name());
+      _softdrop.configure(name());
+      _sets.resize(_centrality.size() * _subtraction.size());
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        SubtractedJewelEvent sev(_subtraction.parameter(c));
+        SubtractedJewelFinalState fs(sev, cut);
+        declare(fs, _subtraction.name("FS", c));
+        ChargedFinalState cfs(fs);
+        declare(cfs, _subtraction.name("CFS", c));
+
+        FastJets cfj(cfs, FastJets::ANTIKT, RJETS_f);
+        declare(cfj, _subtraction.name("ChargedJets", c));
+
+        for (size_t k = 0; k < _centrality.size(); k++) {
+          bookSet(_sets[k * _subtraction.size() + c], _subtraction.tag(c) + _centrality.tag(k));
+        }
+      }
+
+      // Events of each centrality class, for the per-class normalisation
+      if (_centrality.enabled()) {
+        book(_centcount, "Centrality_counter", _centrality.size(), -0.5, _centrality.size() - 0.5);
+      }
+      _runtime.route(_centrality, _subtraction.size(), _centcount);
+
+      // Events rejected (bin 0) and accepted (bin 1) by the pre-filter
+      _skim.configure(RJETS_f, 0.9, 80 * GeV);
+      book(_skimcount, "Skim_counter_R" + RJETS, 2, -0.5, 1.5);
+      _runtime.prefilter(_skim, _skimcount);
+
+      // Optional per-jet output for re-binning without rerunning (see USPJWL_JetStore.hh)
+      if (getenv("USPJWL_JETSTORE")) {
+        _jetstore.open(std::string(getenv("USPJWL_JETSTORE")) + "_" + name() + "_R" + RJETS + ".jets");
+      }
+
+
+      // Checkpointing and resume (see USPJWL_Runtime.hh)
+      _runtime.init(*this, analysisObjects());
+    }
 
-      FastJets cfj(cfs, FastJets::ANTIKT, RJETS_f);
-      declare(cfj, "ChargedJets");
 
-      // Book histograms
+    // Book histograms, tag is appended to every name
+    void bookSet(Histos& hs, const std::string& tag) {
       // Full: pp analysis, High: 80 < pT < 120 GeV, HighD: 100 < pT < 150 GeV, 
       // Custom: very detailed and full range 
       // for each r = [0.1, 0.2]
 
-      book(zfull_1,"z_Full_r01", PTEDGES_FULL);
-      book(zhigh_1,"z_High_r01", PTEDGES_HIGH);
-      book(zhighd_1,"z_HighD_r01", PTEDGES_HIGHD);
-      book(zcustom_1,"z_Custom_r01", 25, 0.50001, 1.00001);
-
-      book(zfull_2,"z_Full_r02", PTEDGES_FULL);
-      book(zhigh_2,"z_High_r02", PTEDGES_HIGH);
-      book(zhighd_2,"z_HighD_r02", PTEDGES_HIGHD);
-      book(zcustom_2,"z_Custom_r02", 25, 0.50001, 1.00001);
+      book(hs.zfull_1,"z_Full_r01" + tag, PTEDGES_FULL);
+      book(hs.zhigh_1,"z_High_r01" + tag, PTEDGES_HIGH);
+      book(hs.zhighd_1,"z_HighD_r01" + tag, PTEDGES_HIGHD);
+      book(hs.zcustom_1,"z_Custom_r01" + tag, 25, 0.50001, 1.00001);
+
+      book(hs.zfull_2,"z_Full_r02" + tag, PTEDGES_FULL);
+      book(hs.zhigh_2,"z_High_r02" + tag, PTEDGES_HIGH);
+      book(hs.zhighd_2,"z_HighD_r02" + tag, PTEDGES_HIGHD);
+      book(hs.zcustom_2,"z_Custom_r02" + tag, 25, 0.50001, 1.00001);
+
+      // Only the leading z_r of each jet pT class is filled, on the union of the
+      // High, HighD and Custom edges; those are their sums at finalize (see USPJWL_Master.hh)
+      static const char* PTCLASSES[] = {"_0_100", "_100_120", "_120_inf"};
+      for (int i = 0; i < 3; i++) {
+        book(hs.zlead_1[i],"z_Lead_r01" + std::string(PTCLASSES[i]) + tag, ZLEAD_EDGES);
+        book(hs.zlead_2[i],"z_Lead_r02" + std::string(PTCLASSES[i]) + tag, ZLEAD_EDGES);
+      }
+      for (const std::string r : {"_r01", "_r02"}) {
+        const std::string low = "z_Lead" + r + PTCLASSES[0] + tag, mid = "z_Lead" + r + PTCLASSES[1] + tag,
+                          high = "z_Lead" + r + PTCLASSES[2] + tag;
+        _runtime.project("z_High" + r + tag, {low, mid});
+        _runtime.project("z_HighD" + r + tag, {mid, high});
+        _runtime.project("z_Custom" + r + tag, {low, mid, high});
+      }
       
       // Counter for a better control on the inclusive and full range normalizations
       // First bin (0): 80 < pT < 120 GeV, second bin (1): 100 < pT < 150 GeV
-      book(jetcount, "Number_Jets", 2, -0.5, 1.5);
-
+      book(hs.jetcount, "Number_Jets" + tag, 2, -0.5, 1.5);
+
+      // z_g, R_g, groomed mass and n_SD of the same jets, per Soft Drop setting
+      // (see USPJWL_SoftDrop.hh)
+      hs.sd.resize(_softdrop.size());
+      for (size_t i = 0; i < _softdrop.size(); i++) {
+        const std::string sd = _softdrop.tag(i) + tag;
+        book(hs.sd[i].zg, "zg" + sd, 20, 0., 0.5);
+        book(hs.sd[i].rg, "Rg" + sd, 20, 0., RJETS_f);
+        book(hs.sd[i].mass, "mg" + sd, 40, 0., 40.);
+        book(hs.sd[i].nsd, "nSD" + sd, 15, -0.5, 14.5);
+      }
     }
 
 
     /// Perform the per-event analysis
     void analyze(const Event& evt) {
 
+      // Timers, resumed events, centrality class and pre-filter (see USPJWL_Runtime.hh)
+      USPJWL::Runtime::Event event(_runtime, evt, _profile);
+      if (event.set() < 0) vetoEvent;
+
+      // Per-event scratch memory, released when the event is done
+      USPJWL::Arena::EventScope scratch(_arena);
+
+      for (size_t c = 0; c < _subtraction.size(); c++) {
+        analyzeSetting(evt, c, _sets[event.set() + c]);
+      }
+    }
+
+
+    // Observables of subtraction setting c, filled into hs
+    void analyzeSetting(const Event& evt, size_t c, Histos& hs) {
+      // Charged to its own stage instead of the first apply<FastJets>
+      USPJWL_TIME_AHEAD(_profile, "subtracted final state", apply<FinalState>(evt, _subtraction.name("FS", c)));
+
       // Get jets of event
       double etamax = 0.9 - RJETS_f;
       Cut jetcuts = Cuts::pT > 80 * GeV && Cuts::pT < 150 * GeV 
                     && Cuts::abseta < etamax;
 
       const vector<double> rs = {0.1, 0.2};
-      const Jets& jets = apply<FastJets>(evt, "ChargedJets").jetsByPt(jetcuts);
+      const FastJets& fj = USPJWL_TIMED(_profile, "clustering", apply<FastJets>(evt, _subtraction.name("ChargedJets", c)));
+      const Jets& jets = USPJWL_TIMED(_profile, "jetsByPt", fj.jetsByPt(jetcuts));
  
+      const bool store = c == 0 && _jetstore.isOpen();
       for (const Jet& j : jets) {
+        USPJWL_TIME_SCOPE(_profile, "jet");
+
         // Apply jet algorithm on jets constituents to calculate z_r
        
-	Particles jetconsti = j.constituents();
+	Particles jetconsti = USPJWL_TIMED(_profile, "constituents", j.constituents());
         double jpt = j.pT();
 
+        // Converted once for both subjet radii
+        PseudoJets jetpseudo;
+        jetpseudo.reserve(jetconsti.size());
+        for (const Particle& p : jetconsti) jetpseudo.push_back(p.pseudojet());
+
+        if (store) {
+          _jetstore.beginJet(evt.genEvent()->event_number(), evt.weights()[0], RJETS_f, j);
+        }
+
+        // One C/A reclustering serves every Soft Drop setting; jets without a
+        // tagged splitting go to the z_g and R_g underflow
+        {
+          USPJWL_TIME_SCOPE(_profile, "soft drop");
+          _sdtree.build(jetpseudo);
+          for (size_t i = 0; i < _softdrop.size(); i++) {
+            const USPJWL::SoftDrop::Result sd = _sdtree.groom(_softdrop[i], RJETS_f);
+            hs.sd[i].zg -> fill(sd.zg);
+            hs.sd[i].rg -> fill(sd.rg);
+            hs.sd[i].mass -> fill(sd.mass / GeV);
+            hs.sd[i].nsd -> fill(sd.nsd);
+          }
+        }
+
         //std::cout << "\nJet pt = " << jpt << std::endl;
 
         for (double r : rs) {
  
           // Apply jet algorithm on jets constituents to calculate z_r
           // using the fastjet classes (arXiv:1111.6097)
-          JetDefinition def_subjet(fastjet::kt_algorithm, r);
-          ClusterSequence cs(jetconsti, def_subjet);
-
-          // Grab leading subjet
-          PseudoJets subjets = sorted_by_pt(cs.inclusive_jets());
-          PseudoJet lead_subjet = subjets[0];
+          // Subjet pTs come sorted, leading first (see USPJWL_Kernels.hh)
+          USPJWL::ScratchVector<double> subjets(_arena);
+          USPJWL_TIMED(_profile, "subjet reclustering", USPJWL::Kernels::ktSubjetPts(jetpseudo, r, subjets));
 
-          double z_lead = lead_subjet.perp() / jpt;
+          double z_lead = subjets[0] / jpt;
 
           //std::cout << "z lead = " << z_lead << std::endl;
 
-          vector<Histo1DPtr> histos;
+          if (store) {
+            _jetstore.set(r == 0.1 ? USPJWL::JetStore::ZLEAD_R01 : USPJWL::JetStore::ZLEAD_R02, z_lead);
+          }
+
+          USPJWL::ScratchVector<Histo1DPtr> histos(_arena);
           if (r == 0.1) { 
-            histos = {zfull_1, zhigh_1, zhighd_1, zcustom_1}; 
+            histos.assign({hs.zfull_1, hs.zlead_1[0], hs.zlead_1[1], hs.zlead_1[2]}); 
           }
           else { 
-            histos = {zfull_2, zhigh_2, zhighd_2, zcustom_2}; 
+            histos.assign({hs.zfull_2, hs.zlead_2[0], hs.zlead_2[1], hs.zlead_2[2]}); 
           } 
 
-          // Select correct histogram
+          // Select correct jet pT class: High (pT < 120 GeV), HighD (pT > 100 GeV)
+          // and Custom (all pT) are projected from the classes at finalize
+          histos[jpt <= 100 * GeV ? 1 : jpt < 120 * GeV ? 2 : 3] -> fill(z_lead);
+
           if (jpt < 120 * GeV) { 
-            histos[1] -> fill(z_lead);
-            jetcount -> fill(0.);
+            hs.jetcount -> fill(0.);
           }
           
           if (jpt > 100 * GeV) {
-            histos[2] -> fill(z_lead);
-            jetcount -> fill(1.);
+            hs.jetcount -> fill(1.);
           }
-          
-          // Fill Custom for all pt
-          histos[3] -> fill(z_lead);
 
           // Inclusive calculation
-          for (auto subj : subjets) {
-            double z = subj.perp() / jpt;
+          for (double subjpt : subjets) {
+            double z = subjpt / jpt;
             //std::cout << "z = " << z << std::endl;
             histos[0] -> fill(z);
+
+            if (store) {
+              _jetstore.addZ(r == 0.1 ? 0 : 1, z);
+            }
           }
         }
+
+        if (store) {
+          _jetstore.endJet();
+        }
       }
 
     }
@@ -141,24 +285,38 @@ namespace Rivet {
 
     void finalize() {
       // Scale only after yoda merge
+      _jetstore.close();
+      _runtime.finalize();
+      _profile.report(name());
+      USPJWL_ALLOC_REPORT(name(), analysisObjects());
     }
 
 
     /// @name Histograms
-    // R_AA
-    Histo1DPtr zfull_1, zhigh_1, zhighd_1, zcustom_1,
-               zfull_2, zhigh_2, zhighd_2, zcustom_2,
-               jetcount;
+    std::vector<Histos> _sets;
+    USPJWL::Subtraction::Settings _subtraction;
+    USPJWL::Centrality::Classes _centrality;
+    USPJWL::SoftDrop::Settings _softdrop;
+    USPJWL::SoftDrop::Tree _sdtree;
+
+    Histo1DPtr _skimcount, _centcount;
+    USPJWL::Skim::Filter _skim;
+    USPJWL::Runtime _runtime;
+    USPJWL::Timing::Profile _profile;
+    USPJWL::Arena _arena;
 
 
     double RJETS_f;
     std::string RJETS;
+    USPJWL::JetStore::Writer _jetstore;
 
     std::vector<double> PTEDGES_FULL = {0., 0.02, 0.04, 0.1, 0.3, 0.6, 0.7, 
                                         0.77, 0.83, 0.89, 0.95, 1.00001};
     std::vector<double> PTEDGES_HIGH = {0.6, 0.7, 0.77, 0.83, 0.89, 0.95, 1.00001}; 
     std::vector<double> PTEDGES_HIGHD = {0.7, 0.75, 0.77, 0.8, 0.83, 0.86, 0.9, 
                                         0.92, 0.95, 0.98, 1.00001};
+    std::vector<double> ZLEAD_EDGES = USPJWL::Master::unionEdges({PTEDGES_HIGH, PTEDGES_HIGHD,
+                                                                  USPJWL::Master::linearEdges(25, 0.50001, 1.00001)});
 
     
 
@@ -0,0 +1,149 @@
+// -*- C++ -*-
+
+// Conservative event pre-filter for the USPJWL analyses.
+//
+// Before any subtraction or clustering, the unsubtracted final state is
+// summed into a coarse rapidity-phi tower grid. The scalar pT sum of the
+// towers in a square window around any possible jet axis bounds the pT of
+// every jet of radius R from above, since
+//  - |sum of constituent momenta| <= sum of constituent pT,
+//  - the constituent subtraction only removes pT from particles,
+//  - anti-kt constituents lie within R of the jet axis in (y, phi), the
+//    coordinates the clustering uses; the window spans one extra tower on
+//    each side to absorb the recombination drift,
+//  - a particle in the |eta| acceptance of the analysis has |y| <= |eta|,
+//    so the towers with |y| below the acceptance hold all of them.
+// An event whose largest window sum is below the analysis jet threshold
+// cannot fill any jet histogram and is skipped.
+//
+// Every analysis builds its own grid for each event; the analyses are
+// separate plugins, and no key on the HepMC record reliably tells two
+// events apart (drivers reuse the record, event numbers repeat across
+// inputs), so a grid is never reused for the next event.
+// Set USPJWL_SKIM=0 to disable the filter.
+
+#ifndef USPJWL_SKIM_HH
+#define USPJWL_SKIM_HH
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Skim {
+
+    // Grid covering the widest USPJWL acceptance, |y| < 3.2
+    const double ETAMAX = 3.2;
+    const int NETA = 64;
+    const int NPHI = 64;
+    const double DETA = 2 * ETAMAX / NETA;
+    const double DPHI = 2 * M_PI / NPHI;
+
+
+    // Scalar pT sums of the final-state particles in rapidity-phi towers
+    class TowerGrid {
+    public:
+
+      TowerGrid() : _pt(NETA * NPHI, 0.) {}
+
+      void build(const HepMC::GenEvent* ge) {
+        std::fill(_pt.begin(), _pt.end(), 0.);
+
+        for (HepMC::GenEvent::particle_const_iterator it = ge->particles_begin(); it != ge->particles_end(); ++it) {
+          if ((*it)->status() != 1) continue;
+          const HepMC::FourVector& p = (*it)->momentum();
+          double pt = p.perp();
+          if (pt <= 0) continue;
+          // Rapidity from the four-momentum; eta where rounding leaves E <= |pz|
+          double y = p.e() > std::fabs(p.pz()) ? 0.5 * std::log((p.e() + p.pz()) / (p.e() - p.pz())) : p.eta();
+          if (std::fabs(y) >= ETAMAX) continue;
+          double phi = p.phi();
+          if (phi < 0) phi += 2 * M_PI;
+          int ieta = std::min(NETA - 1, std::max(0, int((y + ETAMAX) / DETA)));
+          int iphi = std::min(NPHI - 1, std::max(0, int(phi / DPHI)));
+          _pt[ieta * NPHI + iphi] += pt;
+        }
+      }
+
+      // Upper bound on the pT of any jet of radius R built from particles with |eta| < etaacc
+      double maxJetPt(double R, double etaacc) {
+        // Towers overlapping |y| < etaacc are taken in full
+        int ietamin = std::max(0, int(std::floor((ETAMAX - etaacc) / DETA)));
+        int ietamax = std::min(NETA, int(std::ceil((ETAMAX + etaacc) / DETA)));
+        int neta = ietamax - ietamin;
+        int keta = std::min(neta, 2 * (int(std::ceil(R / DETA)) + 1) + 1);
+        int kphi = std::min(NPHI, 2 * (int(std::ceil(R / DPHI)) + 1) + 1);
+        if (neta <= 0) return 0.;
+
+        // Prefix sums over eta and (wrapped) phi, in storage kept across calls
+        const int nphiext = NPHI + kphi;
+        std::vector<double>& sum = _sum;
+        sum.assign((neta + 1) * (nphiext + 1), 0.);
+        for (int i = 0; i < neta; i++) {
+          for (int j = 0; j < nphiext; j++) {
+            sum[(i + 1) * (nphiext + 1) + j + 1] = _pt[(ietamin + i) * NPHI + j % NPHI]
+              + sum[i * (nphiext + 1) + j + 1] + sum[(i + 1) * (nphiext + 1) + j]
+              - sum[i * (nphiext + 1) + j];
+          }
+        }
+
+        double best = 0.;
+        for (int i = 0; i + keta <= neta; i++) {
+          for (int j = 0; j < NPHI; j++) {
+            double window = sum[(i + keta) * (nphiext + 1) + j + kphi] - sum[i * (nphiext + 1) + j + kphi]
+                            - sum[(i + keta) * (nphiext + 1) + j] + sum[i * (nphiext + 1) + j];
+            best = std::max(best, window);
+          }
+        }
+        return best;
+      }
+
+    private:
+
+      std::vector<double> _pt;
+      std::vector<double> _sum;
+    };
+
+
+    // Per-analysis filter: jet radius, particle acceptance and jet pT threshold
+    class Filter {
+    public:
+
+      Filter() : _enabled(false), _R(0.4), _etaacc(ETAMAX), _ptmin(0.) {}
+
+      void configure(double R, double etaacc, double ptmin) {
+        const char* env = getenv("USPJWL_SKIM");
+        _enabled = !(env && std::string(env) == "0");
+        _R = R;
+        _etaacc = etaacc;
+        _ptmin = ptmin;
+      }
+
+      bool enabled() const { return _enabled; }
+
+      // False if no jet in the event can reach the threshold
+      bool accept(const HepMC::GenEvent* ge) {
+        if (!_enabled) return true;
+        _grid.build(ge);
+        // Small margin for the different summation order of the jet momentum
+        return _grid.maxJetPt(_R, _etaacc) * (1 + 1e-9) >= _ptmin;
+      }
+
+    private:
+
+      bool _enabled;
+      double _R, _etaacc, _ptmin;
+      TowerGrid _grid;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+// -*- C++ -*-
+
+// Capture of the slowest events of an analysis for outlier diagnosis.
+//
+// With USPJWL_SLOWEVENTS=<prefix> every analyze() call is timed and the
+// USPJWL_SLOWEVENTS_K slowest events (default 20) are kept as copies.
+// At finalize they are written, slowest first, to
+//   <prefix>_<ANALYSIS>.slow.hepmc   HepMC IO_GenEvent file
+//   <prefix>_<ANALYSIS>.slow.txt     time, final-state multiplicity and
+//                                    number of scattering centres of each
+// and the median time over all events is printed for comparison.
+// tools/uspjwl-replay runs an analysis on the .hepmc file alone, repeated
+// as often as a profiler needs.
+//
+// Usage, as the first line of analyze():
+//   USPJWL::SlowEvents::Timer timer(_runtime.slowEvents(), evt);
+// The Recorder is owned and configured by USPJWL::Runtime. When it is not
+// enabled the Timer does nothing but a branch.
+
+#ifndef USPJWL_SLOWEVENTS_HH
+#define USPJWL_SLOWEVENTS_HH
+
+#include "Rivet/Analysis.hh"
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+#include "HepMC/IO_GenEvent.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace SlowEvents {
+
+    struct Entry {
+      double seconds;
+      int number;
+      size_t nFinal, nCentres;
+      std::shared_ptr<HepMC::GenEvent> event;
+
+      // Heap order: the fastest kept event on top
+      bool operator<(const Entry& o) const { return seconds > o.seconds; }
+    };
+
+
+    class Recorder {
+    public:
+
+      Recorder() : _k(0) {}
+
+      void configure(const std::string& name, const std::string& prefix, size_t k) {
+        _name = name;
+        _path = prefix + "_" + name + ".slow";
+        _k = k;
+        std::cout << _name << ": keeping the " << _k << " slowest events for " << _path << ".hepmc" << std::endl;
+      }
+
+      bool enabled() const { return _k > 0; }
+
+      void record(const HepMC::GenEvent& ge, double seconds) {
+        _times.push_back(float(seconds));
+        if (_top.size() == _k && seconds <= _top.front().seconds) return;
+
+        Entry e;
+        e.seconds = seconds;
+        e.number = ge.event_number();
+        e.nFinal = e.nCentres = 0;
+        for (HepMC::GenEvent::particle_const_iterator p = ge.particles_begin(); p != ge.particles_end(); ++p) {
+          // JEWEL keeps the thermal scattering centres with status 3
+          if ((*p)->status() == 1) e.nFinal++;
+          else if ((*p)->status() == 3) e.nCentres++;
+        }
+        e.event = std::make_shared<HepMC::GenEvent>(ge);
+
+        _top.push_back(e);
+        std::push_heap(_top.begin(), _top.end());
+        if (_top.size() > _k) {
+          std::pop_heap(_top.begin(), _top.end());
+          _top.pop_back();
+        }
+      }
+
+      void write() {
+        if (!enabled() || _times.empty()) return;
+
+        std::vector<Entry> slowest = _top;
+        std::sort(slowest.begin(), slowest.end(), [](const Entry& a, const Entry& b) { return a.seconds > b.seconds; });
+        std::vector<float> times = _times;
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        const double median = times[times.size() / 2];
+
+        {
+          HepMC::IO_GenEvent out(_path + ".hepmc", std::ios::out);
+          for (const Entry& e : slowest) out.write_event(e.event.get());
+        }
+
+        std::ofstream txt(_path + ".txt");
+        txt << "# " << _name << ": " << slowest.size() << " slowest of " << _times.size()
+            << " events, median " << 1e3 * median << " ms\n";
+        txt << "# rank event ms x_median n_final n_centres\n";
+        for (size_t i = 0; i < slowest.size(); i++) {
+          const Entry& e = slowest[i];
+          char line[160];
+          std::snprintf(line, sizeof(line), "%zu %d %.3f %.1f %zu %zu\n", i, e.number, 1e3 * e.seconds,
+                        median > 0 ? e.seconds / median : 0., e.nFinal, e.nCentres);
+          txt << line;
+        }
+
+        std::cout << _name << ": median " << 1e3 * median << " ms/event, slowest " << 1e3 * slowest.front().seconds
+                  << " ms; wrote " << slowest.size() << " events to " << _path << ".hepmc" << std::endl;
+      }
+
+    private:
+      std::string _name, _path;
+      size_t _k;
+      std::vector<float> _times;
+      std::vector<Entry> _top;
+    };
+
+
+    // Times one analyze() call, including early returns
+    class Timer {
+    public:
+
+      Timer(Recorder& recorder, const Rivet::Event& evt) : _recorder(recorder), _evt(evt) {
+        if (_recorder.enabled()) _start = std::chrono::steady_clock::now();
+      }
+
+      ~Timer() {
+        if (!_recorder.enabled()) return;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+        _recorder.record(*_evt.genEvent(), seconds);
+      }
+
+      Timer(const Timer&) = delete;
+      Timer& operator=(const Timer&) = delete;
+
+    private:
+      Recorder& _recorder;
+      const Rivet::Event& _evt;
+      std::chrono::steady_clock::time_point _start;
+    };
+
+  }
+
+}
+
+#endif
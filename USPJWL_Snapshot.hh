@@ -0,0 +1,208 @@
+// -*- C++ -*-
+
+// Live histogram snapshots in POSIX shared memory, for looking at a
+// running job.
+//
+// With USPJWL_SNAPSHOT=<tag> every analysis publishes its unscaled booked
+// histograms and counters every USPJWL_SNAPSHOT_EVERY events (default
+// 1000) into the segment /dev/shm/uspjwl_<tag>_<ANALYSIS>, in the .ybin
+// layout of USPJWL_BinHisto.hh. tools/uspjwl-inspect lists the segments
+// and reads them.
+//
+// Segment layout:
+//   Header                     magic, pid, capacity, latest complete buffer
+//   Buffer, data[capacity]     buffer 0
+//   Buffer, data[capacity]     buffer 1
+// The writer fills the buffer that is not the latest, bracketing the copy
+// with an odd and an even sequence number, then makes it the latest. A
+// reader copies the latest buffer and retries if its sequence number was
+// odd or changed meanwhile (a seqlock), so the event loop never waits for
+// readers and readers never see a half-written snapshot. The segment is
+// removed at finalize.
+
+#ifndef USPJWL_SNAPSHOT_HH
+#define USPJWL_SNAPSHOT_HH
+
+#include "USPJWL_BinHisto.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace USPJWL {
+
+  namespace Snapshot {
+
+    const char MAGIC[8] = {'U', 'S', 'P', 'J', 'W', 'L', 'S', 'N'};
+    const uint32_t VERSION = 1;
+
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t pid;
+      uint64_t capacity;               // data bytes per buffer
+      std::atomic<uint64_t> latest;    // buffer holding the newest snapshot
+      std::atomic<uint64_t> published; // number of snapshots written
+    };
+
+    struct Buffer {
+      std::atomic<uint64_t> seq;       // odd while being written
+      uint64_t bytes;
+      uint64_t events;
+      uint64_t padding;
+    };
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared-memory atomics must be lock-free");
+
+    inline size_t segmentBytes(uint64_t capacity) {
+      return sizeof(Header) + 2 * (sizeof(Buffer) + BinHisto::padTo8(capacity));
+    }
+
+    inline Buffer* buffer(Header* h, int i) {
+      char* base = reinterpret_cast<char*>(h + 1);
+      return reinterpret_cast<Buffer*>(base + i * (sizeof(Buffer) + BinHisto::padTo8(h->capacity)));
+    }
+
+    inline char* payload(Buffer* b) { return reinterpret_cast<char*>(b + 1); }
+    inline const char* payload(const Buffer* b) { return reinterpret_cast<const char*>(b + 1); }
+
+    inline std::string segmentName(const std::string& tag, const std::string& analysis) {
+      return "/uspjwl_" + tag + "_" + analysis;
+    }
+
+
+    class Publisher {
+    public:
+
+      Publisher() : _header(nullptr), _bytes(0), _warned(false) {}
+      ~Publisher() { close(); }
+
+      Publisher(const Publisher&) = delete;
+      Publisher& operator=(const Publisher&) = delete;
+
+      bool isOpen() const { return _header != nullptr; }
+
+      // The histograms are booked by now, so the first snapshot gives the size
+      void open(const std::string& name, const std::vector<char>& first) {
+        const uint64_t capacity = 2 * first.size() + 65536;
+        const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) throw std::runtime_error("Cannot create shared memory " + name + ": " + std::strerror(errno));
+        _bytes = segmentBytes(capacity);
+        void* p = MAP_FAILED;
+        if (ftruncate(fd, _bytes) == 0) p = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+          shm_unlink(name.c_str());
+          throw std::runtime_error("Cannot map shared memory " + name + ": " + std::strerror(errno));
+        }
+        _name = name;
+        _header = static_cast<Header*>(p);
+        _header->version = VERSION;
+        _header->pid = uint32_t(getpid());
+        _header->capacity = capacity;
+        _header->latest.store(0, std::memory_order_relaxed);
+        _header->published.store(0, std::memory_order_relaxed);
+        // Readers check the magic last
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+      }
+
+      void publish(const std::vector<char>& data, uint64_t events) {
+        if (!_header) return;
+        if (data.size() > _header->capacity) {
+          if (!_warned) std::fprintf(stderr, "%s: snapshot of %zu bytes does not fit, not updated\n", _name.c_str(), data.size());
+          _warned = true;
+          return;
+        }
+        const int next = int(1 - _header->latest.load(std::memory_order_relaxed));
+        Buffer* b = buffer(_header, next);
+        const uint64_t seq = b->seq.load(std::memory_order_relaxed);
+        b->seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(payload(b), data.data(), data.size());
+        b->bytes = data.size();
+        b->events = events;
+        b->seq.store(seq + 2, std::memory_order_release);
+        _header->latest.store(next, std::memory_order_release);
+        _header->published.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      void close() {
+        if (!_header) return;
+        munmap(_header, _bytes);
+        shm_unlink(_name.c_str());
+        _header = nullptr;
+      }
+
+    private:
+      std::string _name;
+      Header* _header;
+      size_t _bytes;
+      bool _warned;
+    };
+
+
+    struct Reading {
+      uint32_t pid = 0;
+      uint64_t events = 0;
+      uint64_t published = 0;
+      std::vector<char> data;     // .ybin image
+    };
+
+
+    // Copies the newest complete snapshot of a segment
+    inline Reading read(const std::string& name) {
+      const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+      if (fd < 0) throw std::runtime_error("Cannot open shared memory " + name + ": " + std::strerror(errno));
+      struct stat st;
+      void* p = MAP_FAILED;
+      if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Header))
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (p == MAP_FAILED) throw std::runtime_error("Cannot map shared memory " + name);
+
+      Header* h = static_cast<Header*>(p);
+      Reading r;
+      bool ok = std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0 && h->version == VERSION
+                && size_t(st.st_size) >= segmentBytes(h->capacity);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      for (int attempt = 0; ok; attempt++) {
+        if (attempt == 1000) {
+          ok = false;
+          break;
+        }
+        const int i = int(h->latest.load(std::memory_order_acquire));
+        const Buffer* b = buffer(h, i);
+        const uint64_t seq = b->seq.load(std::memory_order_acquire);
+        if (seq == 0) break;            // nothing published yet
+        if (seq & 1) continue;
+        const uint64_t bytes = b->bytes;
+        if (bytes > h->capacity) continue;
+        r.data.assign(payload(b), payload(b) + bytes);
+        r.events = b->events;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (b->seq.load(std::memory_order_relaxed) == seq) break;
+        r.data.clear();
+      }
+      r.pid = h->pid;
+      r.published = h->published.load(std::memory_order_relaxed);
+      munmap(p, st.st_size);
+      if (!ok) throw std::runtime_error("No consistent snapshot in " + name);
+      return r;
+    }
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+// -*- C++ -*-
+
+// Soft Drop grooming for several (z_cut, beta) settings from one
+// Cambridge/Aachen reclustering per jet.
+//
+// Tree::build() reclusters the constituents of a jet with C/A once and
+// keeps its primary declustering chain: from the full jet down the harder
+// branch, the pTs of the two branches, their distance and the mass of the
+// jet at each step. Soft Drop only ever follows this chain, so every
+// setting is a walk over a few numbers (groom()): the first step with
+//   min(pT1, pT2) / (pT1 + pT2) > z_cut (dR / R0)^beta
+// gives z_g, R_g = dR and the groomed mass, the mass of the jet at that
+// step; n_SD counts the steps along the chain that pass.
+//
+// USPJWL_SOFTDROP lists the settings as z_cut,beta pairs separated by ';'
+// (default "0.1,0;0.2,0;0.1,1;0.1,2"). Their histograms get the suffix of
+// tag(), e.g. Jet_Mass_60_80_SD0.1_0.
+
+#ifndef USPJWL_SOFTDROP_HH
+#define USPJWL_SOFTDROP_HH
+
+#include "fastjet/ClusterSequence.hh"
+#include "fastjet/PseudoJet.hh"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace SoftDrop {
+
+    struct Setting {
+      double zcut, beta;
+    };
+
+
+    class Settings {
+    public:
+
+      Settings() : _settings({{0.1, 0.}, {0.2, 0.}, {0.1, 1.}, {0.1, 2.}}) {}
+
+      void configure(const std::string& analysis) {
+        const char* env = getenv("USPJWL_SOFTDROP");
+        if (!env) return;
+        std::vector<Setting> settings;
+        std::istringstream in(env);
+        std::string item;
+        while (std::getline(in, item, ';')) {
+          if (item.empty()) continue;
+          const size_t comma = item.find(',');
+          if (comma == std::string::npos) throw std::invalid_argument("USPJWL_SOFTDROP entry is not z_cut,beta: " + item);
+          settings.push_back({std::stod(item.substr(0, comma)), std::stod(item.substr(comma + 1))});
+        }
+        _settings = settings;
+
+        std::cout << analysis << ": Soft Drop settings";
+        for (size_t i = 0; i < size(); i++) std::cout << " (" << _settings[i].zcut << ", " << _settings[i].beta << ")";
+        std::cout << std::endl;
+      }
+
+      size_t size() const { return _settings.size(); }
+      const Setting& operator[](size_t i) const { return _settings[i]; }
+
+      // Histogram name suffix of setting i
+      std::string tag(size_t i) const {
+        std::ostringstream s;
+        s << "_SD" << _settings[i].zcut << "_" << _settings[i].beta;
+        return s.str();
+      }
+
+    private:
+      std::vector<Setting> _settings;
+    };
+
+
+    // Soft Drop observables of one jet; z_g = R_g = -1 if no step passes,
+    // and the groomed mass is then that of the last constituent
+    struct Result {
+      double zg, rg, mass;
+      int nsd;
+    };
+
+
+    class Tree {
+    public:
+
+      // Reclusters one jet; the storage is kept for the next jet
+      void build(const std::vector<fastjet::PseudoJet>& constituents) {
+        _steps.clear();
+        _leafMass = 0.;
+        if (constituents.empty()) return;
+        fastjet::ClusterSequence cs(constituents, fastjet::JetDefinition(fastjet::cambridge_algorithm, CA_R));
+        const std::vector<fastjet::PseudoJet> jets = cs.exclusive_jets(1);
+        if (jets.empty()) return;
+        fastjet::PseudoJet j = jets[0], a, b;
+        while (j.has_parents(a, b)) {
+          if (a.pt2() < b.pt2()) std::swap(a, b);
+          const double pt1 = a.pt(), pt2 = b.pt();
+          _steps.push_back({pt2 / (pt1 + pt2), a.delta_R(b), j.m()});
+          j = a;
+        }
+        _leafMass = j.m();
+      }
+
+      size_t depth() const { return _steps.size(); }
+
+      // Soft Drop with jet radius r0
+      Result groom(const Setting& s, double r0) const {
+        Result r = {-1., -1., _leafMass, 0};
+        for (const Step& step : _steps) {
+          if (!(step.z > s.zcut * std::pow(step.dr / r0, s.beta))) continue;
+          if (r.nsd++ == 0) {
+            r.zg = step.z;
+            r.rg = step.dr;
+            r.mass = step.mass;
+          }
+        }
+        return r;
+      }
+
+    private:
+
+      // Larger than any distance within a jet: C/A merges everything
+      static constexpr double CA_R = 1000.;
+
+      struct Step {
+        double z, dr, mass;
+      };
+
+      std::vector<Step> _steps;
+      double _leafMass = 0.;
+    };
+
+  }
+
+}
+
+#endif
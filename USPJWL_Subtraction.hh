@@ -0,0 +1,78 @@
+// -*- C++ -*-
+
+// Several constituent-subtraction settings evaluated on the same event.
+//
+// USPJWL_SUBTRACTION lists the parameters passed to SubtractedJewelEvent,
+// comma separated (default "1.0", the value the analyses always used).
+// Every analysis declares one subtracted final state and jet projection
+// per setting and books one set of its subtraction-dependent histograms
+// per setting. The first setting keeps the usual histogram names, the
+// others get the suffix of tag(), e.g. JetpT_R0.4_SUB0.5.
+//
+// Per event, the HepMC conversion, the unsubtracted final state and the
+// pre-filter (USPJWL_Skim.hh) are done once; Rivet caches the projections
+// that the settings have in common, so only the subtraction itself and
+// what follows it is repeated per setting. Event-level counters that do
+// not depend on the subtraction, the per-jet output and the subtracted
+// final-state cache (USPJWL_FSCACHE) use the first setting only.
+
+#ifndef USPJWL_SUBTRACTION_HH
+#define USPJWL_SUBTRACTION_HH
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Subtraction {
+
+    class Settings {
+    public:
+
+      Settings() : _parameters(1, 1.0) {}
+
+      void configure(const std::string& analysis) {
+        const char* env = getenv("USPJWL_SUBTRACTION");
+        if (!env) return;
+        std::vector<double> parameters;
+        std::istringstream in(env);
+        std::string item;
+        while (std::getline(in, item, ',')) {
+          if (!item.empty()) parameters.push_back(std::stod(item));
+        }
+        if (parameters.empty()) return;
+        _parameters = parameters;
+
+        std::cout << analysis << ": subtraction settings";
+        for (size_t i = 0; i < size(); i++) std::cout << " " << parameter(i) << (i == 0 ? " (nominal names)" : "");
+        std::cout << std::endl;
+      }
+
+      size_t size() const { return _parameters.size(); }
+      double parameter(size_t i) const { return _parameters[i]; }
+
+      // Histogram name suffix, empty for the first setting
+      std::string tag(size_t i) const {
+        if (i == 0) return "";
+        std::ostringstream s;
+        s << "_SUB" << _parameters[i];
+        return s.str();
+      }
+
+      // Projection name of setting i
+      std::string name(const std::string& base, size_t i) const {
+        return i == 0 ? base : base + "_" + std::to_string(i);
+      }
+
+    private:
+      std::vector<double> _parameters;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,290 @@
+// -*- C++ -*-
+
+// Scoped timers for the stages of analyze(), compiled in only with
+// -DUSPJWL_PROFILE.
+//
+// Every analysis owns one Profile and marks its stages with
+//   USPJWL_TIME_SCOPE(_profile, "stage");              time to end of block
+//   x = USPJWL_TIMED(_profile, "stage", expression);   time one expression
+//   USPJWL_TIME_AHEAD(_profile, "stage", expression);  see below
+// Scopes opened inside another scope become its children, so finalize()
+// (_profile.report(name())) prints a tree with call counts, total and
+// per-call times, the share of the parent and the time not covered by
+// children ("self").
+// Rivet computes projections lazily on first use, so the subtraction of
+// the final state would otherwise be charged to whichever stage first asks
+// for jets. USPJWL_TIME_AHEAD applies it on its own first, and only in the
+// profiling build.
+//
+// Times are read with rdtsc where available (steady_clock otherwise) and
+// converted with the rate measured over the run. With USPJWL_PROFILE_PERF=1
+// (Linux) every scope also reads the hardware cycle and cache-miss counters
+// of the thread; this costs a system call per scope.
+//
+// Without USPJWL_PROFILE the macros expand to nothing (USPJWL_TIMED to its
+// expression) and Profile is an empty class.
+
+#ifndef USPJWL_TIMING_HH
+#define USPJWL_TIMING_HH
+
+#include <string>
+
+#ifdef USPJWL_PROFILE
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace USPJWL {
+
+  namespace Timing {
+
+    inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+
+    // CPU cycles and cache misses of the calling thread
+    class PerfCounters {
+    public:
+
+      PerfCounters() : _leader(-1), _misses(-1) {}
+      ~PerfCounters() { close(); }
+
+      PerfCounters(const PerfCounters&) = delete;
+      PerfCounters& operator=(const PerfCounters&) = delete;
+
+      bool open() {
+#ifdef __linux__
+        _leader = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (_leader >= 0) _misses = openCounter(PERF_COUNT_HW_CACHE_MISSES, _leader);
+        if (_misses < 0) close();
+#endif
+        return isOpen();
+      }
+
+      bool isOpen() const { return _leader >= 0; }
+
+      void read(uint64_t& cycles, uint64_t& misses) const {
+        cycles = misses = 0;
+#ifdef __linux__
+        // PERF_FORMAT_GROUP: number of counters, then their values
+        uint64_t buf[3];
+        if (::read(_leader, buf, sizeof(buf)) == ssize_t(sizeof(buf)) && buf[0] == 2) {
+          cycles = buf[1];
+          misses = buf[2];
+        }
+#endif
+      }
+
+    private:
+
+#ifdef __linux__
+      static int openCounter(uint64_t config, int group) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return int(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+      }
+#endif
+
+      void close() {
+#ifdef __linux__
+        if (_misses >= 0) ::close(_misses);
+        if (_leader >= 0) ::close(_leader);
+#endif
+        _leader = _misses = -1;
+      }
+
+      int _leader, _misses;
+    };
+
+
+    struct Node {
+      Node(const char* n, Node* p) : name(n), parent(p), calls(0), ticks(0), cycles(0), misses(0) {}
+
+      // Stage names are string literals, so the pointer usually matches
+      Node* child(const char* n) {
+        for (const std::unique_ptr<Node>& c : children) {
+          if (c->name == n || std::strcmp(c->name, n) == 0) return c.get();
+        }
+        children.emplace_back(new Node(n, this));
+        return children.back().get();
+      }
+
+      const char* name;
+      Node* parent;
+      uint64_t calls, ticks, cycles, misses;
+      std::vector<std::unique_ptr<Node> > children;
+    };
+
+
+    class Profile {
+    public:
+
+      Profile() : _root("", nullptr), _current(&_root), _perfChecked(false),
+                  _start(std::chrono::steady_clock::now()), _startTicks(ticks()) {}
+
+      Profile(const Profile&) = delete;
+      Profile& operator=(const Profile&) = delete;
+
+      Node* enter(const char* name) {
+        // Opened on first use, by the thread that runs the events
+        if (!_perfChecked) {
+          _perfChecked = true;
+          const char* env = getenv("USPJWL_PROFILE_PERF");
+          if (env && std::string(env) == "1" && !_perf.open()) {
+            std::cerr << "USPJWL profile: hardware counters unavailable (perf_event_open failed)" << std::endl;
+          }
+        }
+        _current = _current->child(name);
+        return _current;
+      }
+
+      void leave(Node* node) { _current = node->parent; }
+
+      const PerfCounters& perf() const { return _perf; }
+
+      void report(const std::string& analysis) const {
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - _start).count();
+        uint64_t dt = ticks() - _startTicks;
+        const double msPerTick = dt > 0 ? 1e-6 * ns / dt : 0.;
+
+        std::cout << analysis << ": profile (times in ms)" << std::endl;
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-40s %10s %12s %12s %7s", "stage", "calls", "total", "per call", "share");
+        std::cout << line;
+        if (_perf.isOpen()) std::cout << "  cycles/call  misses/call";
+        std::cout << std::endl;
+        for (const std::unique_ptr<Node>& c : _root.children) print(*c, 0, c->ticks, msPerTick);
+      }
+
+    private:
+
+      void print(const Node& node, int depth, uint64_t parentTicks, double msPerTick) const {
+        const std::string name = std::string(2 * depth, ' ') + node.name;
+        const double total = node.ticks * msPerTick;
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-40s %10llu %12.3f %12.6f %6.1f%%", name.c_str(), (unsigned long long)node.calls,
+                      total, node.calls ? total / node.calls : 0., parentTicks ? 100. * node.ticks / parentTicks : 0.);
+        std::cout << line;
+        if (_perf.isOpen() && node.calls) {
+          std::snprintf(line, sizeof(line), "  %11.0f  %11.1f", double(node.cycles) / node.calls, double(node.misses) / node.calls);
+          std::cout << line;
+        }
+        std::cout << std::endl;
+
+        if (node.children.empty()) return;
+        uint64_t covered = 0;
+        for (const std::unique_ptr<Node>& c : node.children) {
+          print(*c, depth + 1, node.ticks, msPerTick);
+          covered += c->ticks;
+        }
+        uint64_t self = node.ticks > covered ? node.ticks - covered : 0;
+        const std::string selfName = std::string(2 * depth + 2, ' ') + "(self)";
+        std::snprintf(line, sizeof(line), "  %-40s %10s %12.3f %12s %6.1f%%", selfName.c_str(), "", self * msPerTick, "",
+                      node.ticks ? 100. * self / node.ticks : 0.);
+        std::cout << line << std::endl;
+      }
+
+      Node _root;
+      Node* _current;
+      PerfCounters _perf;
+      bool _perfChecked;
+      std::chrono::steady_clock::time_point _start;
+      uint64_t _startTicks;
+    };
+
+
+    class Scope {
+    public:
+
+      Scope(Profile& profile, const char* name) : _profile(profile), _node(profile.enter(name)), _cycles(0), _misses(0) {
+        if (_profile.perf().isOpen()) _profile.perf().read(_cycles, _misses);
+        _start = ticks();
+      }
+
+      ~Scope() {
+        _node->ticks += ticks() - _start;
+        _node->calls++;
+        if (_profile.perf().isOpen()) {
+          uint64_t cycles, misses;
+          _profile.perf().read(cycles, misses);
+          _node->cycles += cycles - _cycles;
+          _node->misses += misses - _misses;
+        }
+        _profile.leave(_node);
+      }
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+
+    private:
+      Profile& _profile;
+      Node* _node;
+      uint64_t _start, _cycles, _misses;
+    };
+
+
+    template <typename F>
+    inline auto timed(Profile& profile, const char* name, F f) -> decltype(f()) {
+      Scope scope(profile, name);
+      return f();
+    }
+
+  }
+
+}
+
+#define USPJWL_TIMING_CAT2(a, b) a##b
+#define USPJWL_TIMING_CAT(a, b) USPJWL_TIMING_CAT2(a, b)
+#define USPJWL_TIME_SCOPE(profile, name) USPJWL::Timing::Scope USPJWL_TIMING_CAT(uspjwl_scope_, __LINE__)(profile, name)
+#define USPJWL_TIMED(profile, name, ...) USPJWL::Timing::timed(profile, name, [&]() -> decltype(auto) { return __VA_ARGS__; })
+#define USPJWL_TIME_AHEAD(profile, name, ...) USPJWL::Timing::timed(profile, name, [&]() { (void)(__VA_ARGS__); })
+
+#else
+
+namespace USPJWL {
+
+  namespace Timing {
+
+    class Profile {
+    public:
+      void report(const std::string&) const {}
+    };
+
+  }
+
+}
+
+#define USPJWL_TIME_SCOPE(profile, name) ((void)0)
+#define USPJWL_TIMED(profile, name, ...) (__VA_ARGS__)
+#define USPJWL_TIME_AHEAD(profile, name, ...) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+// -*- C++ -*-
+
+// Conversion between the binary histogram container (USPJWL_BinHisto.hh)
+// and YODA text objects (tools/YodaText.hh). Histograms and counters map
+// to the binary arrays; every other object type is kept as YODA text.
+
+#ifndef USPJWL_BINHISTOTEXT_HH
+#define USPJWL_BINHISTOTEXT_HH
+
+#include "USPJWL_BinHisto.hh"
+#include "tools/YodaText.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace BinHistoText {
+
+    namespace detail {
+
+      inline YodaText::Line comment(const std::string& text) {
+        YodaText::Line line;
+        line.row = YodaText::Line::COMMENT;
+        line.text = text;
+        return line;
+      }
+
+      inline void addRow(YodaText::Object& obj, const std::string& key, const std::vector<double>& values) {
+        YodaText::Row row;
+        row.key = key;
+        row.values = values;
+        obj.rows.push_back(row);
+        YodaText::Line line;
+        line.row = int(obj.rows.size()) - 1;
+        obj.body.push_back(line);
+      }
+
+    }
+
+
+    // Histograms and counters as YODA text; bin edges are formatted with
+    // %.<edgePrecision>e (6 matches Rivet's own output)
+    inline std::vector<YodaText::Object> toText(const BinHisto::Object& bo, int edgePrecision) {
+      using namespace BinHisto;
+      if (bo.kind == TEXT) return YodaText::parse(bo.text, bo.path);
+
+      YodaText::Object obj;
+      obj.path = bo.path;
+      obj.scaledBy = bo.scaledBy;
+      size_t start = 0;
+      while (start < bo.annotations.size()) {
+        size_t end = bo.annotations.find('\n', start);
+        if (end == std::string::npos) end = bo.annotations.size();
+        obj.annotations.push_back(bo.annotations.substr(start, end - start));
+        start = end + 1;
+      }
+
+      if (bo.kind == COUNTER) {
+        obj.tag = "YODA_COUNTER_V2";
+        obj.type = "COUNTER";
+        obj.body.push_back(detail::comment("# sumW\t sumW2\t numEntries"));
+        detail::addRow(obj, "", {bo.at(SUMW, 0), bo.at(SUMW2, 0), bo.at(NUMENTRIES, 0)});
+        return {obj};
+      }
+
+      obj.tag = "YODA_HISTO1D_V2";
+      obj.type = "HISTO1D";
+      YodaText::Line mean, area;
+      mean.row = YodaText::Line::MEAN;
+      area.row = YodaText::Line::AREA;
+      obj.body.push_back(mean);
+      obj.body.push_back(area);
+      obj.body.push_back(detail::comment("# ID\t ID\t sumw\t sumw2\t sumwx\t sumwx2\t numEntries"));
+      auto values = [&bo](size_t slot) {
+        return std::vector<double>{bo.at(SUMW, slot), bo.at(SUMW2, slot), bo.at(SUMWX, slot),
+                                   bo.at(SUMWX2, slot), bo.at(NUMENTRIES, slot)};
+      };
+      detail::addRow(obj, "Total\tTotal", values(TOTAL));
+      detail::addRow(obj, "Underflow\tUnderflow", values(UNDERFLOW));
+      detail::addRow(obj, "Overflow\tOverflow", values(OVERFLOW));
+      obj.body.push_back(detail::comment("# xlow\t xhigh\t sumw\t sumw2\t sumwx\t sumwx2\t numEntries"));
+      for (size_t i = 0; i < bo.numBins(); i++) {
+        char key[128];
+        std::snprintf(key, sizeof(key), "%.*e\t%.*e", edgePrecision, bo.edges[i], edgePrecision, bo.edges[i + 1]);
+        detail::addRow(obj, key, values(FIRSTBIN + i));
+      }
+      return {obj};
+    }
+
+
+    // YODA text object in binary form; precision is used for TEXT objects
+    inline BinHisto::Object fromText(const YodaText::Object& obj, int precision) {
+      using namespace BinHisto;
+      Object bo;
+      bo.path = obj.path;
+      bo.scaledBy = obj.scaledBy;
+      for (size_t i = 0; i < obj.annotations.size(); i++) bo.annotations += (i ? "\n" : "") + obj.annotations[i];
+
+      auto bad = [&obj]() { return std::runtime_error(obj.path + ": unexpected " + obj.type + " layout"); };
+
+      if (obj.type == "COUNTER") {
+        bo.kind = COUNTER;
+        bo.resize();
+        if (obj.rows.size() != 1 || obj.rows[0].values.size() != 3) throw bad();
+        bo.at(SUMW, 0) = obj.rows[0].values[0];
+        bo.at(SUMW2, 0) = obj.rows[0].values[1];
+        bo.at(NUMENTRIES, 0) = obj.rows[0].values[2];
+        return bo;
+      }
+
+      if (obj.type != "HISTO1D") {
+        bo.kind = TEXT;
+        bo.text = YodaText::format(obj, precision);
+        return bo;
+      }
+
+      bo.kind = HISTO1D;
+      std::vector<const YodaText::Row*> bins;
+      const YodaText::Row* special[FIRSTBIN] = {nullptr, nullptr, nullptr};
+      for (const YodaText::Row& r : obj.rows) {
+        if (r.values.size() != NSTATS) throw bad();
+        if (r.key.compare(0, 5, "Total") == 0) special[TOTAL] = &r;
+        else if (r.key.compare(0, 9, "Underflow") == 0) special[UNDERFLOW] = &r;
+        else if (r.key.compare(0, 8, "Overflow") == 0) special[OVERFLOW] = &r;
+        else {
+          char* end;
+          double lo = std::strtod(r.key.c_str(), &end);
+          double hi = std::strtod(end, nullptr);
+          if (bo.edges.empty()) bo.edges.push_back(lo);
+          else if (bo.edges.back() != lo) throw std::runtime_error(obj.path + ": gaps between bins are not supported");
+          bo.edges.push_back(hi);
+          bins.push_back(&r);
+        }
+      }
+      if (!special[TOTAL] || !special[UNDERFLOW] || !special[OVERFLOW] || bins.empty()) throw bad();
+      bo.resize();
+      for (int s = 0; s < NSTATS; s++) {
+        for (int k = 0; k < FIRSTBIN; k++) bo.at(s, k) = special[k]->values[s];
+        for (size_t i = 0; i < bins.size(); i++) bo.at(s, FIRSTBIN + i) = bins[i]->values[s];
+      }
+      return bo;
+    }
+
+  }
+
+}
+
+#endif
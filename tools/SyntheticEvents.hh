@@ -0,0 +1,179 @@
+// -*- C++ -*-
+
+// Reproducible JEWEL-like events for benchmarking the USPJWL analyses.
+//
+// Every event holds
+//  - a hard topology: a back-to-back dijet, or a charged trigger hadron
+//    (20-50 GeV, |eta| < 0.9) with a recoiling jet,
+//  - a thermal background of nThermal hadrons (pT dN/dpT ~ pT exp(-pT/T),
+//    flat in |eta| < etaMax and phi),
+//  - JEWEL-style medium response: nRecoil scattering centres (status 3)
+//    around the jet axes and the corresponding recoil hadrons (status 1),
+//    so the SubtractedJewelEvent projections have something to subtract.
+// The physics is only meant to be plausible in multiplicities, momenta
+// and jet structure. Event i of a given configuration and seed is always
+// the same.
+
+#ifndef USPJWL_SYNTHETICEVENTS_HH
+#define USPJWL_SYNTHETICEVENTS_HH
+
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+#include "HepMC/GenVertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace Synthetic {
+
+    struct Config {
+      int nThermal = 2000;          // background hadrons in |eta| < etaMax
+      double etaMax = 5.;
+      double temperature = 0.35;    // GeV
+      bool hadronTrigger = false;   // hadron+jet instead of dijet
+      double ptHatMin = 30., ptHatMax = 300., ptHatPower = 5.;
+      int nRecoil = 40;             // scattering centres (and recoils) per event
+      uint64_t seed = 12345;
+    };
+
+
+    class Generator {
+    public:
+
+      explicit Generator(const Config& cfg) : _cfg(cfg) {}
+
+      const Config& config() const { return _cfg; }
+
+      void generate(uint64_t index, HepMC::GenEvent& ge) const {
+        std::seed_seq seq{uint32_t(_cfg.seed), uint32_t(_cfg.seed >> 32), uint32_t(index), uint32_t(index >> 32)};
+        std::mt19937_64 rng(seq);
+        std::uniform_real_distribution<double> flat(0., 1.);
+
+        ge.use_units(HepMC::Units::GEV, HepMC::Units::MM);
+        ge.set_event_number(int(index));
+        ge.weights().push_back(1.);
+        HepMC::GenVertex* vtx = new HepMC::GenVertex();
+        ge.add_vertex(vtx);
+
+        // Hard topology
+        const double pthat = ptHat(flat(rng));
+        const double phi1 = 2 * M_PI * flat(rng);
+        const double phi2 = phi1 + M_PI + 0.3 * (flat(rng) - 0.5);
+        std::vector<double> axesEta, axesPhi;
+        if (_cfg.hadronTrigger) {
+          double eta = 1.8 * flat(rng) - 0.9;
+          addHadron(*vtx, 20. + 30. * flat(rng), eta, phi1, flat(rng) < 0.5 ? 211 : -211);
+          double etaj = 2. * flat(rng) - 1.;
+          fragment(*vtx, rng, pthat, etaj, phi2);
+          axesEta = {eta, etaj};
+          axesPhi = {phi1, phi2};
+        }
+        else {
+          double eta1 = 4. * flat(rng) - 2., eta2 = 4. * flat(rng) - 2.;
+          fragment(*vtx, rng, pthat, eta1, phi1);
+          fragment(*vtx, rng, pthat * (0.5 + 0.5 * flat(rng)), eta2, phi2);
+          axesEta = {eta1, eta2};
+          axesPhi = {phi1, phi2};
+        }
+
+        // Thermal background
+        for (int i = 0; i < _cfg.nThermal; i++) {
+          addHadron(*vtx, thermalPt(rng), _cfg.etaMax * (2 * flat(rng) - 1), 2 * M_PI * flat(rng), randomPid(flat(rng)));
+        }
+
+        // Medium response: a thermal scattering centre near a jet axis and
+        // the hadron it turns into after being kicked along the jet
+        std::normal_distribution<double> spread(0., 0.3);
+        for (int i = 0; i < _cfg.nRecoil; i++) {
+          size_t k = i % axesEta.size();
+          double eta = axesEta[k] + spread(rng), phi = axesPhi[k] + spread(rng);
+          double pt = thermalPt(rng);
+          HepMC::GenParticle* sc = new HepMC::GenParticle(momentum(pt, eta, phi, 0.), 21, 3);
+          vtx->add_particle_out(sc);
+          double kick = 1. + 2. * flat(rng);
+          double px = pt * std::cos(phi) + kick * std::cos(axesPhi[k]);
+          double py = pt * std::sin(phi) + kick * std::sin(axesPhi[k]);
+          double pz = pt * std::sinh(eta) + kick * std::sinh(axesEta[k]);
+          double ptr = std::hypot(px, py);
+          addHadron(*vtx, ptr, std::asinh(pz / ptr), std::atan2(py, px), randomPid(flat(rng)));
+        }
+      }
+
+    private:
+
+      static double mass(int pid) {
+        switch (std::abs(pid)) {
+          case 211: return 0.13957;
+          case 321: return 0.49368;
+          case 2212: return 0.93827;
+          case 130: return 0.49761;
+          default: return 0.;
+        }
+      }
+
+      static int randomPid(double u) {
+        if (u < 0.30) return 211;
+        if (u < 0.60) return -211;
+        if (u < 0.67) return 321;
+        if (u < 0.74) return -321;
+        if (u < 0.78) return 2212;
+        if (u < 0.82) return -2212;
+        if (u < 0.88) return 130;
+        return 22;
+      }
+
+      static HepMC::FourVector momentum(double pt, double eta, double phi, double m) {
+        double px = pt * std::cos(phi), py = pt * std::sin(phi), pz = pt * std::sinh(eta);
+        return HepMC::FourVector(px, py, pz, std::sqrt(px * px + py * py + pz * pz + m * m));
+      }
+
+      static void addHadron(HepMC::GenVertex& vtx, double pt, double eta, double phi, int pid) {
+        HepMC::GenParticle* p = new HepMC::GenParticle(momentum(pt, eta, phi, mass(pid)), pid, 1);
+        p->set_generated_mass(mass(pid));
+        vtx.add_particle_out(p);
+      }
+
+      // Power-law pT-hat between ptHatMin and ptHatMax
+      double ptHat(double u) const {
+        double a = 1 - _cfg.ptHatPower;
+        double lo = std::pow(_cfg.ptHatMin, a), hi = std::pow(_cfg.ptHatMax, a);
+        return std::pow(lo + u * (hi - lo), 1 / a);
+      }
+
+      // pT dN/dpT ~ pT exp(-pT/T), i.e. a Gamma(2, T) distribution
+      double thermalPt(std::mt19937_64& rng) const {
+        std::gamma_distribution<double> g(2., _cfg.temperature);
+        return g(rng);
+      }
+
+      // Collimated hadrons sharing the parton pT
+      void fragment(HepMC::GenVertex& vtx, std::mt19937_64& rng, double pt, double eta, double phi) const {
+        std::uniform_real_distribution<double> flat(0., 1.);
+        int n = 4 + int(3 * std::log(pt)) + int(4 * flat(rng));
+        std::vector<double> share(n);
+        double sum = 0;
+        for (double& s : share) {
+          s = -std::log(1 - flat(rng)) * (flat(rng) < 0.2 ? 4. : 1.);   // a few hard fragments
+          sum += s;
+        }
+        for (double s : share) {
+          double z = s / sum;
+          double width = 0.02 + 0.15 * (1 - z);
+          std::normal_distribution<double> angle(0., width);
+          addHadron(vtx, z * pt, eta + angle(rng), phi + angle(rng), randomPid(flat(rng)));
+        }
+      }
+
+      Config _cfg;
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,242 @@
+// -*- C++ -*-
+
+// Minimal reader and writer for the YODA text format, as written by Rivet
+// for the USPJWL analyses. It does not interpret the objects beyond what
+// merging needs: every data row is split into leading key tokens (bin
+// edges or Total/Underflow/Overflow labels), kept verbatim, and numeric
+// values. Annotations and comments are kept verbatim, except the
+// "# Mean:" and "# Area:" lines of 1D histograms and profiles, which are
+// regenerated from the Total row when writing.
+
+#ifndef USPJWL_YODATEXT_HH
+#define USPJWL_YODATEXT_HH
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace USPJWL {
+
+  namespace YodaText {
+
+    struct Row {
+      std::string key;              // leading non-additive tokens, tab separated
+      std::vector<double> values;
+    };
+
+    // Body line: a data row (row >= 0) or a comment
+    struct Line {
+      enum { COMMENT = -1, MEAN = -2, AREA = -3 };
+      int row;
+      std::string text;
+    };
+
+    struct Object {
+      std::string tag;                        // e.g. YODA_HISTO1D_V2
+      std::string type;                       // e.g. HISTO1D
+      std::string path;
+      std::vector<std::string> annotations;   // lines between BEGIN and ---
+      double scaledBy = 1.;
+      std::vector<Line> body;
+      std::vector<Row> rows;
+    };
+
+
+    // Number of leading numeric tokens that are bin edges rather than sums
+    inline size_t numEdgeTokens(const std::string& type) {
+      if (type == "HISTO1D" || type == "PROFILE1D") return 2;
+      if (type == "HISTO2D" || type == "PROFILE2D") return 4;
+      return 0;
+    }
+
+
+    namespace detail {
+
+      inline bool startsWith(const char* b, const char* e, const char* prefix) {
+        size_t n = std::strlen(prefix);
+        return size_t(e - b) >= n && std::memcmp(b, prefix, n) == 0;
+      }
+
+      inline Row parseRow(const char* b, const char* e, size_t nedges) {
+        Row row;
+        size_t ntok = 0;
+        const char* p = b;
+        while (p < e) {
+          while (p < e && (*p == ' ' || *p == '\t')) p++;
+          if (p == e) break;
+          const char* q = p;
+          while (q < e && *q != ' ' && *q != '\t') q++;
+          bool numeric = false;
+          double v = 0;
+          if (row.values.empty()) {
+            // Still in the key part: labels, then the edges
+            char* end = nullptr;
+            v = std::strtod(p, &end);
+            numeric = (end == q);
+            if (!numeric || ntok < nedges) {
+              if (!row.key.empty()) row.key += '\t';
+              row.key.append(p, q);
+              if (numeric) ntok++;
+              else ntok = nedges;   // labelled rows have no edges
+              p = q;
+              continue;
+            }
+          }
+          else {
+            char* end = nullptr;
+            v = std::strtod(p, &end);
+            if (end != q) throw std::runtime_error("bad number '" + std::string(p, q) + "'");
+          }
+          row.values.push_back(v);
+          p = q;
+        }
+        return row;
+      }
+
+    }
+
+
+    // Parses the objects in YODA text; source is used in error messages
+    inline std::vector<Object> parse(const std::string& buf, const std::string& source) {
+      std::vector<Object> objects;
+      Object* obj = nullptr;
+      bool inData = false;
+      size_t lineno = 0;
+      const char* p = buf.data();
+      const char* end = p + buf.size();
+      while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* e = nl ? nl : end;
+        const char* next = nl ? nl + 1 : end;
+        lineno++;
+        if (e > p && e[-1] == '\r') e--;
+
+        try {
+          if (!obj) {
+            if (detail::startsWith(p, e, "BEGIN ")) {
+              objects.push_back(Object());
+              obj = &objects.back();
+              std::string header(p + 6, e);
+              size_t sp = header.find(' ');
+              obj->tag = header.substr(0, sp);
+              obj->path = sp == std::string::npos ? "" : header.substr(sp + 1);
+              if (obj->tag.compare(0, 5, "YODA_") != 0) throw std::runtime_error("unknown object " + obj->tag);
+              obj->type = obj->tag.substr(5, obj->tag.rfind("_V") - 5);
+              inData = false;
+            }
+          }
+          else if (detail::startsWith(p, e, "END ")) {
+            if (std::string(p + 4, e) != obj->tag) throw std::runtime_error("unterminated " + obj->tag);
+            obj = nullptr;
+          }
+          else if (!inData) {
+            if (detail::startsWith(p, e, "---")) inData = true;
+            else {
+              obj->annotations.push_back(std::string(p, e));
+              if (detail::startsWith(p, e, "ScaledBy:")) obj->scaledBy = std::strtod(p + 9, nullptr);
+            }
+          }
+          else if (detail::startsWith(p, e, "#")) {
+            Line line;
+            line.row = detail::startsWith(p, e, "# Mean:") ? Line::MEAN
+                       : detail::startsWith(p, e, "# Area:") ? Line::AREA : Line::COMMENT;
+            line.text.assign(p, e);
+            obj->body.push_back(line);
+          }
+          else if (e > p) {
+            obj->rows.push_back(detail::parseRow(p, e, numEdgeTokens(obj->type)));
+            Line line;
+            line.row = int(obj->rows.size()) - 1;
+            obj->body.push_back(line);
+          }
+        }
+        catch (const std::runtime_error& err) {
+          throw std::runtime_error(source + ":" + std::to_string(lineno) + ": " + err.what());
+        }
+        p = next;
+      }
+      if (obj) throw std::runtime_error(source + ": unterminated " + obj->tag + " " + obj->path);
+      return objects;
+    }
+
+
+    // Reads every object of a YODA text file
+    inline std::vector<Object> read(const std::string& filename) {
+      std::FILE* f = std::fopen(filename.c_str(), "rb");
+      if (!f) throw std::runtime_error(filename + ": " + std::strerror(errno));
+      std::string buf;
+      char chunk[1 << 16];
+      size_t n;
+      while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) buf.append(chunk, n);
+      std::fclose(f);
+      return parse(buf, filename);
+    }
+
+
+    namespace detail {
+
+      inline void appendf(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+      inline void appendf(std::string& out, const char* fmt, ...) {
+        char buf[256];
+        va_list ap;
+        va_start(ap, fmt);
+        int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        if (n > 0) out.append(buf, std::min(size_t(n), sizeof(buf) - 1));
+      }
+
+    }
+
+
+    // Formats an object; values use %.<precision>e (YODA itself uses 6)
+    inline std::string format(const Object& obj, int precision) {
+      std::string out;
+      out += "BEGIN " + obj.tag + " " + obj.path + "\n";
+      for (const std::string& a : obj.annotations) out += a + "\n";
+      out += "---\n";
+
+      const Row* total = nullptr;
+      for (const Row& r : obj.rows) {
+        if (r.key.compare(0, 5, "Total") == 0 && r.values.size() >= 3) {
+          total = &r;
+          break;
+        }
+      }
+
+      for (const Line& line : obj.body) {
+        if (line.row == Line::COMMENT || ((line.row == Line::MEAN || line.row == Line::AREA) && !total))
+          out += line.text + "\n";
+        else if (line.row == Line::MEAN)
+          detail::appendf(out, "# Mean: %.*e\n", precision, total->values[0] != 0 ? total->values[2] / total->values[0] : 0.);
+        else if (line.row == Line::AREA)
+          detail::appendf(out, "# Area: %.*e\n", precision, total->values[0]);
+        else {
+          const Row& r = obj.rows[line.row];
+          out += r.key;
+          for (size_t i = 0; i < r.values.size(); i++)
+            detail::appendf(out, (i == 0 && r.key.empty()) ? "%.*e" : "\t%.*e", precision, r.values[i]);
+          out += '\n';
+        }
+      }
+      out += "END " + obj.tag + "\n\n";
+      return out;
+    }
+
+
+    inline void write(std::FILE* f, const Object& obj, int precision) {
+      const std::string text = format(obj, precision);
+      std::fwrite(text.data(), 1, text.size(), f);
+    }
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,174 @@
+// -*- C++ -*-
+
+// Allocation tracker for the USPJWL analyses, preloaded into the job.
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++14 -shared -fPIC -I. -o libuspjwl-alloc.so tools/uspjwl-allocprofile.cc
+// and run analyses built with -DUSPJWL_ALLOC_PROFILE (see USPJWL_AllocProfile.hh):
+//   LD_PRELOAD=./libuspjwl-alloc.so rivet -a USPJWL_HJET events.hepmc
+//
+// The global operator new/delete are replaced. Every block carries a
+// 16-byte header with its size and the analysis that was in init() or
+// analyze() on the allocating thread, so that frees, wherever they
+// happen, reduce the live bytes of the right analysis. Allocations made
+// outside any analysis scope, and by the tracker itself, are not counted.
+// Over-aligned new/delete are left to the standard library.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+
+
+namespace {
+
+  struct Stats {
+    Stats() : events(0), live(0), peak(0) {
+      for (int phase = 0; phase < 2; phase++) {
+        allocs[phase] = 0;
+        bytes[phase] = 0;
+      }
+    }
+    std::atomic<uint64_t> events;
+    std::atomic<uint64_t> allocs[2], bytes[2];     // by phase: init, analyze
+    std::atomic<int64_t> live, peak;
+  };
+
+  struct Header {
+    Stats* owner;
+    size_t size;
+  };
+  static_assert(sizeof(Header) == 16, "the header keeps blocks 16-byte aligned");
+
+  // Trivially initialised, so using them never allocates
+  thread_local Stats* tl_current = nullptr;
+  thread_local int tl_phase = 0;
+  thread_local bool tl_inTracker = false;
+
+
+  // Stats live until exit and are never moved
+  std::mutex& registryMutex() {
+    static std::mutex m;
+    return m;
+  }
+
+  std::map<std::string, Stats*>& registry() {
+    static std::map<std::string, Stats*>* r = new std::map<std::string, Stats*>();
+    return *r;
+  }
+
+
+  // Blocks allocated while it is alive are not attributed
+  class TrackerScope {
+  public:
+    TrackerScope() : _outer(tl_inTracker) { tl_inTracker = true; }
+    ~TrackerScope() { tl_inTracker = _outer; }
+  private:
+    bool _outer;
+  };
+
+
+  void* allocate(size_t size) {
+    Header* h = static_cast<Header*>(std::malloc(size + sizeof(Header)));
+    if (!h) return nullptr;
+    h->size = size;
+    h->owner = tl_inTracker ? nullptr : tl_current;
+    if (Stats* s = h->owner) {
+      s->allocs[tl_phase].fetch_add(1, std::memory_order_relaxed);
+      s->bytes[tl_phase].fetch_add(size, std::memory_order_relaxed);
+      int64_t live = s->live.fetch_add(int64_t(size), std::memory_order_relaxed) + int64_t(size);
+      int64_t peak = s->peak.load(std::memory_order_relaxed);
+      while (live > peak && !s->peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+    return h + 1;
+  }
+
+
+  void release(void* p) {
+    if (!p) return;
+    Header* h = static_cast<Header*>(p) - 1;
+    if (h->owner) h->owner->live.fetch_sub(int64_t(h->size), std::memory_order_relaxed);
+    std::free(h);
+  }
+
+
+  void* allocateOrThrow(size_t size) {
+    while (true) {
+      if (void* p = allocate(size)) return p;
+      std::new_handler handler = std::get_new_handler();
+      if (!handler) throw std::bad_alloc();
+      handler();
+    }
+  }
+
+}
+
+
+extern "C" {
+
+  __attribute__((visibility("default")))
+  void uspjwl_alloc_enter(const char* analysis, int phase, void** saved) {
+    TrackerScope tracker;
+    // The outer scope's phase goes in the low bit of its (aligned) Stats pointer
+    *saved = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(tl_current) | uintptr_t(tl_phase));
+    Stats* s;
+    {
+      std::lock_guard<std::mutex> lock(registryMutex());
+      Stats*& slot = registry()[analysis];
+      if (!slot) slot = new Stats();
+      s = slot;
+    }
+    if (phase == 1) s->events.fetch_add(1, std::memory_order_relaxed);
+    tl_current = s;
+    tl_phase = phase;
+  }
+
+
+  __attribute__((visibility("default")))
+  void uspjwl_alloc_leave(void* saved) {
+    uintptr_t bits = reinterpret_cast<uintptr_t>(saved);
+    tl_current = reinterpret_cast<Stats*>(bits & ~uintptr_t(1));
+    tl_phase = int(bits & 1);
+  }
+
+
+  __attribute__((visibility("default")))
+  void uspjwl_alloc_report(const char* analysis, size_t histogramBytes) {
+    TrackerScope tracker;
+    Stats* s;
+    {
+      std::lock_guard<std::mutex> lock(registryMutex());
+      auto it = registry().find(analysis);
+      if (it == registry().end()) return;
+      s = it->second;
+    }
+    const double events = double(s->events.load());
+    const double n = events > 0 ? events : 1.;
+    std::printf("%s: allocations: init %llu (%.1f kB); analyze %.1f per event, %.1f kB per event over %.0f events\n",
+                analysis, (unsigned long long)s->allocs[0].load(), s->bytes[0].load() / 1024.,
+                s->allocs[1].load() / n, s->bytes[1].load() / 1024. / n, events);
+    std::printf("%s: live heap: peak %.1f kB, now %.1f kB; booked histograms %.1f kB\n",
+                analysis, s->peak.load() / 1024., s->live.load() / 1024., histogramBytes / 1024.);
+    std::fflush(stdout);
+  }
+
+}
+
+
+// Replacements of the global allocation functions
+
+void* operator new(size_t size) { return allocateOrThrow(size); }
+void* operator new[](size_t size) { return allocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
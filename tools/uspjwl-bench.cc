@@ -0,0 +1,139 @@
+// -*- C++ -*-
+
+// Throughput benchmark of the USPJWL analyses on synthetic JEWEL-like
+// events (tools/SyntheticEvents.hh).
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++14 -I. -o uspjwl-bench tools/uspjwl-bench.cc $(rivet-config --cppflags --ldflags --libs)
+//
+// Usage:
+//   uspjwl-bench [-n EVENTS] [-w WARMUP] [-m MULT,MULT,...] [-r R,R,...]
+//                [-a ANALYSIS,...] [-t dijet|hadron] [-s SEED] [-c results.csv]
+// For every background multiplicity and jet radius (RJETS) the events are
+// generated once, then run through each analysis on its own and through
+// all of them in one AnalysisHandler. The first WARMUP events of every run
+// (default 5, which include the analysis init) are not timed. The table
+// gives events per second and milliseconds per event; -c also writes it
+// as CSV. USPJWL_JET_MASS and USPJWL_HJET do not read RJETS, so their rows
+// only differ by the event sample.
+
+#include "Rivet/AnalysisHandler.hh"
+#include "Rivet/Tools/Logging.hh"
+#include "tools/SyntheticEvents.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+  const char* ALL_ANALYSES[] = {"USPJWL_JETSPEC", "USPJWL_EXTRASPEC", "USPJWL_PHIDIST", "USPJWL_INOUTPLANESPEC",
+                                "USPJWL_SUBFRAG", "USPJWL_JET_MASS", "USPJWL_HJET"};
+
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-bench [-n EVENTS] [-w WARMUP] [-m MULT,...] [-r R,...] [-a ANALYSIS,...] "
+              << "[-t dijet|hadron] [-s SEED] [-c results.csv]" << std::endl;
+  }
+
+
+  std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string tok;
+    while (std::getline(ss, tok, ',')) if (!tok.empty()) out.push_back(tok);
+    return out;
+  }
+
+
+  // Seconds spent in analyze() for the timed events
+  double run(const std::vector<std::string>& analyses,
+             const std::vector<std::unique_ptr<HepMC::GenEvent> >& events, size_t warmup) {
+    Rivet::AnalysisHandler ah("uspjwl-bench");
+    ah.setIgnoreBeams(true);
+    ah.addAnalyses(analyses);
+    for (size_t i = 0; i < warmup && i < events.size(); i++) ah.analyze(*events[i]);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = warmup; i < events.size(); i++) ah.analyze(*events[i]);
+    auto stop = std::chrono::steady_clock::now();
+
+    ah.finalize();
+    return std::chrono::duration<double>(stop - start).count();
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  size_t nevents = 200, warmup = 5;
+  std::vector<std::string> mults = {"500", "2000", "8000"}, radii = {"0.2", "0.4"}, analyses, csvRows;
+  std::string csv;
+  USPJWL::Synthetic::Config cfg;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc) nevents = std::atol(argv[++i]);
+    else if (arg == "-w" && i + 1 < argc) warmup = std::atol(argv[++i]);
+    else if (arg == "-m" && i + 1 < argc) mults = split(argv[++i]);
+    else if (arg == "-r" && i + 1 < argc) radii = split(argv[++i]);
+    else if (arg == "-a" && i + 1 < argc) analyses = split(argv[++i]);
+    else if (arg == "-t" && i + 1 < argc) cfg.hadronTrigger = std::string(argv[++i]) == "hadron";
+    else if (arg == "-s" && i + 1 < argc) cfg.seed = std::strtoull(argv[++i], nullptr, 10);
+    else if (arg == "-c" && i + 1 < argc) csv = argv[++i];
+    else { usage(); return arg == "-h" || arg == "--help" ? 0 : 1; }
+  }
+  if (analyses.empty()) analyses.assign(std::begin(ALL_ANALYSES), std::end(ALL_ANALYSES));
+  if (nevents <= warmup) {
+    std::cerr << "Need more events than warm-up events" << std::endl;
+    return 1;
+  }
+
+  // INOUTPLANESPEC expects the event-plane angles
+  setenv("PSI2", "0", 0);
+  setenv("PSI3", "0", 0);
+  setenv("PSI4", "0", 0);
+  Rivet::Log::setLevel("Rivet", Rivet::Log::WARN);
+
+  std::printf("%8s %5s  %-24s %12s %12s\n", "mult", "R", "analysis", "events/s", "ms/event");
+  for (const std::string& mult : mults) {
+    cfg.nThermal = std::atoi(mult.c_str());
+    USPJWL::Synthetic::Generator gen(cfg);
+    std::vector<std::unique_ptr<HepMC::GenEvent> > events;
+    for (size_t i = 0; i < nevents; i++) {
+      events.emplace_back(new HepMC::GenEvent());
+      gen.generate(i, *events.back());
+    }
+
+    for (const std::string& R : radii) {
+      setenv("RJETS", R.c_str(), 1);
+      std::vector<std::vector<std::string> > runs;
+      for (const std::string& a : analyses) runs.push_back({a});
+      if (analyses.size() > 1) runs.push_back(analyses);
+
+      for (const std::vector<std::string>& r : runs) {
+        const std::string label = r.size() == 1 ? r[0] : "all";
+        double seconds = run(r, events, warmup);
+        double n = nevents - warmup;
+        std::printf("%8s %5s  %-24s %12.1f %12.3f\n", mult.c_str(), R.c_str(), label.c_str(), n / seconds, 1e3 * seconds / n);
+        std::fflush(stdout);
+        csvRows.push_back(mult + "," + R + "," + label + "," + std::to_string(n / seconds) + "," + std::to_string(1e3 * seconds / n));
+      }
+    }
+  }
+
+  if (!csv.empty()) {
+    std::ofstream out(csv);
+    out << "multiplicity,R,analysis,events_per_s,ms_per_event\n";
+    for (const std::string& row : csvRows) out << row << "\n";
+  }
+  return 0;
+}
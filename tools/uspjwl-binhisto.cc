@@ -0,0 +1,78 @@
+// -*- C++ -*-
+
+// Converts between the binary histogram container (.ybin, see
+// USPJWL_BinHisto.hh) and YODA text.
+//
+// Build (from the repository root):
+//   g++ -O3 -std=c++14 -I. -o uspjwl-binhisto tools/uspjwl-binhisto.cc
+//
+// Usage:
+//   uspjwl-binhisto toyoda in.ybin [-o out.yoda] [-p DIGITS]
+//   uspjwl-binhisto fromyoda in.yoda -o out.ybin
+// toyoda writes values and bin edges with DIGITS digits after the point
+// (default 16), which converts back to exactly the same binary file;
+// -p 6 gives YODA's usual output. Without -o it writes to stdout.
+
+#include "tools/BinHistoText.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace USPJWL;
+
+
+namespace {
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-binhisto toyoda in.ybin [-o out.yoda] [-p DIGITS]\n"
+              << "       uspjwl-binhisto fromyoda in.yoda -o out.ybin" << std::endl;
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+  const std::string mode = argv[1], input = argv[2];
+  std::string output;
+  int precision = 16;
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) output = argv[++i];
+    else if (arg == "-p" && i + 1 < argc) precision = std::atoi(argv[++i]);
+    else { usage(); return 1; }
+  }
+
+  try {
+    if (mode == "toyoda") {
+      std::FILE* f = output.empty() ? stdout : std::fopen(output.c_str(), "w");
+      if (!f) throw std::runtime_error("Cannot write " + output);
+      for (const BinHisto::Object& bo : BinHisto::read(input)) {
+        for (const YodaText::Object& obj : BinHistoText::toText(bo, precision)) YodaText::write(f, obj, precision);
+      }
+      if (f != stdout) std::fclose(f);
+    }
+    else if (mode == "fromyoda" && !output.empty()) {
+      std::vector<BinHisto::Object> objects;
+      for (const YodaText::Object& obj : YodaText::read(input)) objects.push_back(BinHistoText::fromText(obj, precision));
+      BinHisto::write(output, objects);
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,458 @@
+// -*- C++ -*-
+
+// Computes derived observables (per-trigger and per-event normalisations,
+// differences, ratios) from merged USPJWL outputs in one pass, following
+// a recipe file, instead of rescanning the job outputs.
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++14 -I. -o uspjwl-derive tools/uspjwl-derive.cc
+//
+// Usage:
+//   uspjwl-derive RECIPE -o out.yoda [-D NAME=VALUE ...] [-p DIGITS] in.yoda|in.ybin [LABEL=in.yoda ...]
+//
+// The analyses write only raw sums: unscaled histograms, and counters of
+// events and triggers (sums of weights), which uspjwl-merge adds exactly.
+// Every recipe line
+//   /OUTPUT/PATH = EXPRESSION
+// writes one Scatter2D (or a Scatter1D for a number). Expressions combine
+// objects, numbers, + - * / and parentheses; operators and operands are
+// separated by spaces. Objects are paths in the first input, or
+// LABEL:/PATH in the input given as LABEL=file. A histogram is its bin
+// contents, a counter its sum of weights; bin-by-bin operations need the
+// same binning. Functions:
+//   density(h)    bin contents divided by the bin widths
+//   integral(h)   sum of the bin contents (without under- and overflow)
+// Lines "$NAME = VALUE" set defaults for ${NAME}, which -D overrides.
+// Uncertainties are propagated from sumw2 as if all operands were
+// independent. If every object of a line has bootstrap replicas
+// (<path>[BOOT<k>], USPJWL_Bootstrap.hh), the line is also evaluated on
+// each replica and written as <OUTPUT>[BOOT<k>]; their spread is the
+// uncertainty including the correlations. Lines whose objects or labelled
+// inputs are missing are skipped with a warning, so one recipe serves every
+// job type.
+
+#include "tools/BinHistoText.hh"
+#include "USPJWL_Master.hh"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace USPJWL;
+
+
+namespace {
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-derive RECIPE -o out.yoda [-D NAME=VALUE ...] [-p DIGITS] in.yoda|in.ybin [LABEL=in.yoda ...]"
+              << std::endl;
+  }
+
+
+  // Objects missing from the inputs: the line is skipped, not an error
+  struct Missing : std::runtime_error {
+    explicit Missing(const std::string& path) : std::runtime_error(path) {}
+  };
+
+
+  // A number (no edges) or the bins of a histogram, with squared uncertainties
+  struct Value {
+    std::vector<double> edges;
+    std::vector<double> val, err2;
+
+    bool isHisto() const { return !edges.empty(); }
+  };
+
+
+  class Inputs {
+  public:
+
+    void add(const std::string& label, const std::string& path) {
+      std::vector<BinHisto::Object> objects;
+      if (BinHisto::isBinHisto(path)) objects = BinHisto::read(path);
+      else {
+        for (const YodaText::Object& obj : YodaText::read(path)) objects.push_back(BinHistoText::fromText(obj, 16));
+      }
+      std::unordered_map<std::string, BinHisto::Object>& files = _files[label];
+      for (BinHisto::Object& bo : objects) files[bo.path] = std::move(bo);
+    }
+
+    // ref is PATH or LABEL:PATH; suffix selects a bootstrap replica
+    const BinHisto::Object& find(const std::string& ref, const std::string& suffix) const {
+      const size_t colon = ref[0] == '/' ? std::string::npos : ref.find(':');
+      const std::string label = colon == std::string::npos ? "" : ref.substr(0, colon);
+      const std::string path = (colon == std::string::npos ? ref : ref.substr(colon + 1)) + suffix;
+      const auto file = _files.find(label);
+      if (file == _files.end()) throw Missing(ref + suffix);
+      const auto it = file->second.find(path);
+      if (it == file->second.end()) throw Missing(ref + suffix);
+      return it->second;
+    }
+
+    Value value(const std::string& ref, const std::string& suffix) const {
+      const BinHisto::Object& bo = find(ref, suffix);
+      Value v;
+      if (bo.kind == BinHisto::COUNTER) {
+        v.val.push_back(bo.at(BinHisto::SUMW, 0));
+        v.err2.push_back(bo.at(BinHisto::SUMW2, 0));
+      }
+      else if (bo.kind == BinHisto::HISTO1D) {
+        v.edges = bo.edges;
+        for (size_t i = 0; i < bo.numBins(); i++) {
+          v.val.push_back(bo.at(BinHisto::SUMW, BinHisto::FIRSTBIN + i));
+          v.err2.push_back(bo.at(BinHisto::SUMW2, BinHisto::FIRSTBIN + i));
+        }
+      }
+      else throw std::runtime_error(ref + " is neither a histogram nor a counter");
+      return v;
+    }
+
+  private:
+    std::map<std::string, std::unordered_map<std::string, BinHisto::Object> > _files;
+  };
+
+
+  // Expression tree of one recipe line
+  struct Node {
+    enum Kind { NUMBER, OBJECT, NEGATE, ADD, SUBTRACT, MULTIPLY, DIVIDE, DENSITY, INTEGRAL } kind;
+    double number = 0.;
+    std::string ref;
+    std::unique_ptr<Node> a, b;
+  };
+
+
+  class Parser {
+  public:
+
+    explicit Parser(const std::string& text) {
+      std::string spaced;
+      for (char c : text) {
+        if (c == '(' || c == ')') spaced += std::string(" ") + c + " ";
+        else spaced += c;
+      }
+      std::istringstream in(spaced);
+      std::string token;
+      while (in >> token) _tokens.push_back(token);
+    }
+
+    std::unique_ptr<Node> parse() {
+      std::unique_ptr<Node> n = sum();
+      if (_pos != _tokens.size()) throw std::invalid_argument("Unexpected '" + _tokens[_pos] + "'");
+      return n;
+    }
+
+    // Object references of the tree
+    static void refs(const Node& n, std::vector<std::string>& out) {
+      if (n.kind == Node::OBJECT) out.push_back(n.ref);
+      if (n.a) refs(*n.a, out);
+      if (n.b) refs(*n.b, out);
+    }
+
+  private:
+
+    bool accept(const std::string& t) {
+      if (_pos < _tokens.size() && _tokens[_pos] == t) {
+        _pos++;
+        return true;
+      }
+      return false;
+    }
+
+    static std::unique_ptr<Node> make(Node::Kind kind, std::unique_ptr<Node> a, std::unique_ptr<Node> b = nullptr) {
+      std::unique_ptr<Node> n(new Node);
+      n->kind = kind;
+      n->a = std::move(a);
+      n->b = std::move(b);
+      return n;
+    }
+
+    std::unique_ptr<Node> sum() {
+      std::unique_ptr<Node> n = product();
+      while (true) {
+        if (accept("+")) n = make(Node::ADD, std::move(n), product());
+        else if (accept("-")) n = make(Node::SUBTRACT, std::move(n), product());
+        else return n;
+      }
+    }
+
+    std::unique_ptr<Node> product() {
+      std::unique_ptr<Node> n = factor();
+      while (true) {
+        if (accept("*")) n = make(Node::MULTIPLY, std::move(n), factor());
+        else if (accept("/")) n = make(Node::DIVIDE, std::move(n), factor());
+        else return n;
+      }
+    }
+
+    std::unique_ptr<Node> factor() {
+      if (_pos >= _tokens.size()) throw std::invalid_argument("Incomplete expression");
+      if (accept("-")) return make(Node::NEGATE, factor());
+      if (accept("(")) {
+        std::unique_ptr<Node> n = sum();
+        if (!accept(")")) throw std::invalid_argument("Missing ')'");
+        return n;
+      }
+      for (const auto& f : {std::make_pair("density", Node::DENSITY), std::make_pair("integral", Node::INTEGRAL)}) {
+        if (_tokens[_pos] == f.first && _pos + 1 < _tokens.size() && _tokens[_pos + 1] == "(") {
+          _pos++;
+          return make(f.second, factor());
+        }
+      }
+
+      const std::string& t = _tokens[_pos++];
+      std::unique_ptr<Node> n(new Node);
+      char* end;
+      n->number = std::strtod(t.c_str(), &end);
+      if (*end == '\0') {
+        n->kind = Node::NUMBER;
+        return n;
+      }
+      if (t.find('/') == std::string::npos) throw std::invalid_argument("Not a number or object path: " + t);
+      n->kind = Node::OBJECT;
+      n->ref = t;
+      return n;
+    }
+
+    std::vector<std::string> _tokens;
+    size_t _pos = 0;
+  };
+
+
+  Value combine(Node::Kind op, const Value& x, const Value& y, const std::string& what) {
+    if (x.isHisto() && y.isHisto()) {
+      bool same = x.edges.size() == y.edges.size();
+      for (size_t i = 0; same && i < x.edges.size(); i++) same = Master::sameEdge(x.edges[i], y.edges[i]);
+      if (!same) throw std::runtime_error("Different binnings in " + what);
+    }
+    Value r;
+    r.edges = x.isHisto() ? x.edges : y.edges;
+    const size_t n = std::max(x.val.size(), y.val.size());
+    for (size_t i = 0; i < n; i++) {
+      const double a = x.val[x.isHisto() ? i : 0], ea = x.err2[x.isHisto() ? i : 0];
+      const double b = y.val[y.isHisto() ? i : 0], eb = y.err2[y.isHisto() ? i : 0];
+      switch (op) {
+        case Node::ADD:      r.val.push_back(a + b); r.err2.push_back(ea + eb); break;
+        case Node::SUBTRACT: r.val.push_back(a - b); r.err2.push_back(ea + eb); break;
+        case Node::MULTIPLY: r.val.push_back(a * b); r.err2.push_back(b * b * ea + a * a * eb); break;
+        default:
+          r.val.push_back(b != 0 ? a / b : 0.);
+          r.err2.push_back(b != 0 ? ea / (b * b) + a * a * eb / (b * b * b * b) : 0.);
+      }
+    }
+    return r;
+  }
+
+
+  Value evaluate(const Node& n, const Inputs& in, const std::string& suffix, const std::string& what) {
+    switch (n.kind) {
+      case Node::NUMBER: {
+        Value v;
+        v.val.push_back(n.number);
+        v.err2.push_back(0.);
+        return v;
+      }
+      case Node::OBJECT:
+        return in.value(n.ref, suffix);
+      case Node::NEGATE: {
+        Value v = evaluate(*n.a, in, suffix, what);
+        for (double& x : v.val) x = -x;
+        return v;
+      }
+      case Node::DENSITY: {
+        Value v = evaluate(*n.a, in, suffix, what);
+        if (!v.isHisto()) throw std::runtime_error("density() of a number in " + what);
+        for (size_t i = 0; i < v.val.size(); i++) {
+          const double w = v.edges[i + 1] - v.edges[i];
+          v.val[i] /= w;
+          v.err2[i] /= w * w;
+        }
+        return v;
+      }
+      case Node::INTEGRAL: {
+        const Value v = evaluate(*n.a, in, suffix, what);
+        Value s;
+        s.val.push_back(0.);
+        s.err2.push_back(0.);
+        for (size_t i = 0; i < v.val.size(); i++) {
+          s.val[0] += v.val[i];
+          s.err2[0] += v.err2[i];
+        }
+        return s;
+      }
+      default:
+        return combine(n.kind, evaluate(*n.a, in, suffix, what), evaluate(*n.b, in, suffix, what), what);
+    }
+  }
+
+
+  std::string scatter(const std::string& path, const Value& v, int precision) {
+    std::ostringstream out;
+    out.precision(precision);
+    out << std::scientific;
+    const std::string tag = v.isHisto() ? "YODA_SCATTER2D_V2" : "YODA_SCATTER1D_V2";
+    out << "BEGIN " << tag << " " << path << "\nPath: " << path << "\nTitle: \nType: "
+        << (v.isHisto() ? "Scatter2D" : "Scatter1D") << "\n---\n";
+    if (v.isHisto()) {
+      out << "# xval\t xerr-\t xerr+\t yval\t yerr-\t yerr+\n";
+      for (size_t i = 0; i < v.val.size(); i++) {
+        const double mid = 0.5 * (v.edges[i] + v.edges[i + 1]), half = 0.5 * (v.edges[i + 1] - v.edges[i]);
+        const double err = std::sqrt(v.err2[i]);
+        out << mid << "\t" << half << "\t" << half << "\t" << v.val[i] << "\t" << err << "\t" << err << "\n";
+      }
+    }
+    else {
+      out << "# xval\t xerr-\t xerr+\n" << v.val[0] << "\t" << std::sqrt(v.err2[0]) << "\t" << std::sqrt(v.err2[0]) << "\n";
+    }
+    out << "END " << tag << "\n\n";
+    return out.str();
+  }
+
+
+  // ${NAME} replaced from vars; unknown names are an error
+  std::string substitute(const std::string& line, const std::map<std::string, std::string>& vars) {
+    std::string out;
+    size_t pos = 0;
+    while (true) {
+      const size_t open = line.find("${", pos);
+      if (open == std::string::npos) return out + line.substr(pos);
+      const size_t close = line.find('}', open);
+      if (close == std::string::npos) throw std::invalid_argument("Unterminated ${ in: " + line);
+      const std::string name = line.substr(open + 2, close - open - 2);
+      const auto it = vars.find(name);
+      if (it == vars.end()) throw std::invalid_argument("Undefined ${" + name + "} in: " + line);
+      out += line.substr(pos, open - pos) + it->second;
+      pos = close + 1;
+    }
+  }
+
+
+  std::string trim(const std::string& s) {
+    const size_t b = s.find_first_not_of(" \t\r"), e = s.find_last_not_of(" \t\r");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  if (argc < 2 || argv[1][0] == '-') {
+    usage();
+    return 1;
+  }
+  const std::string recipe = argv[1];
+  std::string output;
+  int precision = 6;
+  std::map<std::string, std::string> defines;
+  std::vector<std::pair<std::string, std::string> > inputs;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) output = argv[++i];
+    else if (arg == "-p" && i + 1 < argc) precision = std::atoi(argv[++i]);
+    else if (arg == "-D" && i + 1 < argc) {
+      const std::string d = argv[++i];
+      const size_t eq = d.find('=');
+      if (eq == std::string::npos) { usage(); return 1; }
+      defines[d.substr(0, eq)] = d.substr(eq + 1);
+    }
+    else if (!arg.empty() && arg[0] != '-') {
+      // LABEL=file, or the unlabelled first input
+      const size_t eq = arg.find('=');
+      if (eq == std::string::npos) inputs.push_back(std::make_pair(std::string(), arg));
+      else inputs.push_back(std::make_pair(arg.substr(0, eq), arg.substr(eq + 1)));
+    }
+    else { usage(); return 1; }
+  }
+  if (output.empty() || inputs.empty()) {
+    usage();
+    return 1;
+  }
+
+  try {
+    Inputs in;
+    for (const auto& i : inputs) in.add(i.first, i.second);
+
+    std::ifstream rf(recipe);
+    if (!rf) throw std::runtime_error("Cannot read " + recipe);
+    std::FILE* f = std::fopen(output.c_str(), "w");
+    if (!f) throw std::runtime_error("Cannot write " + output);
+
+    std::map<std::string, std::string> vars;
+    std::string line;
+    size_t lineno = 0, written = 0, skipped = 0;
+    while (std::getline(rf, line)) {
+      lineno++;
+      line = trim(line.substr(0, line.find('#')));
+      if (line.empty()) continue;
+      const std::string where = recipe + ":" + std::to_string(lineno);
+      const size_t eq = line.find('=');
+      if (eq == std::string::npos) throw std::invalid_argument(where + ": expected OUTPUT = EXPRESSION");
+      const std::string lhs = trim(line.substr(0, eq)), rhs = trim(line.substr(eq + 1));
+
+      if (lhs[0] == '$') {
+        const std::string name = lhs.substr(1);
+        vars[name] = defines.count(name) ? defines[name] : rhs;
+        continue;
+      }
+      std::map<std::string, std::string> all = vars;
+      for (const auto& d : defines) all[d.first] = d.second;
+      const std::string out = substitute(lhs, all);
+      if (out.empty() || out[0] != '/') throw std::invalid_argument(where + ": output is not a path: " + out);
+
+      std::unique_ptr<Node> tree;
+      try {
+        tree = Parser(substitute(rhs, all)).parse();
+      }
+      catch (const std::invalid_argument& e) {
+        throw std::invalid_argument(where + ": " + e.what());
+      }
+
+      try {
+        const Value nominal = evaluate(*tree, in, "", out);
+        std::string text = scatter(out, nominal, precision);
+
+        // Bootstrap replicas, if every object of the line has them
+        std::vector<std::string> refs;
+        Parser::refs(*tree, refs);
+        for (size_t k = 0; !refs.empty(); k++) {
+          char suffix[32];
+          std::snprintf(suffix, sizeof(suffix), "[BOOT%03zu]", k);
+          Value replica;
+          try {
+            replica = evaluate(*tree, in, suffix, out);
+          }
+          catch (const Missing&) {
+            break;
+          }
+          text += scatter(out + suffix, replica, precision);
+        }
+        std::fwrite(text.data(), 1, text.size(), f);
+        written++;
+      }
+      catch (const Missing& m) {
+        std::cerr << where << ": skipped " << out << ", " << m.what() << " is missing" << std::endl;
+        skipped++;
+      }
+    }
+    std::fclose(f);
+    std::cout << "uspjwl-derive: wrote " << written << " observables to " << output;
+    if (skipped) std::cout << ", skipped " << skipped;
+    std::cout << std::endl;
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+// -*- C++ -*-
+
+// Reads the live histogram snapshots that running USPJWL analyses publish
+// in shared memory (USPJWL_SNAPSHOT, see USPJWL_Snapshot.hh).
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++14 -I. -o uspjwl-inspect tools/uspjwl-inspect.cc -lrt
+//
+// Usage:
+//   uspjwl-inspect
+//   uspjwl-inspect SEGMENT [-g PATTERN] [-o out.yoda|out.ybin] [-p DIGITS] [-w SECONDS]
+// Without arguments it lists the snapshot segments in /dev/shm with the
+// process that owns them and the number of events they cover. With a
+// SEGMENT (as listed, e.g. uspjwl_job1_USPJWL_JETSPEC) it prints one line
+// per histogram and counter: entries, sum of weights and the relative
+// uncertainty of the total. -g also draws the bins of the histograms whose
+// path contains PATTERN as text bars (sum of weights per unit x). -o saves
+// the snapshot as YODA text (unscaled, DIGITS digits, default 6) or as
+// .ybin, for the usual plotting tools. -w repeats every SECONDS until
+// interrupted or the job ends. Reading never blocks the job.
+
+#include "tools/BinHistoText.hh"
+#include "USPJWL_Snapshot.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+using namespace USPJWL;
+
+
+namespace {
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-inspect\n"
+              << "       uspjwl-inspect SEGMENT [-g PATTERN] [-o out.yoda|out.ybin] [-p DIGITS] [-w SECONDS]" << std::endl;
+  }
+
+
+  bool isRunning(uint32_t pid) {
+    return pid > 0 && (kill(pid_t(pid), 0) == 0 || errno == EPERM);
+  }
+
+
+  bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+
+  int list() {
+    DIR* dir = opendir("/dev/shm");
+    if (!dir) {
+      std::cerr << "Cannot list /dev/shm" << std::endl;
+      return 1;
+    }
+    std::vector<std::string> names;
+    while (dirent* e = readdir(dir)) {
+      const std::string name = e->d_name;
+      if (name.compare(0, 7, "uspjwl_") == 0) names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    std::printf("%-50s %8s %-8s %12s %10s\n", "segment", "pid", "state", "events", "snapshots");
+    for (const std::string& name : names) {
+      try {
+        const Snapshot::Reading r = Snapshot::read("/" + name);
+        std::printf("%-50s %8u %-8s %12llu %10llu\n", name.c_str(), r.pid, isRunning(r.pid) ? "running" : "gone",
+                    (unsigned long long)r.events, (unsigned long long)r.published);
+      }
+      catch (const std::exception& e) {
+        std::printf("%-50s %s\n", name.c_str(), e.what());
+      }
+    }
+    return 0;
+  }
+
+
+  void summary(const std::vector<BinHisto::Object>& objects) {
+    std::printf("%-60s %12s %14s %10s\n", "object", "entries", "sumw", "rel.err");
+    for (const BinHisto::Object& bo : objects) {
+      if (bo.kind == BinHisto::TEXT) continue;
+      const double sumw = bo.at(BinHisto::SUMW, BinHisto::TOTAL), sumw2 = bo.at(BinHisto::SUMW2, BinHisto::TOTAL);
+      std::printf("%-60s %12.0f %14.6g %10.3g\n", bo.path.c_str(), bo.at(BinHisto::NUMENTRIES, BinHisto::TOTAL), sumw,
+                  sumw != 0 ? std::sqrt(sumw2) / std::fabs(sumw) : 0.);
+    }
+  }
+
+
+  void bars(const BinHisto::Object& bo) {
+    const int WIDTH = 50;
+    std::vector<double> density(bo.numBins());
+    double top = 0.;
+    for (size_t i = 0; i < bo.numBins(); i++) {
+      density[i] = bo.at(BinHisto::SUMW, BinHisto::FIRSTBIN + i) / (bo.edges[i + 1] - bo.edges[i]);
+      top = std::max(top, std::fabs(density[i]));
+    }
+    std::printf("\n%s\n", bo.path.c_str());
+    for (size_t i = 0; i < bo.numBins(); i++) {
+      const size_t slot = BinHisto::FIRSTBIN + i;
+      const double sumw2 = bo.at(BinHisto::SUMW2, slot);
+      const int n = top > 0 ? int(std::lround(WIDTH * std::fabs(density[i]) / top)) : 0;
+      std::printf("  [%9.4g, %9.4g)  %12.5g +- %-10.3g |%s\n", bo.edges[i], bo.edges[i + 1], density[i],
+                  std::sqrt(sumw2) / (bo.edges[i + 1] - bo.edges[i]), std::string(n, '#').c_str());
+    }
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  if (argc == 1) return list();
+
+  std::string segment = argv[1], pattern, output;
+  int precision = 6;
+  double wait = 0.;
+  if (segment.empty() || segment[0] == '-') {
+    usage();
+    return 1;
+  }
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-g" && i + 1 < argc) pattern = argv[++i];
+    else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+    else if (arg == "-p" && i + 1 < argc) precision = std::atoi(argv[++i]);
+    else if (arg == "-w" && i + 1 < argc) wait = std::atof(argv[++i]);
+    else { usage(); return 1; }
+  }
+  if (segment[0] != '/') segment = "/" + segment;
+
+  try {
+    while (true) {
+      const Snapshot::Reading r = Snapshot::read(segment);
+      const std::vector<BinHisto::Object> objects = BinHisto::decode(r.data, segment);
+      std::printf("%s: pid %u (%s), %llu events, snapshot %llu\n", segment.c_str() + 1, r.pid,
+                  isRunning(r.pid) ? "running" : "gone", (unsigned long long)r.events, (unsigned long long)r.published);
+      summary(objects);
+      if (!pattern.empty()) {
+        for (const BinHisto::Object& bo : objects) {
+          if (bo.kind == BinHisto::HISTO1D && bo.path.find(pattern) != std::string::npos) bars(bo);
+        }
+      }
+
+      if (!output.empty()) {
+        if (endsWith(output, ".ybin")) BinHisto::write(output, objects);
+        else {
+          std::FILE* f = std::fopen(output.c_str(), "w");
+          if (!f) throw std::runtime_error("Cannot write " + output);
+          for (const BinHisto::Object& bo : objects) {
+            for (const YodaText::Object& obj : BinHistoText::toText(bo, precision)) YodaText::write(f, obj, precision);
+          }
+          std::fclose(f);
+        }
+      }
+
+      if (wait <= 0 || !isRunning(r.pid)) break;
+      std::fflush(stdout);
+      usleep(useconds_t(wait * 1e6));
+      std::printf("\n");
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
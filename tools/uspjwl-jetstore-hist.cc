@@ -0,0 +1,184 @@
+// -*- C++ -*-
+
+// Rebuilds a histogram from one or more per-jet stores (USPJWL_JetStore.hh)
+// and prints it as a YODA Histo1D, so new experimental binnings or cuts can
+// be matched without rerunning the analyses.
+//
+// Build (from the repository root):
+//   g++ -O3 -std=c++14 -I. -o uspjwl-jetstore-hist tools/uspjwl-jetstore-hist.cc
+//
+// Usage:
+//   uspjwl-jetstore-hist -x COLUMN (-e EDGE,EDGE,... | -b NBINS:LO:HI)
+//                        [-c COLUMN:LO:HI ...] [-p /PATH] store.jets [...]
+// COLUMN is any fixed column (pt, y, eta, mass, leadpt, zlead_r01, ...) or,
+// for -x only, a ragged column (zincl_r01, zincl_r02). Cuts select rows with
+// LO <= |value| < HI for y/eta and LO <= value < HI otherwise; rows with
+// a NaN in a cut column fail the cut.
+
+#include "USPJWL_JetStore.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace USPJWL::JetStore;
+
+
+namespace {
+
+  struct Dbn {
+    double sumw = 0, sumw2 = 0, sumwx = 0, sumwx2 = 0, n = 0;
+    void fill(double x, double w) {
+      sumw += w;
+      sumw2 += w * w;
+      sumwx += w * x;
+      sumwx2 += w * x * x;
+      n += 1;
+    }
+  };
+
+  struct CutSpec {
+    int column;
+    bool absolute;
+    double lo, hi;
+  };
+
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-jetstore-hist -x COLUMN (-e EDGES | -b NBINS:LO:HI) "
+              << "[-c COLUMN:LO:HI ...] [-p /PATH] store.jets [...]" << std::endl;
+  }
+
+
+  std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string tok;
+    while (std::getline(ss, tok, sep)) out.push_back(tok);
+    return out;
+  }
+
+
+  // Index of a fixed column, or NCOLUMNS + k for the ragged column k, or -1
+  int columnIndex(const std::string& name) {
+    for (int c = 0; c < NCOLUMNS; c++) if (name == COLUMN_NAMES[c]) return c;
+    for (size_t k = 0; k < NZ; k++) if (name == Z_NAMES[k]) return NCOLUMNS + k;
+    return -1;
+  }
+
+
+  void printDbn(const char* id, const Dbn& d) {
+    std::printf("%s\t%s\t%e\t%e\t%e\t%e\t%e\n", id, id, d.sumw, d.sumw2, d.sumwx, d.sumwx2, d.n);
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  std::string xname, path = "/USPJWL_JETSTORE/hist";
+  std::vector<double> edges;
+  std::vector<CutSpec> cuts;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-x" && i + 1 < argc) xname = argv[++i];
+    else if (arg == "-p" && i + 1 < argc) path = argv[++i];
+    else if (arg == "-e" && i + 1 < argc) {
+      for (const std::string& e : split(argv[++i], ',')) edges.push_back(std::atof(e.c_str()));
+    }
+    else if (arg == "-b" && i + 1 < argc) {
+      std::vector<std::string> b = split(argv[++i], ':');
+      if (b.size() != 3) { usage(); return 1; }
+      int nbins = std::atoi(b[0].c_str());
+      double lo = std::atof(b[1].c_str()), hi = std::atof(b[2].c_str());
+      for (int k = 0; k <= nbins; k++) edges.push_back(lo + (hi - lo) * k / nbins);
+    }
+    else if (arg == "-c" && i + 1 < argc) {
+      std::vector<std::string> c = split(argv[++i], ':');
+      if (c.size() != 3 || columnIndex(c[0]) < 0 || columnIndex(c[0]) >= NCOLUMNS) {
+        std::cerr << "Bad cut " << argv[i] << std::endl;
+        return 1;
+      }
+      CutSpec cut;
+      cut.column = columnIndex(c[0]);
+      cut.absolute = (cut.column == Y || cut.column == ETA);
+      cut.lo = c[1].empty() ? -HUGE_VAL : std::atof(c[1].c_str());
+      cut.hi = c[2].empty() ? HUGE_VAL : std::atof(c[2].c_str());
+      cuts.push_back(cut);
+    }
+    else if (arg == "-h" || arg == "--help") { usage(); return 0; }
+    else inputs.push_back(arg);
+  }
+
+  const int xcol = columnIndex(xname);
+  if (xcol < 0 || edges.size() < 2 || inputs.empty() || !std::is_sorted(edges.begin(), edges.end())) {
+    usage();
+    return 1;
+  }
+
+  const size_t nbins = edges.size() - 1;
+  std::vector<Dbn> bins(nbins);
+  Dbn total, underflow, overflow;
+
+  auto fill = [&](double x, double w) {
+    total.fill(x, w);
+    if (x < edges.front()) underflow.fill(x, w);
+    else if (x >= edges.back()) overflow.fill(x, w);
+    else bins[std::upper_bound(edges.begin(), edges.end(), x) - edges.begin() - 1].fill(x, w);
+  };
+
+  std::vector<char> pass;
+  for (const std::string& input : inputs) {
+    Reader store(input);
+    for (size_t b = 0; b < store.numBlocks(); b++) {
+      const BlockView bv = store.block(b);
+
+      // Evaluate the cuts column by column
+      pass.assign(bv.nJets, 1);
+      for (const CutSpec& cut : cuts) {
+        const float* col = bv.column[cut.column];
+        for (size_t j = 0; j < bv.nJets; j++) {
+          double v = cut.absolute ? std::fabs(col[j]) : col[j];
+          pass[j] &= (v >= cut.lo && v < cut.hi);
+        }
+      }
+
+      if (xcol < NCOLUMNS) {
+        const float* x = bv.column[xcol];
+        for (size_t j = 0; j < bv.nJets; j++) {
+          if (pass[j] && !std::isnan(x[j])) fill(x[j], bv.weight[j]);
+        }
+      }
+      else {
+        const size_t k = xcol - NCOLUMNS;
+        for (size_t j = 0; j < bv.nJets; j++) {
+          if (!pass[j]) continue;
+          for (uint64_t iz = bv.zoffset[k][j]; iz < bv.zoffset[k][j + 1]; iz++) fill(bv.z[k][iz], bv.weight[j]);
+        }
+      }
+    }
+  }
+
+  std::printf("BEGIN YODA_HISTO1D_V2 %s\n", path.c_str());
+  std::printf("Path: %s\nScaledBy: 1.000000e+00\nTitle: \nType: Histo1D\n---\n", path.c_str());
+  std::printf("# Mean: %e\n# Area: %e\n", total.sumw != 0 ? total.sumwx / total.sumw : 0., total.sumw);
+  std::printf("# ID\t ID\t sumw\t sumw2\t sumwx\t sumwx2\t numEntries\n");
+  printDbn("Total   ", total);
+  printDbn("Underflow", underflow);
+  printDbn("Overflow", overflow);
+  std::printf("# xlow\t xhigh\t sumw\t sumw2\t sumwx\t sumwx2\t numEntries\n");
+  for (size_t i = 0; i < nbins; i++) {
+    std::printf("%e\t%e\t%e\t%e\t%e\t%e\t%e\n", edges[i], edges[i + 1],
+                bins[i].sumw, bins[i].sumw2, bins[i].sumwx, bins[i].sumwx2, bins[i].n);
+  }
+  std::printf("END YODA_HISTO1D_V2\n\n");
+
+  return 0;
+}
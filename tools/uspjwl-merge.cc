@@ -0,0 +1,295 @@
+// -*- C++ -*-
+
+// Merges the YODA outputs of many USPJWL jobs (hydro events, centralities,
+// jet radii) into one file, as yodamerge does for unscaled histograms.
+//
+// Build (from the repository root):
+//   g++ -O3 -std=c++14 -pthread -I. -o uspjwl-merge tools/uspjwl-merge.cc
+//
+// Usage:
+//   uspjwl-merge -o merged.yoda [-j THREADS] [-p DIGITS] [-l LISTFILE] in.yoda [...]
+//
+// The inputs are split in contiguous chunks parsed on THREADS threads
+// (default: all cores), and the partial sums are combined in a pairwise
+// tree. All sums are kept exact (USPJWL_ExactSum.hh) and rounded once when
+// writing: the result is the correctly rounded sum of the inputs, the same
+// for any number of threads, tree shape and input order. It is not bit for
+// bit the output of yodamerge, whose left-to-right double sums round at
+// every step.
+//
+// Objects are classified by name:
+//  - counters (YODA counters, *_counter*, Number_Jets*, hNtrig_*,
+//    Skim_counter*) hold raw counts and must not have been scaled,
+//  - histograms and profiles are summed and must carry the same ScaledBy
+//    in every input (the analyses only scale after the merge, see
+//    tools/uspjwl-derive.cc),
+//  - scatters (e.g. _XSEC) are averaged over the inputs that contain them.
+// Values are written with DIGITS digits after the point (default 16,
+// lossless; 6 gives YODA's own format). -l reads input names from a file.
+//
+// Inputs may also be binary histogram files (.ybin, USPJWL_BinHisto.hh),
+// mixed freely with YODA text; an output name ending in .ybin writes the
+// binary format. Bin edges are matched as printed by Rivet (%e).
+
+#include "USPJWL_ExactSum.hh"
+#include "tools/BinHistoText.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace USPJWL;
+
+
+namespace {
+
+  enum Kind { COUNTER, HISTOGRAM, AVERAGE };
+
+  const char* KIND_NAMES[] = {"counter", "histogram", "average"};
+
+
+  Kind classify(const YodaText::Object& obj) {
+    if (obj.type.compare(0, 7, "SCATTER") == 0) return AVERAGE;
+    if (obj.type == "COUNTER") return COUNTER;
+    const std::string name = obj.path.substr(obj.path.rfind('/') + 1);
+    if (name.find("_counter") != std::string::npos || name.compare(0, 11, "Number_Jets") == 0
+        || name.compare(0, 7, "hNtrig_") == 0 || name.compare(0, 12, "Skim_counter") == 0) return COUNTER;
+    return HISTOGRAM;
+  }
+
+
+  // Running sums of one object
+  struct Accumulator {
+    std::shared_ptr<const YodaText::Object> proto;   // layout of the first input
+    Kind kind;
+    std::vector<size_t> offset;                      // first sum of each row
+    std::vector<ExactSum> sums;
+    size_t ninputs = 0;
+
+    size_t width(size_t r) const {
+      return (r + 1 < offset.size() ? offset[r + 1] : sums.size()) - offset[r];
+    }
+  };
+
+
+  // Sums over a contiguous range of inputs, objects in order of first appearance
+  struct Partial {
+    std::vector<Accumulator> accs;
+    std::unordered_map<std::string, size_t> index;
+
+    void check(const Accumulator& acc, const YodaText::Object& obj, const std::string& source) const {
+      const YodaText::Object& p = *acc.proto;
+      std::string what;
+      if (obj.tag != p.tag) what = "type " + obj.tag + " vs " + p.tag;
+      else if (obj.rows.size() != p.rows.size()) what = "different number of bins";
+      else if (acc.kind == COUNTER && obj.scaledBy != 1.) what = "counter already scaled";
+      else if (obj.scaledBy != p.scaledBy) what = "different ScaledBy, scale only after the merge";
+      else {
+        for (size_t r = 0; r < p.rows.size() && what.empty(); r++) {
+          if (obj.rows[r].key != p.rows[r].key || obj.rows[r].values.size() != acc.width(r))
+            what = "different binning";
+        }
+      }
+      if (!what.empty()) throw std::runtime_error(source + ": " + obj.path + ": " + what);
+    }
+
+    void add(YodaText::Object&& obj, const std::string& source) {
+      auto it = index.find(obj.path);
+      if (it == index.end()) {
+        Accumulator acc;
+        acc.kind = classify(obj);
+        if (acc.kind == COUNTER && obj.scaledBy != 1.)
+          throw std::runtime_error(source + ": " + obj.path + ": counter already scaled");
+        size_t n = 0;
+        for (const YodaText::Row& r : obj.rows) {
+          acc.offset.push_back(n);
+          n += r.values.size();
+        }
+        acc.sums.resize(n);
+        index[obj.path] = accs.size();
+        accs.push_back(std::move(acc));
+        it = index.find(obj.path);
+      }
+      else check(accs[it->second], obj, source);
+
+      Accumulator& acc = accs[it->second];
+      for (size_t r = 0; r < obj.rows.size(); r++) {
+        const std::vector<double>& v = obj.rows[r].values;
+        for (size_t c = 0; c < v.size(); c++) acc.sums[acc.offset[r] + c] += v[c];
+      }
+      acc.ninputs++;
+      if (!acc.proto) {
+        for (YodaText::Row& r : obj.rows) r.values.clear();
+        acc.proto = std::make_shared<const YodaText::Object>(std::move(obj));
+      }
+    }
+
+    // Appends the sums of a later range of inputs
+    void merge(Partial&& other) {
+      for (Accumulator& acc : other.accs) {
+        auto it = index.find(acc.proto->path);
+        if (it == index.end()) {
+          index[acc.proto->path] = accs.size();
+          accs.push_back(std::move(acc));
+          continue;
+        }
+        Accumulator& mine = accs[it->second];
+        const YodaText::Object& p = *acc.proto;
+        if (p.tag != mine.proto->tag || p.scaledBy != mine.proto->scaledBy || acc.sums.size() != mine.sums.size())
+          throw std::runtime_error(p.path + ": inconsistent inputs");
+        for (size_t r = 0; r < p.rows.size(); r++) {
+          if (p.rows[r].key != mine.proto->rows[r].key) throw std::runtime_error(p.path + ": different binning");
+        }
+        for (size_t i = 0; i < acc.sums.size(); i++) mine.sums[i] += acc.sums[i];
+        mine.ninputs += acc.ninputs;
+      }
+      other.accs.clear();
+      other.index.clear();
+    }
+  };
+
+
+  std::vector<YodaText::Object> readInput(const std::string& path) {
+    if (!BinHisto::isBinHisto(path)) return YodaText::read(path);
+    std::vector<YodaText::Object> out;
+    for (const BinHisto::Object& bo : BinHisto::read(path)) {
+      for (YodaText::Object& obj : BinHistoText::toText(bo, 6)) out.push_back(std::move(obj));
+    }
+    return out;
+  }
+
+
+  std::vector<std::string> readList(const std::string& listfile) {
+    std::ifstream in(listfile);
+    if (!in) throw std::runtime_error("cannot read " + listfile);
+    std::vector<std::string> out;
+    std::string line;
+    while (std::getline(in, line)) {
+      if (!line.empty() && line[0] != '#') out.push_back(line);
+    }
+    return out;
+  }
+
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-merge -o merged.yoda [-j THREADS] [-p DIGITS] [-l LISTFILE] in.yoda [...]" << std::endl;
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  std::string output;
+  std::vector<std::string> inputs;
+  size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+  int precision = 16;
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "-o" && i + 1 < argc) output = argv[++i];
+      else if (arg == "-j" && i + 1 < argc) nthreads = std::max(1, std::atoi(argv[++i]));
+      else if (arg.compare(0, 2, "-j") == 0 && arg.size() > 2) nthreads = std::max(1, std::atoi(arg.c_str() + 2));
+      else if (arg == "-p" && i + 1 < argc) precision = std::atoi(argv[++i]);
+      else if (arg == "-l" && i + 1 < argc) {
+        for (const std::string& f : readList(argv[++i])) inputs.push_back(f);
+      }
+      else if (arg == "-h" || arg == "--help") { usage(); return 0; }
+      else inputs.push_back(arg);
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  if (output.empty() || inputs.empty()) {
+    usage();
+    return 1;
+  }
+  nthreads = std::min(nthreads, inputs.size());
+
+  // Leaves: contiguous chunks of inputs
+  std::vector<Partial> partials(nthreads);
+  std::vector<std::exception_ptr> errors(nthreads);
+  auto parallel = [&](size_t njobs, const std::function<void(size_t)>& job) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < njobs; t++) {
+      threads.emplace_back([&, t] {
+        try { job(t); }
+        catch (...) { errors[t] = std::current_exception(); }
+      });
+    }
+    for (std::thread& th : threads) th.join();
+    for (std::exception_ptr& e : errors) if (e) std::rethrow_exception(e);
+  };
+
+  try {
+    parallel(nthreads, [&](size_t t) {
+      size_t first = inputs.size() * t / nthreads, last = inputs.size() * (t + 1) / nthreads;
+      for (size_t i = first; i < last; i++) {
+        for (YodaText::Object& obj : readInput(inputs[i])) partials[t].add(std::move(obj), inputs[i]);
+      }
+    });
+
+    // Pairwise tree: partial i absorbs partial i + stride
+    for (size_t stride = 1; stride < nthreads; stride *= 2) {
+      std::vector<size_t> left;
+      for (size_t i = 0; i + stride < nthreads; i += 2 * stride) left.push_back(i);
+      parallel(left.size(), [&](size_t k) {
+        partials[left[k]].merge(std::move(partials[left[k] + stride]));
+      });
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  const bool binary = output.size() > 5 && output.compare(output.size() - 5, 5, ".ybin") == 0;
+  std::vector<BinHisto::Object> binObjects;
+  std::FILE* f = binary ? nullptr : std::fopen(output.c_str(), "w");
+  if (!binary && !f) {
+    std::cerr << "Cannot write " << output << std::endl;
+    return 1;
+  }
+  size_t nkind[3] = {0, 0, 0};
+  for (const Accumulator& acc : partials[0].accs) {
+    YodaText::Object obj = *acc.proto;
+    for (size_t r = 0; r < obj.rows.size(); r++) {
+      std::vector<double>& v = obj.rows[r].values;
+      v.resize(acc.width(r));
+      for (size_t c = 0; c < v.size(); c++) {
+        v[c] = acc.sums[acc.offset[r] + c].value();
+        if (acc.kind == AVERAGE) v[c] /= acc.ninputs;
+      }
+    }
+    if (binary) binObjects.push_back(BinHistoText::fromText(obj, precision));
+    else YodaText::write(f, obj, precision);
+    nkind[acc.kind]++;
+  }
+  if (binary) {
+    try {
+      BinHisto::write(output, binObjects);
+    }
+    catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  else std::fclose(f);
+
+  std::cout << "Merged " << inputs.size() << " files into " << output << ":";
+  for (int k = 0; k < 3; k++) std::cout << " " << nkind[k] << " " << KIND_NAMES[k] << (nkind[k] == 1 ? "" : "s");
+  std::cout << std::endl;
+  return 0;
+}
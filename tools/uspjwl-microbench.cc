@@ -0,0 +1,407 @@
+// -*- C++ -*-
+
+// Microbenchmarks of the analysis kernels in USPJWL_Kernels.hh.
+//
+// Build (from the repository root; no Rivet needed, the kt reclustering
+// benchmark is included when the FastJet headers are found):
+//   g++ -O2 -std=c++14 -I. -o uspjwl-microbench tools/uspjwl-microbench.cc [$(fastjet-config --cxxflags --libs)]
+//
+// Usage:
+//   uspjwl-microbench [-n INPUTS] [-r REPEAT] [-s SEED]
+// Every kernel runs over the same random inputs (with the bin edges, NaN
+// and out-of-range values mixed in) as a verbatim copy of the code it
+// replaced in the analyses. The outputs must agree bit for bit; the table
+// gives the best of REPEAT timings for both and the speedup. The exit
+// status is 1 if any kernel differs from its reference.
+
+#include "USPJWL_Kernels.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+  // Reference copies of the original code
+
+  namespace Reference {
+
+    // USPJWL_JETSPEC
+    int absrapRange(double jety) {
+      std::vector<double> ABSRAPEDGES = {0., 0.3, 0.8, 1.2, 1.6, 2.1, 2.8};
+      int pos = 0;
+      for (double edge : ABSRAPEDGES) {
+        if (jety > edge) pos++;
+        else return pos;
+      }
+      return 0;
+    }
+
+    int pTRange(double jetpT) {
+      std::vector<double> PTEDGES = {10., 30., 60., 90., 100., 112., 126., 141.,
+                                     158., 178., 200., 224., 251., 282., 316.,
+                                     398., 562., 630., 1000.};
+      int pos = 0;
+      for (double edge : PTEDGES) {
+        if (jetpT > edge) pos++;
+        else return pos;
+      }
+      return 0;
+    }
+
+    // USPJWL_INOUTPLANESPEC
+    double planeConversion(double psi) {
+      return fmod(psi + 2 * M_PI, 2 * M_PI);
+    }
+
+    double angDistance(double phi1, double phi2) {
+      double phi1_conv = planeConversion(phi1), phi2_conv = planeConversion(phi2);
+      double diff = std::abs(phi1_conv - phi2_conv);
+      return diff > M_PI ? 2 * M_PI - diff : diff;
+    }
+
+    bool isInPlane(double phi, double psi, int n) {
+      std::vector<double> dists = {};
+      double maxinplanedist = (2. / 3.) * M_PI / (2 * n);
+      for (int i = 0; i < n - 1; i++) {
+        dists.push_back(angDistance(phi, psi + 2 * M_PI * i / n));
+      }
+      double mindist = *std::min_element(std::begin(dists), std::end(dists));
+      return mindist < maxinplanedist;
+    }
+
+    // Rivet 3 MathUtils: deltaPhi and the phi() of a four-momentum
+    bool isZero(double x) { return std::fabs(x) < 1e-8; }
+
+    double mapAngleM2PITo2Pi(double angle) {
+      double rtn = fmod(angle, 2 * M_PI);
+      if (isZero(rtn)) return 0;
+      return rtn;
+    }
+
+    double mapAngleMPiToPi(double angle) {
+      double rtn = mapAngleM2PITo2Pi(angle);
+      if (isZero(rtn)) return 0;
+      if (rtn > M_PI) rtn -= 2 * M_PI;
+      if (rtn <= -M_PI) rtn += 2 * M_PI;
+      return rtn;
+    }
+
+    double mapAngle0To2Pi(double angle) {
+      double rtn = mapAngleM2PITo2Pi(angle);
+      if (isZero(rtn)) return 0;
+      if (rtn < 0) rtn += 2 * M_PI;
+      if (rtn == 2 * M_PI) rtn = 0;
+      return rtn;
+    }
+
+    double deltaPhi(double phi1, double phi2) {
+      return std::fabs(mapAngleMPiToPi(phi1 - phi2));
+    }
+
+    double phi(double px, double py) {
+      if (isZero(px * px + py * py)) return 0.;
+      return mapAngle0To2Pi(std::atan2(py, px));
+    }
+
+    // USPJWL_JET_MASS: index of the histogram filled, -1 for none
+    int massSlice(double pt) {
+      int filled = -1;
+      if (60.0 <= pt && pt < 80.0) filled = 0;
+      if (80.0 <= pt && pt < 100.0) filled = 1;
+      if (100.0 <= pt && pt < 120.0) filled = 2;
+      if (120.0 <= pt && pt < 140.0) filled = 3;
+      if (140.0 <= pt && pt < 160.0) filled = 4;
+      if (160.0 <= pt && pt < 180.0) filled = 5;
+      if (180.0 <= pt && pt < 200.0) filled = 6;
+      if (200.0 <= pt && pt < 220.0) filled = 7;
+      if (220.0 <= pt && pt < 240.0) filled = 8;
+      if (240.0 <= pt && pt < 260.0) filled = 9;
+      if (260.0 <= pt && pt < 280.0) filled = 10;
+      if (280.0 <= pt && pt < 300.0) filled = 11;
+      if (300.0 <= pt) filled = 12;
+      return filled;
+    }
+
+  }
+
+
+  struct Options {
+    size_t inputs = 1 << 16;
+    int repeat = 7;
+    unsigned long seed = 12345;
+  };
+
+
+  // Best wall time of repeated runs of f, in nanoseconds per input
+  template <typename F>
+  double bestNs(F f, size_t inputs, int repeat) {
+    double best = std::numeric_limits<double>::infinity();
+    for (int k = 0; k < repeat; k++) {
+      auto start = std::chrono::steady_clock::now();
+      f();
+      auto stop = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count());
+    }
+    return best / inputs;
+  }
+
+
+  template <typename T>
+  bool sameBits(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+  }
+
+
+  bool report(const char* name, double refNs, double newNs, bool identical) {
+    std::printf("%-28s %12.2f %12.2f %9.2fx  %s\n", name, refNs, newNs, refNs / newNs, identical ? "identical" : "DIFFERENT");
+    return identical;
+  }
+
+
+  // Values spread over [lo, hi], with the given edges and NaN mixed in
+  std::vector<double> sample(std::mt19937_64& rng, size_t n, double lo, double hi, const std::vector<double>& special) {
+    std::uniform_real_distribution<double> flat(lo, hi);
+    std::vector<double> xs(n);
+    for (size_t i = 0; i < n; i++) {
+      if (i % 16 == 0 && !special.empty()) xs[i] = special[(i / 16) % special.size()];
+      else xs[i] = flat(rng);
+    }
+    xs.back() = std::numeric_limits<double>::quiet_NaN();
+    return xs;
+  }
+
+
+  // Analyses' bin lookups
+  bool benchRanges(const Options& opt, std::mt19937_64& rng) {
+    static const double ABSRAPEDGES[] = {0., 0.3, 0.8, 1.2, 1.6, 2.1, 2.8};
+    static const double PTEDGES[] = {10., 30., 60., 90., 100., 112., 126., 141., 158., 178.,
+                                     200., 224., 251., 282., 316., 398., 562., 630., 1000.};
+    bool ok = true;
+
+    std::vector<double> ys = sample(rng, opt.inputs, -0.5, 3.2, {0., 0.3, 0.8, 1.2, 1.6, 2.1, 2.8, -0.});
+    std::vector<int> ref(ys.size()), out(ys.size());
+    auto runRef = [&]() { for (size_t i = 0; i < ys.size(); i++) ref[i] = Reference::absrapRange(ys[i]); };
+    auto runNew = [&]() { for (size_t i = 0; i < ys.size(); i++) out[i] = USPJWL::Kernels::edgeRange(ABSRAPEDGES, ys[i]); };
+    double tRef = bestNs(runRef, ys.size(), opt.repeat), tNew = bestNs(runNew, ys.size(), opt.repeat);
+    ok &= report("absrapRange", tRef, tNew, ref == out);
+
+    std::vector<double> pts = sample(rng, opt.inputs, 0., 1200., {10., 30., 60., 90., 100., 112., 126., 141., 158., 178.,
+                                                                  200., 224., 251., 282., 316., 398., 562., 630., 1000.});
+    ref.assign(pts.size(), 0);
+    out.assign(pts.size(), 0);
+    auto runRefPt = [&]() { for (size_t i = 0; i < pts.size(); i++) ref[i] = Reference::pTRange(pts[i]); };
+    auto runNewPt = [&]() { for (size_t i = 0; i < pts.size(); i++) out[i] = USPJWL::Kernels::edgeRange(PTEDGES, pts[i]); };
+    tRef = bestNs(runRefPt, pts.size(), opt.repeat);
+    tNew = bestNs(runNewPt, pts.size(), opt.repeat);
+    ok &= report("pTRange", tRef, tNew, ref == out);
+    return ok;
+  }
+
+
+  // In- and out-of-plane classification of USPJWL_INOUTPLANESPEC for n = 2, 3, 4
+  bool benchInPlane(const Options& opt, std::mt19937_64& rng) {
+    std::vector<double> phis = sample(rng, opt.inputs, 0., 2 * M_PI, {0., M_PI / 6, M_PI / 2, M_PI, 2 * M_PI});
+    std::uniform_real_distribution<double> flat(-M_PI, M_PI);
+    const double psi2 = Reference::planeConversion(flat(rng)), psi3 = Reference::planeConversion(flat(rng)),
+                 psi4 = Reference::planeConversion(flat(rng));
+
+    // One byte per jet: the in/out bits of the three harmonics, as filled by the analysis
+    std::vector<unsigned char> ref(phis.size()), out(phis.size());
+    auto runRef = [&]() {
+      for (size_t i = 0; i < phis.size(); i++) {
+        double phi = phis[i];
+        unsigned char b = 0;
+        if (Reference::isInPlane(phi, psi2, 2)) b |= 1; else if (Reference::isInPlane(phi, psi2 + M_PI / 2, 2)) b |= 2;
+        if (Reference::isInPlane(phi, psi3, 3)) b |= 4; else if (Reference::isInPlane(phi, psi2 + M_PI / 3, 2)) b |= 8;
+        if (Reference::isInPlane(phi, psi4, 4)) b |= 16; else if (Reference::isInPlane(phi, psi2 + M_PI / 4, 2)) b |= 32;
+        ref[i] = b;
+      }
+    };
+    auto runNew = [&]() {
+      using USPJWL::Kernels::inPlane;
+      for (size_t i = 0; i < phis.size(); i++) {
+        double phi = phis[i];
+        unsigned char b = 0;
+        if (inPlane(phi, psi2, 2)) b |= 1; else if (inPlane(phi, psi2 + M_PI / 2, 2)) b |= 2;
+        if (inPlane(phi, psi3, 3)) b |= 4; else if (inPlane(phi, psi2 + M_PI / 3, 2)) b |= 8;
+        if (inPlane(phi, psi4, 4)) b |= 16; else if (inPlane(phi, psi2 + M_PI / 4, 2)) b |= 32;
+        out[i] = b;
+      }
+    };
+    double tRef = bestNs(runRef, phis.size(), opt.repeat), tNew = bestNs(runNew, phis.size(), opt.repeat);
+    return report("isInPlane (n=2,3,4)", tRef, tNew, ref == out);
+  }
+
+
+  // deltaPhi alone, over any pair of angles
+  bool benchDeltaPhi(const Options& opt, std::mt19937_64& rng) {
+    std::vector<double> a = sample(rng, opt.inputs, -8., 8., {0., M_PI, -M_PI, 2 * M_PI, 1e-9});
+    std::vector<double> b = sample(rng, opt.inputs, 0., 2 * M_PI, {0., M_PI, 2 * M_PI});
+    std::vector<double> ref(a.size()), out(a.size());
+    auto runRef = [&]() { for (size_t i = 0; i < a.size(); i++) ref[i] = Reference::deltaPhi(a[i], b[i]); };
+    auto runNew = [&]() { for (size_t i = 0; i < a.size(); i++) out[i] = USPJWL::Kernels::deltaPhi(a[i], b[i]); };
+    double tRef = bestNs(runRef, a.size(), opt.repeat), tNew = bestNs(runNew, a.size(), opt.repeat);
+    return report("deltaPhi", tRef, tNew, sameBits(ref, out));
+  }
+
+
+  // The trigger x jet loop of USPJWL_HJET: every jet's phi and pT were
+  // computed again for every trigger, now once per event into a table
+  bool benchTriggerJets(const Options& opt, std::mt19937_64& rng) {
+    const size_t ntrig = 8, njets = 40;
+    const size_t nevents = std::max<size_t>(1, opt.inputs / (ntrig * njets));
+    std::uniform_real_distribution<double> flat(0., 1.);
+    std::vector<double> trigPhi(nevents * ntrig), px(nevents * njets), py(nevents * njets);
+    for (double& p : trigPhi) p = 2 * M_PI * flat(rng);
+    for (size_t i = 0; i < px.size(); i++) {
+      double pt = 0.15 + 60 * flat(rng), phi = 2 * M_PI * flat(rng);
+      px[i] = pt * std::cos(phi);
+      py[i] = pt * std::sin(phi);
+    }
+
+    // The pT of every recoil jet found, in fill order
+    std::vector<double> ref, out;
+    ref.reserve(nevents * ntrig * njets);
+    out.reserve(nevents * ntrig * njets);
+    auto runRef = [&]() {
+      ref.clear();
+      for (size_t e = 0; e < nevents; e++) {
+        for (size_t t = 0; t < ntrig; t++) {
+          double phi = trigPhi[e * ntrig + t];
+          for (size_t j = e * njets; j < (e + 1) * njets; j++) {
+            double phi_j = Reference::phi(px[j], py[j]), pt_j = std::sqrt(px[j] * px[j] + py[j] * py[j]);
+            if (Reference::deltaPhi(phi, phi_j) >= M_PI - 0.6) ref.push_back(pt_j);
+          }
+        }
+      }
+    };
+    std::vector<double> tablePhi(njets), tablePt(njets);
+    auto runNew = [&]() {
+      out.clear();
+      for (size_t e = 0; e < nevents; e++) {
+        for (size_t j = 0; j < njets; j++) {
+          size_t k = e * njets + j;
+          tablePhi[j] = Reference::phi(px[k], py[k]);
+          tablePt[j] = std::sqrt(px[k] * px[k] + py[k] * py[k]);
+        }
+        for (size_t t = 0; t < ntrig; t++) {
+          double phi = trigPhi[e * ntrig + t];
+          for (size_t j = 0; j < njets; j++) {
+            if (USPJWL::Kernels::deltaPhi(phi, tablePhi[j]) >= M_PI - 0.6) out.push_back(tablePt[j]);
+          }
+        }
+      }
+    };
+    size_t pairs = nevents * ntrig * njets;
+    double tRef = bestNs(runRef, pairs, opt.repeat), tNew = bestNs(runNew, pairs, opt.repeat);
+    return report("trigger x jet deltaPhi", tRef, tNew, sameBits(ref, out));
+  }
+
+
+  // Jet-mass pT slice dispatch of USPJWL_JET_MASS
+  bool benchMassSlice(const Options& opt, std::mt19937_64& rng) {
+    static const double MASS_PT_SLICES[13] = {60.0, 80.0, 100.0, 120.0, 140.0, 160.0, 180.0,
+                                              200.0, 220.0, 240.0, 260.0, 280.0, 300.0};
+    std::vector<double> pts = sample(rng, opt.inputs, 20., 400., std::vector<double>(std::begin(MASS_PT_SLICES), std::end(MASS_PT_SLICES)));
+    std::vector<int> ref(pts.size()), out(pts.size());
+    auto runRef = [&]() { for (size_t i = 0; i < pts.size(); i++) ref[i] = Reference::massSlice(pts[i]); };
+    auto runNew = [&]() { for (size_t i = 0; i < pts.size(); i++) out[i] = USPJWL::Kernels::slice(MASS_PT_SLICES, pts[i]); };
+    double tRef = bestNs(runRef, pts.size(), opt.repeat), tNew = bestNs(runNew, pts.size(), opt.repeat);
+    return report("jet mass pT slice", tRef, tNew, ref == out);
+  }
+
+
+#ifdef USPJWL_KERNELS_FASTJET
+  // Stands in for a Rivet Particle, which ClusterSequence converts to a
+  // PseudoJet every time it is handed the constituents
+  struct Constituent {
+    double px, py, pz, E;
+    operator fastjet::PseudoJet() const { return fastjet::PseudoJet(px, py, pz, E); }
+  };
+
+  // Per-jet kt reclustering of USPJWL_SUBFRAG for r = 0.1 and 0.2
+  bool benchKtSubjets(const Options& opt, std::mt19937_64& rng) {
+    const size_t njets = std::max<size_t>(1, opt.inputs / 256);
+    std::uniform_real_distribution<double> flat(0., 1.);
+    std::normal_distribution<double> angle(0., 0.15);
+    std::vector<std::vector<Constituent> > jets(njets);
+    for (std::vector<Constituent>& jet : jets) {
+      size_t n = 5 + size_t(35 * flat(rng));
+      for (size_t i = 0; i < n; i++) {
+        double pt = 0.15 + 20 * flat(rng) * flat(rng), eta = angle(rng), phi = 1. + angle(rng);
+        double px = pt * std::cos(phi), py = pt * std::sin(phi), pz = pt * std::sinh(eta);
+        jet.push_back({px, py, pz, std::sqrt(px * px + py * py + pz * pz)});
+      }
+    }
+    const double rs[] = {0.1, 0.2};
+
+    std::vector<double> ref, out, pts;
+    auto runRef = [&]() {
+      ref.clear();
+      for (const std::vector<Constituent>& jetconsti : jets) {
+        for (double r : rs) {
+          fastjet::JetDefinition def_subjet(fastjet::kt_algorithm, r);
+          fastjet::ClusterSequence cs(jetconsti, def_subjet);
+          std::vector<fastjet::PseudoJet> subjets = fastjet::sorted_by_pt(cs.inclusive_jets());
+          for (auto subj : subjets) ref.push_back(subj.perp());
+        }
+      }
+    };
+    auto runNew = [&]() {
+      out.clear();
+      std::vector<fastjet::PseudoJet> jetpseudo;
+      for (const std::vector<Constituent>& jetconsti : jets) {
+        jetpseudo.assign(jetconsti.begin(), jetconsti.end());
+        for (double r : rs) {
+          USPJWL::Kernels::ktSubjetPts(jetpseudo, r, pts);
+          out.insert(out.end(), pts.begin(), pts.end());
+        }
+      }
+    };
+    double tRef = bestNs(runRef, njets, opt.repeat), tNew = bestNs(runNew, njets, opt.repeat);
+    return report("kt subjets (per jet)", tRef, tNew, sameBits(ref, out));
+  }
+#endif
+
+}
+
+
+int main(int argc, char** argv) {
+
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc) opt.inputs = std::max(16L, std::atol(argv[++i]));
+    else if (arg == "-r" && i + 1 < argc) opt.repeat = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "-s" && i + 1 < argc) opt.seed = std::strtoul(argv[++i], nullptr, 10);
+    else {
+      std::cerr << "Usage: uspjwl-microbench [-n INPUTS] [-r REPEAT] [-s SEED]" << std::endl;
+      return arg == "-h" || arg == "--help" ? 0 : 1;
+    }
+  }
+
+  std::mt19937_64 rng(opt.seed);
+  std::printf("%-28s %12s %12s %10s  %s\n", "kernel", "ref ns/call", "new ns/call", "speedup", "output");
+  bool ok = true;
+  ok &= benchRanges(opt, rng);
+  ok &= benchInPlane(opt, rng);
+  ok &= benchDeltaPhi(opt, rng);
+  ok &= benchTriggerJets(opt, rng);
+  ok &= benchMassSlice(opt, rng);
+#ifdef USPJWL_KERNELS_FASTJET
+  ok &= benchKtSubjets(opt, rng);
+#else
+  std::printf("%-28s (FastJet headers not found, skipped)\n", "kt subjets (per jet)");
+#endif
+  return ok ? 0 : 1;
+}
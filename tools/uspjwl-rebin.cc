@@ -0,0 +1,190 @@
+// -*- C++ -*-
+
+// Projects master histograms (USPJWL_Master.hh) of a merged output to new
+// binnings, without rerunning the jobs.
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++14 -I. -o uspjwl-rebin tools/uspjwl-rebin.cc
+//
+// Usage:
+//   uspjwl-rebin in.yoda|in.ybin -o out.yoda|out.ybin [-p DIGITS] SPEC [...]
+// with every SPEC
+//   TARGET=MASTER[+MASTER...]:EDGE,EDGE,...
+// e.g.
+//   uspjwl-rebin merged.yoda -o rebinned.yoda 'JetpT_0_0.8_R0.4=JetpT_0_0.3_R0.4+JetpT_0.3_0.8_R0.4:30,50,79,125,199,316,1000'
+// Names are taken relative to the analysis directory, in every analysis of
+// the file. If TARGET and every MASTER end in '*', they match any suffix,
+// which is carried over from the first master: the subtraction and
+// centrality tags and the bootstrap replicas of a master get their own
+// projection. Every new edge must be an edge of the masters. The output is
+// the input plus the projected histograms, which replace objects of the
+// same path; an output name ending in .ybin writes the binary format, and
+// YODA text is written with DIGITS digits after the point (default 16).
+
+#include "tools/BinHistoText.hh"
+#include "USPJWL_Master.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace USPJWL;
+
+
+namespace {
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-rebin in.yoda|in.ybin -o out.yoda|out.ybin [-p DIGITS] TARGET=MASTER[+MASTER...]:EDGES [...]"
+              << std::endl;
+  }
+
+
+  bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+
+  struct Spec {
+    std::string target;
+    std::vector<std::string> masters;
+    std::vector<double> edges;
+    bool wildcard;
+  };
+
+
+  Spec parseSpec(const std::string& text) {
+    const size_t eq = text.find('='), colon = text.rfind(':');
+    if (eq == std::string::npos || colon == std::string::npos || colon < eq) throw std::invalid_argument("Bad projection " + text);
+    Spec spec;
+    spec.target = text.substr(0, eq);
+    std::istringstream masters(text.substr(eq + 1, colon - eq - 1)), edges(text.substr(colon + 1));
+    std::string item;
+    while (std::getline(masters, item, '+')) {
+      if (!item.empty()) spec.masters.push_back(item);
+    }
+    while (std::getline(edges, item, ',')) {
+      if (!item.empty()) spec.edges.push_back(std::stod(item));
+    }
+    if (spec.target.empty() || spec.masters.empty() || spec.edges.size() < 2) throw std::invalid_argument("Bad projection " + text);
+    for (size_t i = 1; i < spec.edges.size(); i++) {
+      if (!(spec.edges[i - 1] < spec.edges[i])) throw std::invalid_argument("Edges are not increasing in " + text);
+    }
+
+    spec.wildcard = endsWith(spec.target, "*");
+    for (std::string& m : spec.masters) {
+      if (endsWith(m, "*") != spec.wildcard) throw std::invalid_argument("Either all or none of the names end in '*': " + text);
+      if (spec.wildcard) m.pop_back();
+    }
+    if (spec.wildcard) spec.target.pop_back();
+    return spec;
+  }
+
+
+  std::vector<BinHisto::Object> readObjects(const std::string& path, int precision) {
+    if (BinHisto::isBinHisto(path)) return BinHisto::read(path);
+    std::vector<BinHisto::Object> objects;
+    for (const YodaText::Object& obj : YodaText::read(path)) objects.push_back(BinHistoText::fromText(obj, precision));
+    return objects;
+  }
+
+
+  // New histograms of spec from objects
+  std::vector<BinHisto::Object> project(const Spec& spec, const std::vector<BinHisto::Object>& objects,
+                                        const std::unordered_map<std::string, size_t>& index) {
+    std::vector<BinHisto::Object> out;
+    for (const BinHisto::Object& first : objects) {
+      if (first.kind != BinHisto::HISTO1D) continue;
+      const size_t slash = first.path.rfind('/');
+      const std::string dir = first.path.substr(0, slash + 1), name = first.path.substr(slash + 1);
+      if (spec.wildcard ? name.compare(0, spec.masters[0].size(), spec.masters[0]) != 0 : name != spec.masters[0]) continue;
+      const std::string suffix = name.substr(spec.masters[0].size());
+
+      BinHisto::Object target;
+      target.kind = BinHisto::HISTO1D;
+      target.path = dir + spec.target + suffix;
+      target.annotations = "Path: " + target.path + "\nTitle: \nType: Histo1D";
+      target.scaledBy = first.scaledBy;
+      target.edges = spec.edges;
+      target.resize();
+      for (const std::string& m : spec.masters) {
+        const auto it = index.find(dir + m + suffix);
+        if (it == index.end()) throw std::runtime_error("Master " + dir + m + suffix + " of " + target.path + " is missing");
+        const BinHisto::Object& master = objects[it->second];
+        if (master.scaledBy != first.scaledBy) throw std::runtime_error("Masters of " + target.path + " are scaled differently");
+        Master::addProjection(master, target);
+      }
+      out.push_back(target);
+    }
+    return out;
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  if (argc < 2 || argv[1][0] == '-') {
+    usage();
+    return 1;
+  }
+  const std::string input = argv[1];
+  std::string output;
+  int precision = 16;
+  std::vector<std::string> specs;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) output = argv[++i];
+    else if (arg == "-p" && i + 1 < argc) precision = std::atoi(argv[++i]);
+    else if (!arg.empty() && arg[0] != '-') specs.push_back(arg);
+    else { usage(); return 1; }
+  }
+  if (output.empty() || specs.empty()) {
+    usage();
+    return 1;
+  }
+
+  try {
+    std::vector<BinHisto::Object> objects = readObjects(input, precision);
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < objects.size(); i++) index[objects[i].path] = i;
+
+    // Masters are taken from the input, never from other projections
+    std::vector<BinHisto::Object> projected;
+    for (const std::string& text : specs) {
+      const Spec spec = parseSpec(text);
+      const std::vector<BinHisto::Object> out = project(spec, objects, index);
+      if (out.empty()) std::cerr << "uspjwl-rebin: no master matches " << text << std::endl;
+      projected.insert(projected.end(), out.begin(), out.end());
+    }
+    for (BinHisto::Object& bo : projected) {
+      const auto it = index.find(bo.path);
+      if (it != index.end()) objects[it->second] = bo;
+      else {
+        index[bo.path] = objects.size();
+        objects.push_back(bo);
+      }
+    }
+    std::cout << "uspjwl-rebin: " << projected.size() << " projected histograms" << std::endl;
+
+    if (endsWith(output, ".ybin")) BinHisto::write(output, objects);
+    else {
+      std::FILE* f = std::fopen(output.c_str(), "w");
+      if (!f) throw std::runtime_error("Cannot write " + output);
+      for (const BinHisto::Object& bo : objects) {
+        for (const YodaText::Object& obj : BinHistoText::toText(bo, precision)) YodaText::write(f, obj, precision);
+      }
+      std::fclose(f);
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,157 @@
+// -*- C++ -*-
+
+// Replays subtracted final-state caches written by USPJWL_FSCACHE through
+// the USPJWL analyses, without reading HepMC or subtracting again.
+//
+// Cached particles are already subtracted and carry no scattering centres,
+// so the SubtractedJewelEvent projections pass them through unchanged.
+//
+// Inputs ending in .hepmc are read as HepMC IO_GenEvent files instead, such
+// as the slow events captured with USPJWL_SLOWEVENTS (see
+// USPJWL_SlowEvents.hh). With -r every event is analysed REPEAT times (each
+// under a new event number) to give a profiler enough samples, e.g.
+//   perf record -g ./uspjwl-replay -a USPJWL_HJET -r 100 -t slow_USPJWL_HJET.slow.hepmc
+// and -t prints the mean analysis time of every input event.
+//
+// Build (from the repository root):
+//   g++ -O2 -std=c++14 -I. -o uspjwl-replay tools/uspjwl-replay.cc $(rivet-config --cppflags --ldflags --libs)
+//
+// Usage:
+//   uspjwl-replay -a USPJWL_JETSPEC[,USPJWL_SUBFRAG,...] [-o out.yoda]
+//                 [-n maxevents] [-r repeat] [-t] cache1.fscache [events.hepmc ...]
+// The analysis plugins are found through RIVET_ANALYSIS_PATH as usual,
+// and environment settings such as RJETS apply as in a normal run.
+
+#include "Rivet/AnalysisHandler.hh"
+#include "HepMC/GenEvent.h"
+#include "HepMC/GenParticle.h"
+#include "HepMC/GenVertex.h"
+#include "HepMC/IO_GenEvent.h"
+#include "USPJWL_EventCache.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+  void usage() {
+    std::cerr << "Usage: uspjwl-replay -a ANALYSIS[,ANALYSIS...] [-o out.yoda] [-n maxevents] "
+              << "[-r repeat] [-t] cache.fscache|events.hepmc [...]" << std::endl;
+  }
+
+
+  bool isHepMC(const std::string& path) {
+    const std::string ext = ".hepmc";
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+
+  // Rebuild a minimal HepMC event holding only the cached final state
+  void fillGenEvent(const USPJWL::EventCache::EventView& ev, HepMC::GenEvent& ge) {
+    ge.use_units(HepMC::Units::GEV, HepMC::Units::MM);
+    ge.set_event_number(ev.number);
+    ge.weights().push_back(ev.weight);
+
+    HepMC::GenVertex* vtx = new HepMC::GenVertex();
+    ge.add_vertex(vtx);
+    for (size_t i = 0; i < ev.size; i++) {
+      double pt = ev.pt[i], eta = ev.eta[i], phi = ev.phi[i], m = ev.m[i];
+      double px = pt * std::cos(phi), py = pt * std::sin(phi), pz = pt * std::sinh(eta);
+      // Subtraction can leave negative m^2, stored as a negative mass
+      double e2 = pt * pt + pz * pz + (m >= 0 ? m * m : -m * m);
+      HepMC::GenParticle* p = new HepMC::GenParticle(HepMC::FourVector(px, py, pz, std::sqrt(std::max(e2, 0.))),
+                                                     ev.pid[i], 1);
+      p->set_generated_mass(m);
+      vtx->add_particle_out(p);
+    }
+  }
+
+}
+
+
+int main(int argc, char** argv) {
+
+  std::vector<std::string> analyses, inputs;
+  std::string output = "Rivet.yoda";
+  long maxevents = -1, repeat = 1;
+  bool timing = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-a" && i + 1 < argc) {
+      std::stringstream ss(argv[++i]);
+      std::string name;
+      while (std::getline(ss, name, ',')) if (!name.empty()) analyses.push_back(name);
+    }
+    else if (arg == "-o" && i + 1 < argc) output = argv[++i];
+    else if (arg == "-n" && i + 1 < argc) maxevents = std::atol(argv[++i]);
+    else if (arg == "-r" && i + 1 < argc) repeat = std::max(1L, std::atol(argv[++i]));
+    else if (arg == "-t") timing = true;
+    else if (arg == "-h" || arg == "--help") { usage(); return 0; }
+    else inputs.push_back(arg);
+  }
+
+  if (analyses.empty() || inputs.empty()) {
+    usage();
+    return 1;
+  }
+
+  Rivet::AnalysisHandler ah("uspjwl-replay");
+  ah.setIgnoreBeams(true);
+  ah.addAnalyses(analyses);
+
+  long nevt = 0;
+  int number = 0;
+
+  // Repeated events get fresh numbers, so that Rivet does not group them as sub-events
+  auto analyze = [&](HepMC::GenEvent& ge) {
+    const int original = ge.event_number();
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < repeat; r++) {
+      if (repeat > 1) ge.set_event_number(++number);
+      ah.analyze(ge);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    if (timing) {
+      std::cout << "event " << original << ": "
+                << 1e3 * std::chrono::duration<double>(stop - start).count() / repeat << " ms" << std::endl;
+    }
+    nevt++;
+  };
+
+  for (const std::string& input : inputs) {
+    if (isHepMC(input)) {
+      HepMC::IO_GenEvent in(input, std::ios::in);
+      while (maxevents < 0 || nevt < maxevents) {
+        std::unique_ptr<HepMC::GenEvent> ge(in.read_next_event());
+        if (!ge) break;
+        analyze(*ge);
+      }
+      continue;
+    }
+
+    USPJWL::EventCache::Reader cache(input);
+    std::cout << input << ": " << cache.numEvents() << " events" << std::endl;
+
+    for (size_t i = 0; i < cache.numEvents(); i++) {
+      if (maxevents >= 0 && nevt >= maxevents) break;
+      HepMC::GenEvent ge;
+      fillGenEvent(cache.event(i), ge);
+      analyze(ge);
+    }
+  }
+
+  ah.finalize();
+  ah.writeData(output);
+  std::cout << "Replayed " << nevt << " events into " << output << std::endl;
+
+  return 0;
+}